@@ -1,12 +1,15 @@
 #include "NAMPlugin.hpp"
 #include <algorithm>
-#include <cfenv>
+#include <chrono>
 #include <cmath>
 #include <cstring>
+#include <istream>
 
 #include <NeuralAudio/NeuralModel.h>
 
-#include "architecture.hpp"
+#include "nam_denormals.h"
+#include "nam_model_file.h"
+#include "nam_rt_check.h"
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
@@ -89,6 +92,56 @@ void NAMPlugin::initParameter(uint32_t index, Parameter& parameter)
         parameter.ranges.min = 0.0f;
         parameter.ranges.max = 1.0f;
         break;
+
+    case kParameterInputPeak:
+        parameter.hints = kParameterIsOutput;
+        parameter.name = "Input Peak";
+        parameter.symbol = "input_peak";
+        parameter.unit = "dB";
+        parameter.ranges.def = NAM::LevelMeter::FLOOR_DB;
+        parameter.ranges.min = NAM::LevelMeter::FLOOR_DB;
+        parameter.ranges.max = 12.0f;
+        break;
+
+    case kParameterInputRMS:
+        parameter.hints = kParameterIsOutput;
+        parameter.name = "Input RMS";
+        parameter.symbol = "input_rms";
+        parameter.unit = "dB";
+        parameter.ranges.def = NAM::LevelMeter::FLOOR_DB;
+        parameter.ranges.min = NAM::LevelMeter::FLOOR_DB;
+        parameter.ranges.max = 12.0f;
+        break;
+
+    case kParameterModelInputPeak:
+        parameter.hints = kParameterIsOutput;
+        parameter.name = "Model Input Peak";
+        parameter.symbol = "model_input_peak";
+        parameter.unit = "dB";
+        parameter.ranges.def = NAM::LevelMeter::FLOOR_DB;
+        parameter.ranges.min = NAM::LevelMeter::FLOOR_DB;
+        parameter.ranges.max = 12.0f;
+        break;
+
+    case kParameterOutputPeak:
+        parameter.hints = kParameterIsOutput;
+        parameter.name = "Output Peak";
+        parameter.symbol = "output_peak";
+        parameter.unit = "dB";
+        parameter.ranges.def = NAM::LevelMeter::FLOOR_DB;
+        parameter.ranges.min = NAM::LevelMeter::FLOOR_DB;
+        parameter.ranges.max = 12.0f;
+        break;
+
+    case kParameterOutputRMS:
+        parameter.hints = kParameterIsOutput;
+        parameter.name = "Output RMS";
+        parameter.symbol = "output_rms";
+        parameter.unit = "dB";
+        parameter.ranges.def = NAM::LevelMeter::FLOOR_DB;
+        parameter.ranges.min = NAM::LevelMeter::FLOOR_DB;
+        parameter.ranges.max = 12.0f;
+        break;
     }
 }
 
@@ -114,6 +167,16 @@ float NAMPlugin::getParameterValue(uint32_t index) const
         return fEnabled;
     case kParameterHardBypass:
         return fHardBypass;
+    case kParameterInputPeak:
+        return inputMeter.peak_db();
+    case kParameterInputRMS:
+        return inputMeter.rms_db();
+    case kParameterModelInputPeak:
+        return modelInputMeter.peak_db();
+    case kParameterOutputPeak:
+        return outputMeter.peak_db();
+    case kParameterOutputRMS:
+        return outputMeter.rms_db();
     default:
         return 0.0f;
     }
@@ -121,7 +184,6 @@ float NAMPlugin::getParameterValue(uint32_t index) const
 
 void NAMPlugin::setParameterValue(uint32_t index, float value)
 {
-    std::fprintf(stderr, "NAM DSP: setParameterValue index=%u value=%f\n", index, value);
     switch (index) {
     case kParameterInputLevel:
         fInputLevel = value;
@@ -131,7 +193,6 @@ void NAMPlugin::setParameterValue(uint32_t index, float value)
         break;
     case kParameterEnabled:
         fEnabled = value;
-        std::fprintf(stderr, "NAM DSP: Enabled set to %f (1=active, 0=bypassed)\n", value);
         break;
     case kParameterHardBypass:
         fHardBypass = value;
@@ -169,33 +230,30 @@ void NAMPlugin::deactivate()
 
 void NAMPlugin::run(const float** inputs, float** outputs, uint32_t frames)
 {
+    NAM::RTSection rtSection;
+    NAM::StatsBlock statsBlock(stats, frames, sampleRate);
+
     const float* in = inputs[0];
     float* out = outputs[0];
 
-    // Debug buffer size
-    static int debugCounter7 = 0;
-    static uint32_t lastFrames = 0;
-    if (frames != lastFrames) {
-        std::fprintf(stderr, "NAM DSP: Buffer size changed to %u (maxBufferSize=%d)\n", frames, maxBufferSize);
-        lastFrames = frames;
-    }
-
-    // Debug input level
-    static int debugCounter5 = 0;
-    if (debugCounter5++ % 100 == 0) {
-        float maxInput = 0.0f;
-        for (uint32_t i = 0; i < frames; i++) {
-            maxInput = std::max(maxInput, std::abs(in[i]));
-        }
-        std::fprintf(stderr, "NAM DSP: Raw input max sample = %f, fEnabled = %f, frames = %u\n", maxInput, fEnabled, frames);
-    }
-
     // Check enabled state: 1.0 = enabled (active), 0.0 = disabled (bypassed)
     const bool bypassed = fEnabled < 0.5f;
+    stats.set_bypassed(bypassed);
 
-    // If bypassed, just copy input to output
+    // If bypassed, just copy input to output (metering it on the way)
     if (bypassed) {
-        std::copy(in, in + frames, out);
+        float peak = 0.0f;
+        float squares = 0.0f;
+
+        for (uint32_t i = 0; i < frames; i++) {
+            out[i] = in[i];
+            peak = std::max(peak, std::abs(in[i]));
+            squares += in[i] * in[i];
+        }
+
+        inputMeter.update(peak, squares, frames, sampleRate);
+        modelInputMeter.update(0.0f, 0.0f, frames, sampleRate);
+        outputMeter.update(peak, squares, frames, sampleRate);
         return;
     }
 
@@ -206,88 +264,55 @@ void NAMPlugin::run(const float** inputs, float** outputs, uint32_t frames)
     if (currentModel != nullptr) {
         modelInputAdjustmentDB = currentModel->GetRecommendedInputDBAdjustment();
         modelOutputAdjustmentDB = currentModel->GetRecommendedOutputDBAdjustment();
-        static int debugCounter = 0;
-        if (debugCounter++ % 100 == 0) {
-            std::fprintf(stderr, "NAM DSP: Model adjustments - input=%f dB, output=%f dB\n",
-                        modelInputAdjustmentDB, modelOutputAdjustmentDB);
-        }
     }
 
     targetInputLevel = std::pow(10.0f, (fInputLevel + modelInputAdjustmentDB) * 0.05f);
     targetOutputLevel = std::pow(10.0f, (fOutputLevel + modelOutputAdjustmentDB) * 0.05f);
 
-    static int debugCounter2 = 0;
-    if (debugCounter2++ % 100 == 0) {
-        std::fprintf(stderr, "NAM DSP: Target gains - input=%f, output=%f (current: in=%f, out=%f)\n",
-                    targetInputLevel, targetOutputLevel, inputLevel, outputLevel);
-    }
-
-    // ========== Apply Input Gain ==========
+    // ========== Apply Input Gain and Meter ==========
     const float smoothCoeff = SMOOTH_COEFF;
     float inGain = inputLevel;
+    float inPeak = 0.0f;
+    float inSquares = 0.0f;
+    float modelInPeak = 0.0f;
 
     for (uint32_t i = 0; i < frames; i++) {
         inGain += smoothCoeff * (targetInputLevel - inGain);
         out[i] = in[i] * inGain;
+
+        inPeak = std::max(inPeak, std::abs(in[i]));
+        inSquares += in[i] * in[i];
+        modelInPeak = std::max(modelInPeak, std::abs(out[i]));
     }
     inputLevel = inGain;
 
     // ========== Process Neural Model ==========
     if (currentModel != nullptr) {
-        static int debugCounter3 = 0;
-        if (debugCounter3++ % 100 == 0) {
-            float maxIn = 0.0f;
-            for (uint32_t i = 0; i < frames; i++) {
-                maxIn = std::max(maxIn, std::abs(out[i]));
-            }
-            std::fprintf(stderr, "NAM DSP: Before model processing, max sample = %f\n", maxIn);
-        }
-
-#ifdef DISABLE_DENORMALS // Disable floating point denormals
-  std::fenv_t fe_state;
-  std::feholdexcept(&fe_state);
-  disable_denormals();
+#ifdef DISABLE_DENORMALS // once per audio thread, see nam_denormals.h
+        NAM::flush_denormals_on_thread();
 #endif
         currentModel->Process(out, out, frames);
-
-#ifdef DISABLE_DENORMALS // restore previous floating point state
-  std::feupdateenv(&fe_state);
-#endif
-
-
-        // currentModel->Process(out, out, frames);
-
-        static int debugCounter4 = 0;
-        if (debugCounter4++ % 100 == 0) {
-            float maxOut = 0.0f;
-            for (uint32_t i = 0; i < frames; i++) {
-                maxOut = std::max(maxOut, std::abs(out[i]));
-            }
-            std::fprintf(stderr, "NAM DSP: After model processing, max sample = %f\n", maxOut);
-        }
     }
 
-    // ========== Apply Output Gain ==========
+    // ========== Apply Output Gain and Meter ==========
     float outGain = outputLevel;
+    float outPeak = 0.0f;
+    float outSquares = 0.0f;
 
     for (uint32_t i = 0; i < frames; i++) {
         outGain += smoothCoeff * (targetOutputLevel - outGain);
         out[i] *= outGain;
+
+        outPeak = std::max(outPeak, std::abs(out[i]));
+        outSquares += out[i] * out[i];
     }
 
     outputLevel = outGain;
 
-    // Debug final output
-    static int debugCounter6 = 0;
-    if (debugCounter6++ % 100 == 0) {
-        float maxFinal = 0.0f;
-        for (uint32_t i = 0; i < frames; i++) {
-            maxFinal = std::max(maxFinal, std::abs(out[i]));
-        }
-        std::fprintf(stderr, "NAM DSP: FINAL OUTPUT max sample = %f\n", maxFinal);
-    }
-
-    std::copy(in, in + frames, out);
+    // Ballistics, once per block
+    inputMeter.update(inPeak, inSquares, frames, sampleRate);
+    modelInputMeter.update(modelInPeak, 0.0f, frames, sampleRate);
+    outputMeter.update(outPeak, outSquares, frames, sampleRate);
 }
 
 void NAMPlugin::sampleRateChanged(double newSampleRate)
@@ -301,17 +326,38 @@ void NAMPlugin::loadModel(const char* path)
         std::fprintf(stderr, "NAM DSP: Clearing model\n");
         currentModel.reset();
         currentModelPath.clear();
+        stats.set_model("", "");
         return;
     }
 
     std::fprintf(stderr, "NAM DSP: Attempting to load model from: %s\n", path);
+    const auto loadStart = std::chrono::steady_clock::now();
+
     try {
-        auto newModel = NeuralAudio::NeuralModel::CreateFromFile(path);
+        // read (and if needed decompress) the whole file, then build from memory
+        NAM::ModelFile file;
+        NeuralAudio::NeuralModel* newModel = nullptr;
+
+        if (file.load(path)) {
+            NAM::MemoryStreamBuf buffer(file.text.data(), file.text.size());
+            std::istream stream(&buffer);
+
+            newModel = NeuralAudio::NeuralModel::CreateFromStream(
+                stream, NAM::ModelFile::extension(path));
+        } else {
+            std::fprintf(stderr, "NAM DSP: Could not read model file\n");
+        }
+
         if (newModel != nullptr) {
             currentModel.reset(newModel);
             currentModelPath = path;
             std::fprintf(stderr, "NAM DSP: Model loaded successfully\n");
 
+            const std::chrono::duration<double, std::milli> loadTime =
+                std::chrono::steady_clock::now() - loadStart;
+            stats.set_model(path, file.architecture.c_str());
+            stats.model_loaded(loadTime.count());
+
             // Reset processing state when model changes
             prevDCInput = 0.0f;
             prevDCOutput = 0.0f;
@@ -323,6 +369,7 @@ void NAMPlugin::loadModel(const char* path)
         std::fprintf(stderr, "NAM DSP: Model loading failed: %s\n", e.what());
         currentModel.reset();
         currentModelPath.clear();
+        stats.set_model("", "");
     }
 }
 
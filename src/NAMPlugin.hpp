@@ -6,6 +6,9 @@
 #include <vector>
 #include <memory>
 
+#include "nam_meter.h"
+#include "nam_stats.h"
+
 START_NAMESPACE_DISTRHO
 
 // Parameter indices
@@ -14,6 +17,12 @@ enum Parameters {
     kParameterOutputLevel,
     kParameterEnabled,
     kParameterHardBypass,
+    // level meters (outputs, in dB)
+    kParameterInputPeak,
+    kParameterInputRMS,
+    kParameterModelInputPeak,
+    kParameterOutputPeak,
+    kParameterOutputRMS,
     kParameterCount
 };
 
@@ -105,6 +114,14 @@ private:
     // Smoothing coefficient
     static constexpr float SMOOTH_COEFF = 0.001f;
 
+    // Level meters, reported through the output parameters
+    NAM::LevelMeter inputMeter;
+    NAM::LevelMeter modelInputMeter;  // after the input gain
+    NAM::LevelMeter outputMeter;
+
+    // Published for nam-top
+    NAM::InstanceStats stats;
+
     // Current smoothed values
     float inputLevel;
     float outputLevel;
@@ -1,4 +1,10 @@
 #include "NAMUI.hpp"
+#include "OpenGL.hpp"
+#include "src/nanovg/nanovg.h"
+#ifdef NAM_UI_FRAMEBUFFER
+#include "src/nanovg/nanovg_gl_utils.h"
+#endif
+#include <cmath>
 #include <string>
 #include <cstring>
 #include <cstdio>
@@ -15,11 +21,20 @@ NAMUI::NAMUI()
       fOutputLevel(0.0f),
       fEnabled(1.0f),  // 1 = enabled (active), 0 = disabled (bypassed)
       fHardBypass(0.0f),
+      modelInfoText("No model loaded - click 'Load Model' to select a .nam file"),
+      repaintPending(false),
+      backgroundCache(nullptr),
+      backgroundCacheWidth(0),
+      backgroundCacheHeight(0),
+      backgroundDirty(true),
       inputKnob(150, 150, 80, -20.0f, 20.0f, 0.0f, "Input", kParameterInputLevel),
       outputKnob(450, 150, 80, -20.0f, 20.0f, 0.0f, "Output", kParameterOutputLevel),
       enabledButton(120, 270, 120, 35, true, "Enabled", kParameterEnabled),  // true = enabled by default
       bypassButton(360, 270, 120, 35, false, "Hard Bypass", kParameterHardBypass),
-      loadButton(220, 320, 160, 40, "Load Model")
+      loadButton(220, 320, 160, 40, "Load Model"),
+      inputMeter(40, 100, 12, 130, "In"),
+      modelInputMeter(64, 100, 12, 130, "Amp"),
+      outputMeter(548, 100, 12, 130, "Out")
 {
     // Load font for text rendering
 #ifdef DGL_NO_SHARED_RESOURCES
@@ -33,35 +48,37 @@ NAMUI::NAMUI()
 
 NAMUI::~NAMUI()
 {
+#ifdef NAM_UI_FRAMEBUFFER
+    if (backgroundCache != nullptr) {
+        nvgluDeleteFramebuffer(backgroundCache);
+    }
+#endif
 }
 
 void NAMUI::parameterChanged(uint32_t index, float value)
 {
-    std::fprintf(stderr, "NAM UI: parameterChanged index=%u value=%f\n", index, value);
     bool needsRepaint = false;
 
     switch (index) {
     case kParameterInputLevel:
         if (fInputLevel != value) {
             fInputLevel = value;
-            inputKnob.value = value;
+            setKnobValue(inputKnob, value);
             needsRepaint = true;
         }
         break;
     case kParameterOutputLevel:
         if (fOutputLevel != value) {
             fOutputLevel = value;
-            outputKnob.value = value;
+            setKnobValue(outputKnob, value);
             needsRepaint = true;
         }
         break;
     case kParameterEnabled:
-        std::fprintf(stderr, "NAM UI: parameterChanged enabled - old=%f new=%f\n", fEnabled, value);
         if (fEnabled != value) {
             fEnabled = value;
             enabledButton.value = (value >= 0.5f);  // value is enabled: 1.0 = enabled (button ON), 0.0 = disabled (button OFF)
             needsRepaint = true;
-            std::fprintf(stderr, "NAM UI: Updated enabled button to %d\n", enabledButton.value);
         }
         break;
     case kParameterHardBypass:
@@ -71,10 +88,27 @@ void NAMUI::parameterChanged(uint32_t index, float value)
             needsRepaint = true;
         }
         break;
+    case kParameterInputPeak:
+        setMeterValue(inputMeter.peakDb, value);
+        break;
+    case kParameterInputRMS:
+        setMeterValue(inputMeter.rmsDb, value);
+        break;
+    case kParameterModelInputPeak:
+        setMeterValue(modelInputMeter.peakDb, value);
+        modelInputMeter.rmsDb = NAM::LevelMeter::FLOOR_DB;
+        break;
+    case kParameterOutputPeak:
+        setMeterValue(outputMeter.peakDb, value);
+        break;
+    case kParameterOutputRMS:
+        setMeterValue(outputMeter.rmsDb, value);
+        break;
     }
 
+    // Host automation can arrive faster than the display refresh
     if (needsRepaint) {
-        repaint();
+        requestRepaint();
     }
 }
 
@@ -82,19 +116,146 @@ void NAMUI::stateChanged(const char* key, const char* value)
 {
     if (std::strcmp(key, kStateKeyModelPath) == 0) {
         modelPath = value ? value : "";
+
+        if (!modelPath.empty()) {
+            // Extract filename from path
+            size_t lastSlash = modelPath.find_last_of("/\\");
+            std::string filename = (lastSlash != std::string::npos)
+                ? modelPath.substr(lastSlash + 1)
+                : modelPath;
+
+            modelInfoText = "Model: " + filename;
+        } else {
+            modelInfoText = "No model loaded - click 'Load Model' to select a .nam file";
+        }
+
+        // The model info panel is part of the cached background
+        backgroundDirty = true;
+        requestRepaint();
+    }
+}
+
+// The only place the UI repaints: everything else marks it pending
+void NAMUI::uiIdle()
+{
+    if (repaintPending) {
+        repaintPending = false;
         repaint();
     }
 }
 
+void NAMUI::requestRepaint()
+{
+    repaintPending = true;
+}
+
+void NAMUI::setKnobValue(Knob& knob, float value)
+{
+    knob.value = value;
+    knob.updateValueText();
+}
+
+// Meters update at the host's output parameter rate; like everything else
+// they are only redrawn from uiIdle()
+void NAMUI::setMeterValue(float& field, float value)
+{
+    if (field != value) {
+        field = value;
+        requestRepaint();
+    }
+}
+
 void NAMUI::onNanoDisplay()
 {
-    drawBackground();
+    updateBackgroundCache();
+
+    if (backgroundCache != nullptr) {
+        NVGcontext* const context = getContext();
+        const float width = getWidth();
+        const float height = getHeight();
+
+        nvgBeginPath(context);
+        nvgRect(context, 0, 0, width, height);
+        nvgFillPaint(context, nvgImagePattern(context, 0, 0, width, height,
+                                              0, backgroundCache->image, 1.0f));
+        nvgFill(context);
+    } else {
+        drawBackground();
+        drawModelInfo();
+    }
+
     drawKnob(inputKnob);
     drawKnob(outputKnob);
     drawToggleButton(enabledButton);
     drawToggleButton(bypassButton);
     drawButton(loadButton);
+    drawMeter(inputMeter);
+    drawMeter(modelInputMeter);
+    drawMeter(outputMeter);
+}
+
+// Called at the start of the frame, before anything is drawn: the frame is
+// cancelled while the background is rendered offscreen, then started again
+void NAMUI::updateBackgroundCache()
+{
+#ifdef NAM_UI_FRAMEBUFFER
+    const int width = static_cast<int>(getWidth());
+    const int height = static_cast<int>(getHeight());
+    const float scaleFactor = static_cast<float>(getScaleFactor());
+
+    // In device pixels, so the cached image stays sharp on HiDPI screens
+    const int deviceWidth = static_cast<int>(std::lround(width * scaleFactor));
+    const int deviceHeight = static_cast<int>(std::lround(height * scaleFactor));
+
+    if (backgroundCache != nullptr &&
+        (deviceWidth != backgroundCacheWidth || deviceHeight != backgroundCacheHeight)) {
+        nvgluDeleteFramebuffer(backgroundCache);
+        backgroundCache = nullptr;
+        backgroundDirty = true;
+    }
+
+    if (!backgroundDirty) {
+        return;
+    }
+
+    NVGcontext* const context = getContext();
+
+    if (backgroundCache == nullptr) {
+        // GL framebuffers are stored bottom-up and hold premultiplied alpha
+        backgroundCache = nvgluCreateFramebuffer(
+            context, deviceWidth, deviceHeight,
+            NVG_IMAGE_FLIPY | NVG_IMAGE_PREMULTIPLIED);
+        backgroundCacheWidth = deviceWidth;
+        backgroundCacheHeight = deviceHeight;
+
+        // Drawn directly every frame if the GL backend has no framebuffers
+        if (backgroundCache == nullptr) {
+            backgroundDirty = false;
+            return;
+        }
+    }
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    cancelFrame();
+
+    nvgluBindFramebuffer(backgroundCache);
+    glViewport(0, 0, deviceWidth, deviceHeight);
+    glClearColor(0, 0, 0, 0);
+    glClear(GL_COLOR_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+    beginFrame(width, height, scaleFactor);
+    drawBackground();
     drawModelInfo();
+    endFrame();
+    nvgluBindFramebuffer(nullptr);
+
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    beginFrame(width, height, scaleFactor);
+#endif
+
+    // Without DPF's framebuffer helpers it is drawn directly every frame
+    backgroundDirty = false;
 }
 
 bool NAMUI::onMouse(const MouseEvent& ev)
@@ -123,11 +284,10 @@ bool NAMUI::onMouse(const MouseEvent& ev)
         if (enabledButton.contains(mx, my)) {
             enabledButton.value = !enabledButton.value;
             float newValue = enabledButton.value ? 1.0f : 0.0f;
-            std::fprintf(stderr, "NAM UI: Enabled button clicked, setting to %f\n", newValue);
             editParameter(kParameterEnabled, true);
             setParameterValue(kParameterEnabled, newValue);
             editParameter(kParameterEnabled, false);
-            repaint();
+            requestRepaint();
             return true;
         }
         if (bypassButton.contains(mx, my)) {
@@ -135,7 +295,7 @@ bool NAMUI::onMouse(const MouseEvent& ev)
             editParameter(kParameterHardBypass, true);
             setParameterValue(kParameterHardBypass, bypassButton.value ? 1.0f : 0.0f);
             editParameter(kParameterHardBypass, false);
-            repaint();
+            requestRepaint();
             return true;
         }
 
@@ -173,8 +333,7 @@ bool NAMUI::onMotion(const MotionEvent& ev)
         float newValue = inputKnob.dragStartValue + delta;
         newValue = std::max(inputKnob.min, std::min(inputKnob.max, newValue));
         if (newValue != inputKnob.value) {
-            inputKnob.value = newValue;
-            std::fprintf(stderr, "NAM UI: Input knob dragged to %f\n", newValue);
+            setKnobValue(inputKnob, newValue);
             setParameterValue(kParameterInputLevel, newValue);
             needsRepaint = true;
         }
@@ -184,8 +343,7 @@ bool NAMUI::onMotion(const MotionEvent& ev)
         float newValue = outputKnob.dragStartValue + delta;
         newValue = std::max(outputKnob.min, std::min(outputKnob.max, newValue));
         if (newValue != outputKnob.value) {
-            outputKnob.value = newValue;
-            std::fprintf(stderr, "NAM UI: Output knob dragged to %f\n", newValue);
+            setKnobValue(outputKnob, newValue);
             setParameterValue(kParameterOutputLevel, newValue);
             needsRepaint = true;
         }
@@ -219,8 +377,9 @@ bool NAMUI::onMotion(const MotionEvent& ev)
         needsRepaint = true;
     }
 
+    // Drags and hover changes are coalesced and drawn from uiIdle()
     if (needsRepaint) {
-        repaint();
+        requestRepaint();
     }
 
     return false;
@@ -329,12 +488,10 @@ void NAMUI::drawKnob(const Knob& knob)
     text(knob.x, knob.y + radius + 8, knob.label, nullptr);
 
     // Draw value
-    char buf[32];
-    std::snprintf(buf, sizeof(buf), "%.1f dB", knob.value);
     fontSize(12);
     fillColor(150, 150, 160);
     textAlign(ALIGN_CENTER | ALIGN_TOP);
-    text(knob.x, knob.y + radius + 26, buf, nullptr);
+    text(knob.x, knob.y + radius + 26, knob.valueText, nullptr);
 }
 
 void NAMUI::drawToggleButton(const ToggleButton& button)
@@ -435,19 +592,71 @@ void NAMUI::drawModelInfo()
     fillColor(180, 180, 190);
     textAlign(ALIGN_CENTER | ALIGN_MIDDLE);
 
-    if (!modelPath.empty()) {
-        // Extract filename from path
-        size_t lastSlash = modelPath.find_last_of("/\\");
-        std::string filename = (lastSlash != std::string::npos)
-            ? modelPath.substr(lastSlash + 1)
-            : modelPath;
-
-        std::string displayText = "Model: " + filename;
-        text(width / 2, infoY, displayText.c_str(), nullptr);
-    } else {
+    if (modelPath.empty()) {
         fillColor(140, 140, 150);
-        text(width / 2, infoY, "No model loaded - click 'Load Model' to select a .nam file", nullptr);
     }
+    text(width / 2, infoY, modelInfoText.c_str(), nullptr);
+}
+
+void NAMUI::drawMeter(const Meter& meter)
+{
+    const float bottom = meter.y + meter.height;
+
+    // Draw meter background
+    beginPath();
+    rect(meter.x, meter.y, meter.width, meter.height);
+    fillColor(20, 20, 25, 255);
+    fill();
+
+    // Draw RMS bar, red above 0 dB
+    const float rmsHeight = meter.levelHeight(meter.rmsDb);
+    if (rmsHeight > 0.0f) {
+        beginPath();
+        rect(meter.x, bottom - rmsHeight, meter.width, rmsHeight);
+        if (meter.rmsDb > 0.0f) {
+            fillColor(220, 70, 60, 255);
+        } else {
+            fillColor(90, 140, 220, 255);
+        }
+        fill();
+    }
+
+    // Draw peak line
+    const float peakHeight = meter.levelHeight(meter.peakDb);
+    if (peakHeight > 0.0f) {
+        beginPath();
+        moveTo(meter.x, bottom - peakHeight);
+        lineTo(meter.x + meter.width, bottom - peakHeight);
+        if (meter.peakDb > 0.0f) {
+            strokeColor(255, 90, 80, 255);
+        } else {
+            strokeColor(200, 200, 210, 255);
+        }
+        strokeWidth(2.0f);
+        stroke();
+    }
+
+    // Draw 0 dB mark
+    const float zeroY = bottom - meter.levelHeight(0.0f);
+    beginPath();
+    moveTo(meter.x - 2, zeroY);
+    lineTo(meter.x + meter.width + 2, zeroY);
+    strokeColor(120, 120, 130, 255);
+    strokeWidth(1.0f);
+    stroke();
+
+    // Draw meter outline
+    beginPath();
+    rect(meter.x, meter.y, meter.width, meter.height);
+    strokeColor(60, 60, 70, 255);
+    strokeWidth(1.0f);
+    stroke();
+
+    // Draw label
+    fontSize(11);
+    fillColor(150, 150, 160);
+    textAlign(ALIGN_CENTER | ALIGN_TOP);
+    text(meter.x + meter.width / 2, bottom + 6, meter.label, nullptr);
 }
 
 UI* createUI()
@@ -3,6 +3,9 @@
 #include "DistrhoUI.hpp"
 #include "NAMPlugin.hpp"
 #include <cmath>
+#include <cstdio>
+
+struct NVGLUframebuffer;
 
 START_NAMESPACE_DISTRHO
 
@@ -16,12 +19,16 @@ struct Knob {
     int dragStartY;
     float dragStartValue;
     bool hovered;
+    char valueText[16];
 
     Knob(float x_, float y_, float size_, float min_, float max_, float value_,
          const char* label_, uint32_t paramIndex_)
         : x(x_), y(y_), size(size_), min(min_), max(max_), value(value_),
           label(label_), paramIndex(paramIndex_), dragging(false),
-          dragStartY(0), dragStartValue(0.0f), hovered(false) {}
+          dragStartY(0), dragStartValue(0.0f), hovered(false)
+    {
+        updateValueText();
+    }
 
     bool contains(float mx, float my) const {
         float dx = mx - x;
@@ -36,6 +43,12 @@ struct Knob {
     void setNormalizedValue(float norm) {
         value = min + norm * (max - min);
         value = std::max(min, std::min(max, value));
+        updateValueText();
+    }
+
+    // Formatted once per value change instead of on every repaint
+    void updateValueText() {
+        std::snprintf(valueText, sizeof(valueText), "%.1f dB", value);
     }
 };
 
@@ -74,6 +87,28 @@ struct Button {
     }
 };
 
+// Vertical level meter: RMS as a bar, peak as a line
+struct Meter {
+    float x, y, width, height;
+    float peakDb, rmsDb;
+    const char* label;
+
+    // Display range, the plugin reports down to NAM::LevelMeter::FLOOR_DB
+    static constexpr float kMinDb = -60.0f;
+    static constexpr float kMaxDb = 6.0f;
+
+    Meter(float x_, float y_, float width_, float height_, const char* label_)
+        : x(x_), y(y_), width(width_), height(height_),
+          peakDb(NAM::LevelMeter::FLOOR_DB), rmsDb(NAM::LevelMeter::FLOOR_DB),
+          label(label_) {}
+
+    // Height of a level above the bottom of the meter
+    float levelHeight(float db) const {
+        const float norm = (db - kMinDb) / (kMaxDb - kMinDb);
+        return height * std::max(0.0f, std::min(1.0f, norm));
+    }
+};
+
 class NAMUI : public UI
 {
 public:
@@ -84,6 +119,7 @@ protected:
     // DSP/Plugin Callbacks
     void parameterChanged(uint32_t index, float value) override;
     void stateChanged(const char* key, const char* value) override;
+    void uiIdle() override;
 
     // Widget Callbacks
     void onNanoDisplay() override;
@@ -97,6 +133,18 @@ private:
     float fEnabled;
     float fHardBypass;
     std::string modelPath;
+    std::string modelInfoText;
+
+    // Set by input events, serviced in uiIdle() so repaints are limited to
+    // the host's idle (display) rate rather than the mouse event rate
+    bool repaintPending;
+
+    // Background, title and model info panel, rendered offscreen when they
+    // change or the window is resized and drawn as one image otherwise
+    NVGLUframebuffer* backgroundCache;
+    int backgroundCacheWidth; // device pixels
+    int backgroundCacheHeight;
+    bool backgroundDirty;
 
     // UI layout
     static constexpr int kUIWidth = 600;
@@ -109,13 +157,21 @@ private:
     ToggleButton enabledButton;
     ToggleButton bypassButton;
     Button loadButton;
+    Meter inputMeter;
+    Meter modelInputMeter;
+    Meter outputMeter;
 
     // Helper methods
     void drawBackground();
+    void updateBackgroundCache();
+    void requestRepaint();
     void drawKnob(const Knob& knob);
     void drawToggleButton(const ToggleButton& button);
     void drawButton(const Button& button);
     void drawModelInfo();
+    void drawMeter(const Meter& meter);
+    void setMeterValue(float& field, float value);
+    void setKnobValue(Knob& knob, float value);
 
     DISTRHO_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(NAMUI)
 };
@@ -0,0 +1,215 @@
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#ifdef __APPLE__
+#include <sys/sysctl.h>
+#endif
+
+#include "nam_backend_cache.h"
+
+namespace NAM {
+namespace {
+using Key = std::tuple<uint64_t, size_t>;
+
+std::mutex cacheMutex;
+bool cacheLoaded = false;
+std::map<Key, NeuralAudio::EModelLoadMode> entries; // for this CPU only
+
+std::string cpu_model() {
+#if defined(__APPLE__)
+  char brand[256] = {};
+  size_t size = sizeof(brand) - 1;
+
+  if (sysctlbyname("machdep.cpu.brand_string", brand, &size, nullptr, 0) == 0)
+    return brand;
+#elif defined(__linux__)
+  std::ifstream cpuinfo("/proc/cpuinfo");
+  std::string line;
+  std::string implementer;
+  std::string part;
+
+  auto value = [&line]() -> std::string {
+    const size_t start = line.find_first_not_of(" \t", line.find(':') + 1);
+    return (start == std::string::npos) ? "" : line.substr(start);
+  };
+
+  while (std::getline(cpuinfo, line)) {
+    if (line.rfind("model name", 0) == 0)
+      return value();
+
+    // Arm cores only identify themselves by number
+    if (implementer.empty() && line.rfind("CPU implementer", 0) == 0)
+      implementer = value();
+    else if (part.empty() && line.rfind("CPU part", 0) == 0)
+      part = value();
+  }
+
+  if (!part.empty())
+    return "arm " + implementer + " " + part;
+#endif
+
+  return "unknown";
+}
+
+const std::string &cpu() {
+  static const std::string model = cpu_model();
+  return model;
+}
+
+std::filesystem::path cache_file() {
+  std::filesystem::path dir;
+
+  if (const char *xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg) {
+    dir = xdg;
+  } else if (const char *local = std::getenv("LOCALAPPDATA"); local && *local) {
+    dir = local;
+  } else if (const char *home = std::getenv("HOME"); home && *home) {
+    dir = std::filesystem::path(home) / ".cache";
+  } else {
+    return {};
+  }
+
+  return dir / "neural-amp-modeler-lv2" / "backends.txt";
+}
+
+const char *mode_name(NeuralAudio::EModelLoadMode mode) {
+  return (mode == NeuralAudio::PreferRTNeural) ? "rtneural" : "nam";
+}
+
+// one line per entry: hash, block size, backend, then the CPU model, which
+// may contain spaces
+bool parse_line(const std::string &line, uint64_t &modelHash,
+                size_t &blockSize, std::string &mode, std::string &entryCpu) {
+  std::istringstream fields(line);
+
+  if (!(fields >> std::hex >> modelHash >> std::dec >> blockSize >> mode))
+    return false;
+
+  std::getline(fields >> std::ws, entryCpu);
+
+  return mode == "nam" || mode == "rtneural";
+}
+
+void load_entries() {
+  std::ifstream file(cache_file());
+  std::string line;
+
+  while (std::getline(file, line)) {
+    uint64_t modelHash;
+    size_t blockSize;
+    std::string mode;
+    std::string entryCpu;
+
+    if (!parse_line(line, modelHash, blockSize, mode, entryCpu) ||
+        entryCpu != cpu())
+      continue;
+
+    entries[{modelHash, blockSize}] = (mode == "rtneural")
+                                          ? NeuralAudio::PreferRTNeural
+                                          : NeuralAudio::PreferNAMCore;
+  }
+
+  cacheLoaded = true;
+}
+} // namespace
+
+bool BackendCache::lookup(uint64_t modelHash, size_t blockSize,
+                          NeuralAudio::EModelLoadMode &mode) {
+  std::lock_guard<std::mutex> lock(cacheMutex);
+
+  if (!cacheLoaded)
+    load_entries();
+
+  const auto entry = entries.find({modelHash, blockSize});
+
+  if (entry == entries.end())
+    return false;
+
+  mode = entry->second;
+
+  return true;
+}
+
+void BackendCache::store(uint64_t modelHash, size_t blockSize,
+                         NeuralAudio::EModelLoadMode mode) {
+  std::lock_guard<std::mutex> lock(cacheMutex);
+
+  if (!cacheLoaded)
+    load_entries();
+
+  const Key key{modelHash, blockSize};
+  const auto entry = entries.find(key);
+
+  // a reused layout or a repeated tune usually finds what's already there
+  if (entry != entries.end() && entry->second == mode)
+    return;
+
+  entries[key] = mode;
+
+  const std::filesystem::path path = cache_file();
+
+  if (path.empty())
+    return;
+
+  // the file is rewritten with one line per model, block size and CPU, so it
+  // doesn't grow with every load. Lines other instances wrote since this
+  // one read it are kept, the new entry replaces its own.
+  char line[64];
+  snprintf(line, sizeof(line), "%016llx %zu %s ",
+           static_cast<unsigned long long>(modelHash), blockSize,
+           mode_name(mode));
+
+  std::map<std::tuple<uint64_t, size_t, std::string>, std::string> lines;
+  lines[{modelHash, blockSize, cpu()}] = line + cpu();
+
+  {
+    std::ifstream file(path);
+    std::string existing;
+
+    while (std::getline(file, existing)) {
+      uint64_t hash;
+      size_t size;
+      std::string name;
+      std::string entryCpu;
+
+      if (parse_line(existing, hash, size, name, entryCpu))
+        lines.emplace(std::make_tuple(hash, size, entryCpu), existing);
+    }
+  }
+
+  std::error_code error;
+  std::filesystem::create_directories(path.parent_path(), error);
+
+  // written next to it and renamed over it, so other processes read either
+  // the old file or the new one
+  std::filesystem::path temporary = path;
+  temporary += "." + std::to_string(std::random_device{}()) + ".tmp";
+
+  {
+    std::ofstream file(temporary, std::ios::trunc);
+
+    for (const auto &entry : lines)
+      file << entry.second << '\n';
+
+    if (!file.flush()) {
+      file.close();
+      std::filesystem::remove(temporary, error);
+      return;
+    }
+  }
+
+  std::filesystem::rename(temporary, path, error);
+
+  if (error)
+    std::filesystem::remove(temporary, error);
+}
+} // namespace NAM
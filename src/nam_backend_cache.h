@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <NeuralAudio/NeuralModel.h>
+
+namespace NAM {
+// Per-machine record of the NeuralAudio backend that ran a model fastest.
+// Entries are keyed by ModelFile::hash(), the CPU model and the block
+// size, and shared by all instances through a small text file in the user's
+// cache directory. Runs on non-RT threads only.
+class BackendCache {
+public:
+  static bool lookup(uint64_t modelHash, size_t blockSize,
+                     NeuralAudio::EModelLoadMode &mode);
+  static void store(uint64_t modelHash, size_t blockSize,
+                    NeuralAudio::EModelLoadMode mode);
+};
+} // namespace NAM
@@ -0,0 +1,159 @@
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+#include "nam_batch.h"
+
+namespace NAM {
+// instances of one kernel model, for the life of the process like the
+// kernel itself, so a leader never sees a stream's memory go away
+class BatchGroup {
+public:
+  static constexpr size_t MAX_STREAMS = 32;
+
+  explicit BatchGroup(const NAMKernelDescriptor *kernel) : kernel(kernel) {}
+
+  const NAMKernelDescriptor *kernel;
+  std::atomic<bool> leading{false};
+
+  struct alignas(64) Slot {
+    BatchStream stream;
+  };
+
+  std::array<Slot, MAX_STREAMS> slots;
+
+  // takes every stream posted with the same block size, in batches of up
+  // to NAM_KERNEL_MAX_BATCH, and marks them done
+  void lead(size_t n_samples) noexcept {
+    const uint32_t wanted = BatchStream::posted(n_samples);
+
+    void *instances[NAM_KERNEL_MAX_BATCH];
+    const float *inputs[NAM_KERNEL_MAX_BATCH];
+    float *outputs[NAM_KERNEL_MAX_BATCH];
+    BatchStream *taken[NAM_KERNEL_MAX_BATCH];
+    size_t count = 0;
+
+    for (size_t i = 0; i <= slots.size(); ++i) {
+      if (i < slots.size()) {
+        BatchStream &stream = slots[i].stream;
+        uint32_t expected = wanted;
+
+        if (!stream.state.compare_exchange_strong(expected,
+                                                  BatchStream::kTaken,
+                                                  std::memory_order_acquire,
+                                                  std::memory_order_relaxed))
+          continue;
+
+        instances[count] = stream.instance;
+        inputs[count] = stream.input;
+        outputs[count] = stream.output;
+        taken[count++] = &stream;
+      }
+
+      if (count == NAM_KERNEL_MAX_BATCH || (i == slots.size() && count > 0)) {
+        if (count == 1) {
+          kernel->process(instances[0], inputs[0], outputs[0], n_samples);
+        } else {
+          kernel->process_batch(instances, inputs, outputs, count, n_samples);
+        }
+
+        for (size_t k = 0; k < count; ++k)
+          taken[k]->state.store(BatchStream::kDone, std::memory_order_release);
+
+        count = 0;
+      }
+    }
+  }
+};
+
+namespace {
+std::mutex registryMutex;
+std::map<const NAMKernelDescriptor *, std::unique_ptr<BatchGroup>> groups;
+
+bool batching_enabled() {
+  static const bool enabled = [] {
+    const char *value = std::getenv("NAM_BATCH");
+    return value != nullptr && value[0] != '\0' && strcmp(value, "0") != 0;
+  }();
+
+  return enabled;
+}
+
+inline void spin_pause() noexcept {
+#if defined(__SSE2__) || defined(_M_X64)
+  _mm_pause();
+#elif defined(__aarch64__)
+  __asm__ __volatile__("yield");
+#endif
+}
+} // namespace
+
+BatchStream *BatchStream::join(const NAMKernelDescriptor *kernel,
+                               void *instance) {
+  if (!batching_enabled() || kernel->abiVersion < 2 ||
+      kernel->process_batch == nullptr)
+    return nullptr;
+
+  std::lock_guard<std::mutex> lock(registryMutex);
+
+  auto &group = groups[kernel];
+
+  if (group == nullptr)
+    group = std::make_unique<BatchGroup>(kernel);
+
+  for (auto &slot : group->slots) {
+    if (!slot.stream.used) {
+      slot.stream.used = true;
+      slot.stream.group = group.get();
+      slot.stream.instance = instance;
+      return &slot.stream;
+    }
+  }
+
+  return nullptr;
+}
+
+void BatchStream::leave(BatchStream *stream) {
+  if (stream == nullptr)
+    return;
+
+  std::lock_guard<std::mutex> lock(registryMutex);
+
+  stream->used = false;
+  stream->instance = nullptr;
+}
+
+void BatchStream::process(const float *input, float *output,
+                          size_t n_samples) noexcept {
+  this->input = input;
+  this->output = output;
+  state.store(posted(n_samples), std::memory_order_release);
+
+  if (!group->leading.exchange(true, std::memory_order_acquire)) {
+    group->lead(n_samples);
+    group->leading.store(false, std::memory_order_release);
+  } else {
+    // a batch is running: either it has our block, or we missed it
+    uint32_t expected = posted(n_samples);
+
+    if (state.compare_exchange_strong(expected, kIdle,
+                                      std::memory_order_relaxed)) {
+      group->kernel->process(instance, input, output, n_samples);
+      return;
+    }
+  }
+
+  // ours was taken, by us or by the leader that just finished
+  while (state.load(std::memory_order_acquire) != kDone)
+    spin_pause();
+
+  state.store(kIdle, std::memory_order_relaxed);
+}
+} // namespace NAM
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "nam_kernel.h"
+
+namespace NAM {
+class BatchGroup;
+
+// Opt-in (NAM_BATCH=1) batching of instances that run the same kernel model
+// at the same time, for hosts that process their graph on several threads.
+// Each instance posts its block and tries to lead: the leader runs every
+// stream posted with the same block size through the kernel's
+// process_batch(), so the model's weights are fetched once per step for all
+// of them, and the others pick up their finished output. An instance that
+// finds a batch already running without it processes on its own; nobody
+// waits except for a batch that holds its own block.
+//
+// Instances a host runs one after the other on a single thread never
+// overlap: each block's input is only valid inside its own run() call.
+class BatchStream {
+public:
+  // non-RT: null if batching is off, the kernel can't batch or the group
+  // is full, in which case the caller processes on its own
+  static BatchStream *join(const NAMKernelDescriptor *kernel, void *instance);
+  static void leave(BatchStream *stream);
+
+  // RT, only inside a BatchScope; input and output may alias
+  void process(const float *input, float *output, size_t n_samples) noexcept;
+
+private:
+  enum State : uint32_t { kIdle, kPosted, kTaken, kDone };
+
+  // posted blocks also carry their size, kPosted | n_samples << 2
+  static uint32_t posted(size_t n_samples) noexcept {
+    return kPosted | static_cast<uint32_t>(n_samples << 2);
+  }
+
+  friend class BatchGroup;
+
+  BatchGroup *group = nullptr;
+  void *instance = nullptr;
+  bool used = false; // guarded by the registry lock
+
+  const float *input = nullptr;
+  float *output = nullptr;
+  std::atomic<uint32_t> state{kIdle};
+};
+
+// Marks the part of the audio thread that may batch, so models processed
+// on the worker (warm-up, settling) never join a batch and a real-time
+// thread never waits on one.
+class BatchScope {
+public:
+  BatchScope() noexcept { active() = true; }
+  ~BatchScope() { active() = false; }
+
+  BatchScope(const BatchScope &) = delete;
+  BatchScope &operator=(const BatchScope &) = delete;
+
+  static bool &active() noexcept {
+#if defined(__GNUC__) && !defined(_WIN32)
+    static thread_local bool inside
+        __attribute__((tls_model("initial-exec"))) = false;
+#else
+    static thread_local bool inside = false;
+#endif
+    return inside;
+  }
+};
+} // namespace NAM
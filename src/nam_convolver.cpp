@@ -0,0 +1,294 @@
+#include <algorithm>
+#include <cmath>
+
+#include "nam_convolver.h"
+#include "nam_wav.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+namespace NAM {
+RealFFT::RealFFT(size_t size) : size(size), half(size / 2) {
+  size_t bits = 0;
+  while ((size_t(1) << bits) < half)
+    ++bits;
+
+  bitReverse.resize(half);
+  for (size_t i = 0; i < half; ++i) {
+    size_t r = 0;
+    for (size_t b = 0; b < bits; ++b)
+      r |= ((i >> b) & 1) << (bits - 1 - b);
+    bitReverse[i] = r;
+  }
+
+  cosTable.resize(half / 2);
+  sinTable.resize(half / 2);
+  for (size_t i = 0; i < half / 2; ++i) {
+    cosTable[i] = static_cast<float>(std::cos(2.0 * M_PI * i / half));
+    sinTable[i] = static_cast<float>(-std::sin(2.0 * M_PI * i / half));
+  }
+
+  postCos.resize(half + 1);
+  postSin.resize(half + 1);
+  for (size_t k = 0; k <= half; ++k) {
+    postCos[k] = static_cast<float>(std::cos(2.0 * M_PI * k / size));
+    postSin[k] = static_cast<float>(-std::sin(2.0 * M_PI * k / size));
+  }
+
+  workRe.resize(half);
+  workIm.resize(half);
+}
+
+void RealFFT::transform(float *re, float *im, bool inverse) noexcept {
+  for (size_t i = 0; i < half; ++i) {
+    const size_t r = bitReverse[i];
+    if (r > i) {
+      std::swap(re[i], re[r]);
+      std::swap(im[i], im[r]);
+    }
+  }
+
+  const float sign = inverse ? -1.0f : 1.0f;
+
+  for (size_t len = 2; len <= half; len <<= 1) {
+    const size_t step = half / len;
+
+    for (size_t start = 0; start < half; start += len) {
+      for (size_t j = 0; j < len / 2; ++j) {
+        const float wr = cosTable[j * step];
+        const float wi = sign * sinTable[j * step];
+        const size_t a = start + j;
+        const size_t b = a + len / 2;
+        const float tr = re[b] * wr - im[b] * wi;
+        const float ti = re[b] * wi + im[b] * wr;
+        re[b] = re[a] - tr;
+        im[b] = im[a] - ti;
+        re[a] += tr;
+        im[a] += ti;
+      }
+    }
+  }
+}
+
+void RealFFT::forward(const float *in, float *re, float *im) noexcept {
+  // pack even/odd samples as one complex signal of half the size
+  for (size_t n = 0; n < half; ++n) {
+    workRe[n] = in[2 * n];
+    workIm[n] = in[2 * n + 1];
+  }
+
+  transform(workRe.data(), workIm.data(), false);
+
+  // split into the spectrum of the real signal
+  for (size_t k = 0; k <= half; ++k) {
+    const size_t a = k % half;
+    const size_t b = (half - k) % half;
+    const float evenRe = 0.5f * (workRe[a] + workRe[b]);
+    const float evenIm = 0.5f * (workIm[a] - workIm[b]);
+    const float oddRe = 0.5f * (workIm[a] + workIm[b]);
+    const float oddIm = -0.5f * (workRe[a] - workRe[b]);
+    re[k] = evenRe + postCos[k] * oddRe - postSin[k] * oddIm;
+    im[k] = evenIm + postCos[k] * oddIm + postSin[k] * oddRe;
+  }
+}
+
+void RealFFT::inverse(const float *re, const float *im, float *out) noexcept {
+  for (size_t k = 0; k < half; ++k) {
+    const size_t m = half - k;
+    const float evenRe = 0.5f * (re[k] + re[m]);
+    const float evenIm = 0.5f * (im[k] - im[m]);
+    const float diffRe = 0.5f * (re[k] - re[m]);
+    const float diffIm = 0.5f * (im[k] + im[m]);
+    // multiply by the conjugate twiddle to undo the forward split
+    const float oddRe = diffRe * postCos[k] + diffIm * postSin[k];
+    const float oddIm = diffIm * postCos[k] - diffRe * postSin[k];
+    workRe[k] = evenRe - oddIm;
+    workIm[k] = evenIm + oddRe;
+  }
+
+  transform(workRe.data(), workIm.data(), true);
+
+  for (size_t n = 0; n < half; ++n) {
+    out[2 * n] = workRe[n];
+    out[2 * n + 1] = workIm[n];
+  }
+}
+
+Convolver::Convolver(const std::vector<float> &ir)
+    : irLength(ir.size()), fft(FFT_SIZE) {
+  numTailPartitions =
+      irLength > PARTITION_SIZE
+          ? (irLength - PARTITION_SIZE + PARTITION_SIZE - 1) / PARTITION_SIZE
+          : 0;
+
+  headTaps.assign(PARTITION_SIZE, 0.0f);
+  for (size_t i = 0; i < std::min(irLength, PARTITION_SIZE); ++i)
+    headTaps[PARTITION_SIZE - 1 - i] = ir[i];
+
+  headHistory.assign(2 * PARTITION_SIZE, 0.0f);
+
+  tailRe.assign(numTailPartitions * NUM_BINS, 0.0f);
+  tailIm.assign(numTailPartitions * NUM_BINS, 0.0f);
+  delayRe.assign(numTailPartitions * NUM_BINS, 0.0f);
+  delayIm.assign(numTailPartitions * NUM_BINS, 0.0f);
+  inputWindow.assign(FFT_SIZE, 0.0f);
+  accumRe.assign(NUM_BINS, 0.0f);
+  accumIm.assign(NUM_BINS, 0.0f);
+  fftBuffer.assign(FFT_SIZE, 0.0f);
+  tailOutput.assign(PARTITION_SIZE, 0.0f);
+
+  // fold the inverse FFT normalization into the partition spectra
+  const float scale = 1.0f / (FFT_SIZE / 2);
+
+  for (size_t p = 0; p < numTailPartitions; ++p) {
+    const size_t offset = (p + 1) * PARTITION_SIZE;
+    const size_t count = std::min(PARTITION_SIZE, irLength - offset);
+
+    std::fill(fftBuffer.begin(), fftBuffer.end(), 0.0f);
+    for (size_t i = 0; i < count; ++i)
+      fftBuffer[i] = ir[offset + i] * scale;
+
+    fft.forward(fftBuffer.data(), &tailRe[p * NUM_BINS], &tailIm[p * NUM_BINS]);
+  }
+}
+
+Convolver *Convolver::create_from_file(const char *path, double sampleRate) {
+  std::vector<float> samples;
+  double fileRate = 0;
+
+  if (!read_wav_file(path, samples, fileRate) || samples.empty())
+    return nullptr;
+
+  const size_t maxLength = static_cast<size_t>(MAX_IR_SECONDS * fileRate);
+  if (samples.size() > maxLength)
+    samples.resize(maxLength);
+
+  if (std::abs(fileRate - sampleRate) < 0.5)
+    return new Convolver(samples);
+
+  // windowed-sinc resampling, offline so plain per-sample evaluation is fine
+  static constexpr int HALF_TAPS = 32;
+
+  const double ratio = sampleRate / fileRate;
+  const double cutoff = std::min(1.0, ratio);
+  const size_t outLength =
+      static_cast<size_t>(std::ceil(samples.size() * ratio));
+  std::vector<float> resampled(outLength);
+
+  for (size_t i = 0; i < outLength; ++i) {
+    const double center = i / ratio;
+    const long first = static_cast<long>(std::floor(center)) - HALF_TAPS + 1;
+    double sum = 0;
+
+    for (long j = first; j < first + 2 * HALF_TAPS; ++j) {
+      if (j < 0 || j >= static_cast<long>(samples.size()))
+        continue;
+
+      const double x = center - j;
+      const double window =
+          0.5 + 0.5 * std::cos(M_PI * x / HALF_TAPS); // Hann
+      const double arg = M_PI * x * cutoff;
+      const double sinc = (std::abs(arg) < 1e-9) ? 1.0 : std::sin(arg) / arg;
+
+      sum += samples[j] * sinc * cutoff * window;
+    }
+
+    // keep the IR gain independent of the sample rate
+    resampled[i] = static_cast<float>(sum / ratio);
+  }
+
+  return new Convolver(resampled);
+}
+
+void Convolver::reset() noexcept {
+  std::fill(headHistory.begin(), headHistory.end(), 0.0f);
+  std::fill(delayRe.begin(), delayRe.end(), 0.0f);
+  std::fill(delayIm.begin(), delayIm.end(), 0.0f);
+  std::fill(inputWindow.begin(), inputWindow.end(), 0.0f);
+  std::fill(tailOutput.begin(), tailOutput.end(), 0.0f);
+  headPos = 0;
+  delayPos = 0;
+  blockPos = 0;
+}
+
+void Convolver::process(float *buffer, size_t n_samples) noexcept {
+  const float *__restrict taps = headTaps.data();
+  float *__restrict history = headHistory.data();
+
+  for (size_t i = 0; i < n_samples; ++i) {
+    const float x = buffer[i];
+
+    history[headPos] = x;
+    history[headPos + PARTITION_SIZE] = x;
+
+    const float *__restrict window = history + headPos + 1;
+    float y = 0.0f;
+
+#pragma GCC ivdep
+    for (size_t t = 0; t < PARTITION_SIZE; ++t)
+      y += taps[t] * window[t];
+
+    if (++headPos >= PARTITION_SIZE)
+      headPos = 0;
+
+    buffer[i] = y + tailOutput[blockPos];
+
+    if (numTailPartitions == 0)
+      continue;
+
+    inputWindow[PARTITION_SIZE + blockPos] = x;
+
+    if (++blockPos >= PARTITION_SIZE) {
+      blockPos = 0;
+      process_partition();
+    }
+  }
+}
+
+void Convolver::process_partition() noexcept {
+  // spectrum of [previous partition, current partition]
+  float *__restrict inRe = &delayRe[delayPos * NUM_BINS];
+  float *__restrict inIm = &delayIm[delayPos * NUM_BINS];
+
+  fft.forward(inputWindow.data(), inRe, inIm);
+
+  std::copy(inputWindow.begin() + PARTITION_SIZE, inputWindow.end(),
+            inputWindow.begin());
+
+  // tail partition p (covering taps (p + 1) * PARTITION_SIZE onwards) meets
+  // the input spectrum from p partitions ago; the result is the tail output
+  // for the partition that starts now
+  float *__restrict sumRe = accumRe.data();
+  float *__restrict sumIm = accumIm.data();
+
+  std::fill(accumRe.begin(), accumRe.end(), 0.0f);
+  std::fill(accumIm.begin(), accumIm.end(), 0.0f);
+
+  size_t slot = delayPos;
+
+  for (size_t p = 0; p < numTailPartitions; ++p) {
+    const float *__restrict xRe = &delayRe[slot * NUM_BINS];
+    const float *__restrict xIm = &delayIm[slot * NUM_BINS];
+    const float *__restrict hRe = &tailRe[p * NUM_BINS];
+    const float *__restrict hIm = &tailIm[p * NUM_BINS];
+
+#pragma GCC ivdep
+    for (size_t k = 0; k < NUM_BINS; ++k) {
+      sumRe[k] += xRe[k] * hRe[k] - xIm[k] * hIm[k];
+      sumIm[k] += xRe[k] * hIm[k] + xIm[k] * hRe[k];
+    }
+
+    slot = (slot == 0) ? numTailPartitions - 1 : slot - 1;
+  }
+
+  fft.inverse(sumRe, sumIm, fftBuffer.data());
+
+  // overlap-save: only the second half is free of circular wrap-around
+  std::copy(fftBuffer.begin() + PARTITION_SIZE, fftBuffer.end(),
+            tailOutput.begin());
+
+  if (++delayPos >= numTailPartitions)
+    delayPos = 0;
+}
+} // namespace NAM
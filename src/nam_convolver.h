@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace NAM {
+// Real-input FFT of a fixed power-of-two size, computed through a half-size
+// complex FFT. Spectra are stored split (separate re/im arrays) and hold
+// size / 2 + 1 bins.
+class RealFFT {
+public:
+  explicit RealFFT(size_t size);
+
+  void forward(const float *in, float *re, float *im) noexcept;
+  // unnormalized: the result is scaled by size / 2
+  void inverse(const float *re, const float *im, float *out) noexcept;
+
+private:
+  size_t size;
+  size_t half;
+  std::vector<size_t> bitReverse;
+  std::vector<float> cosTable; // twiddles for the half-size complex FFT
+  std::vector<float> sinTable;
+  std::vector<float> postCos; // twiddles for the real/complex split
+  std::vector<float> postSin;
+  std::vector<float> workRe;
+  std::vector<float> workIm;
+
+  void transform(float *re, float *im, bool inverse) noexcept;
+};
+
+// Cabinet impulse response stage.
+// Uniformly partitioned overlap-save convolution with a direct-form head:
+// the first PARTITION_SIZE taps are applied sample by sample so the stage adds
+// no latency, the remaining taps are convolved in the frequency domain one
+// partition at a time. All allocation happens in the constructor (worker
+// thread), process() is RT-safe.
+class Convolver {
+public:
+  static constexpr size_t PARTITION_SIZE = 64;
+  static constexpr double MAX_IR_SECONDS = 2.0;
+
+  explicit Convolver(const std::vector<float> &ir);
+
+  // Loads a WAV file and resamples it to sampleRate, returns nullptr on error
+  static Convolver *create_from_file(const char *path, double sampleRate);
+
+  void process(float *buffer, size_t n_samples) noexcept;
+  void reset() noexcept;
+
+  size_t length() const noexcept { return irLength; }
+
+private:
+  static constexpr size_t FFT_SIZE = 2 * PARTITION_SIZE;
+  static constexpr size_t NUM_BINS = PARTITION_SIZE + 1;
+
+  size_t irLength = 0;
+  size_t numTailPartitions = 0;
+
+  // direct-form head, taps stored reversed over a doubled history
+  std::vector<float> headTaps;
+  std::vector<float> headHistory;
+  size_t headPos = 0;
+
+  // frequency-domain tail
+  RealFFT fft;
+  std::vector<float> tailRe; // partition spectra, NUM_BINS each
+  std::vector<float> tailIm;
+  std::vector<float> delayRe; // frequency-domain delay line of input spectra
+  std::vector<float> delayIm;
+  size_t delayPos = 0;
+  std::vector<float> inputWindow; // previous + current input partition
+  std::vector<float> accumRe;
+  std::vector<float> accumIm;
+  std::vector<float> fftBuffer;
+  std::vector<float> tailOutput; // tail contribution for the current partition
+  size_t blockPos = 0;
+
+  void process_partition() noexcept;
+};
+} // namespace NAM
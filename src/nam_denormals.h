@@ -0,0 +1,103 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "architecture.hpp"
+
+#if defined(ARCH_EXT_SSE)
+#include <xmmintrin.h>
+#elif defined(ARCH_ARM64) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Flushing denormals to zero on the audio thread. Writing MXCSR (x86) or
+// FPCR (aarch64) stalls the pipeline until everything in flight has retired,
+// so rather than saving, setting and restoring the floating point environment
+// around every block, the flags are set the first time a thread runs a block
+// and left set. Hosts run plugins on threads of their own, and commonly set
+// the same flags there themselves.
+//
+// FTZ and DAZ on x86 and FZ on aarch64, which covers both; on 32-bit ARM
+// this falls back to disable_denormals() from architecture.hpp.
+
+namespace NAM {
+namespace detail {
+#if defined(ARCH_EXT_SSE)
+static constexpr uint64_t FLUSH_DENORMALS = 0x8040; // FTZ | DAZ
+#elif defined(ARCH_ARM64)
+static constexpr uint64_t FLUSH_DENORMALS = 1ull << 24; // FPCR.FZ
+#else
+static constexpr uint64_t FLUSH_DENORMALS = 0;
+#endif
+
+inline uint64_t read_fp_control() noexcept {
+#if defined(ARCH_EXT_SSE)
+  return _mm_getcsr();
+#elif defined(ARCH_ARM64) && defined(_MSC_VER)
+  return _ReadStatusReg(ARM64_SYSREG(3, 3, 4, 4, 0));
+#elif defined(ARCH_ARM64)
+  uint64_t fpcr;
+  __asm__ __volatile__("mrs %0, fpcr" : "=r"(fpcr));
+  return fpcr;
+#else
+  return 0;
+#endif
+}
+
+inline void set_flush_denormals() noexcept {
+#if defined(ARCH_EXT_SSE)
+  _mm_setcsr(_mm_getcsr() | static_cast<unsigned>(FLUSH_DENORMALS));
+#elif defined(ARCH_ARM64) && defined(_MSC_VER)
+  _WriteStatusReg(ARM64_SYSREG(3, 3, 4, 4, 0),
+                  read_fp_control() | FLUSH_DENORMALS);
+#elif defined(ARCH_ARM64)
+  const uint64_t fpcr = read_fp_control() | FLUSH_DENORMALS;
+  __asm__ __volatile__("msr fpcr, %0" : : "r"(fpcr));
+#else
+  disable_denormals();
+#endif
+}
+
+// blocks that found the flags cleared by the host since the previous one
+inline std::atomic<uint32_t> fpControlResets{0};
+} // namespace detail
+
+inline bool denormals_flushed() noexcept {
+  return detail::FLUSH_DENORMALS == 0 ||
+         (detail::read_fp_control() & detail::FLUSH_DENORMALS) ==
+             detail::FLUSH_DENORMALS;
+}
+
+// counted in debug builds only
+inline uint32_t denormal_flag_resets() noexcept {
+  return detail::fpControlResets.load(std::memory_order_relaxed);
+}
+
+// call at the start of every block on the audio thread
+inline void flush_denormals_on_thread() noexcept {
+  // initial-exec: a plugin is dlopen()ed, and the first access to a dynamic
+  // TLS variable on a new thread would allocate
+#if defined(__GNUC__) && !defined(_WIN32)
+  static thread_local bool flushing
+      __attribute__((tls_model("initial-exec"))) = false;
+#else
+  static thread_local bool flushing = false;
+#endif
+
+  if (!flushing) {
+    detail::set_flush_denormals();
+    flushing = true;
+    return;
+  }
+
+#ifndef NDEBUG
+  // release builds trust the flags to stay set, debug builds check that the
+  // host didn't clear them between blocks, and set them again if it did
+  if (!denormals_flushed()) {
+    detail::fpControlResets.fetch_add(1, std::memory_order_relaxed);
+    detail::set_flush_denormals();
+  }
+#endif
+}
+} // namespace NAM
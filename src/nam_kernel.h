@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Interface of model kernels generated by nam2cpp and built as shared
+// objects. The plugin looks for nam_kernel_descriptor() in every module it
+// finds and uses the kernel in place of the generic model when the hash of a
+// loaded model file matches.
+
+#define NAM_KERNEL_ABI_VERSION 2
+
+// most streams process_batch() takes at once
+#define NAM_KERNEL_MAX_BATCH 8
+
+#if defined(_WIN32)
+#define NAM_KERNEL_EXPORT extern "C" __declspec(dllexport)
+#else
+#define NAM_KERNEL_EXPORT extern "C" __attribute__((visibility("default")))
+#endif
+
+struct NAMKernelDescriptor {
+  uint32_t abiVersion;
+  uint64_t modelHash; // ModelFile::hash() of the source model
+  double sampleRate;
+  const char *name;
+
+  // create() returns an instance in its initial state, or null
+  void *(*create)();
+  void (*destroy)(void *instance);
+  void (*reset)(void *instance);
+  // RT-safe, any block size, input and output may alias
+  void (*process)(void *instance, const float *input, float *output,
+                  size_t n_samples);
+
+  // ABI 2: process() for up to NAM_KERNEL_MAX_BATCH instances at once. Each
+  // step of the model runs for every stream before the next, so its weights
+  // are fetched once for all of them. A stream's input and output may alias,
+  // different streams' buffers may not.
+  void (*process_batch)(void *const *instances, const float *const *inputs,
+                        float *const *outputs, size_t streams,
+                        size_t n_samples);
+};
+
+typedef const NAMKernelDescriptor *(*NAMKernelDescriptorFunction)();
@@ -0,0 +1,102 @@
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <new>
+#include <set>
+
+#ifndef _WIN32
+#include <dlfcn.h>
+#endif
+
+#include "nam_kernel_model.h"
+
+namespace NAM {
+namespace {
+std::mutex registryMutex;
+bool searchPathScanned = false;
+std::set<std::string> scannedDirs;
+std::map<uint64_t, const NAMKernelDescriptor *> kernels;
+
+void scan_locked(const std::string &dir) {
+  if (dir.empty() || !scannedDirs.insert(dir).second)
+    return;
+
+#ifndef _WIN32
+  std::error_code error;
+
+  for (const auto &entry : std::filesystem::directory_iterator(dir, error)) {
+    const auto extension = entry.path().extension();
+
+    if (extension != ".so" && extension != ".dylib")
+      continue;
+
+    void *module = dlopen(entry.path().c_str(), RTLD_NOW | RTLD_LOCAL);
+
+    if (module == nullptr)
+      continue;
+
+    auto descriptor = reinterpret_cast<NAMKernelDescriptorFunction>(
+        dlsym(module, "nam_kernel_descriptor"));
+    const NAMKernelDescriptor *kernel =
+        (descriptor != nullptr) ? descriptor() : nullptr;
+
+    // the first module found for a model wins; ABI 1 kernels only lack
+    // process_batch
+    if (kernel == nullptr || kernel->abiVersion < 1 ||
+        kernel->abiVersion > NAM_KERNEL_ABI_VERSION ||
+        !kernels.emplace(kernel->modelHash, kernel).second) {
+      dlclose(module);
+    }
+  }
+#endif
+}
+} // namespace
+
+void KernelRegistry::scan(const std::string &dir) {
+  std::lock_guard<std::mutex> lock(registryMutex);
+
+  scan_locked(dir);
+}
+
+const NAMKernelDescriptor *KernelRegistry::find(uint64_t modelHash) {
+  std::lock_guard<std::mutex> lock(registryMutex);
+
+  if (!searchPathScanned) {
+    searchPathScanned = true;
+
+    if (const char *path = std::getenv("NAM_KERNEL_PATH")) {
+      std::string dirs(path);
+      size_t start = 0;
+
+      while (start <= dirs.size()) {
+        const size_t end = std::min(dirs.find(':', start), dirs.size());
+        scan_locked(dirs.substr(start, end - start));
+        start = end + 1;
+      }
+    }
+  }
+
+  const auto kernel = kernels.find(modelHash);
+
+  return (kernel != kernels.end()) ? kernel->second : nullptr;
+}
+
+KernelModel::KernelModel(const NAMKernelDescriptor *kernel,
+                         NeuralAudio::NeuralModel &generic)
+    : kernel(kernel),
+      inputDBAdjustment(generic.GetRecommendedInputDBAdjustment()),
+      outputDBAdjustment(generic.GetRecommendedOutputDBAdjustment()),
+      instance(kernel->create()) {
+  if (instance == nullptr)
+    throw std::bad_alloc();
+
+  stream = BatchStream::join(kernel, instance);
+}
+
+KernelModel::~KernelModel() {
+  BatchStream::leave(stream);
+  kernel->destroy(instance);
+}
+} // namespace NAM
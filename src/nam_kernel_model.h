@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <NeuralAudio/NeuralModel.h>
+
+#include "nam_batch.h"
+#include "nam_kernel.h"
+
+namespace NAM {
+// Kernel modules found on disk. Modules stay loaded for the life of the
+// process. Runs on non-RT threads only.
+class KernelRegistry {
+public:
+  // loads every kernel module in dir, each directory only once
+  static void scan(const std::string &dir);
+
+  // also scans NAM_KERNEL_PATH (':' separated) on first use
+  static const NAMKernelDescriptor *find(uint64_t modelHash);
+};
+
+// Runs a generated kernel in place of a generic model, which it only reads
+// the level adjustments from. Inside a BatchScope, it may share a batch with
+// other instances of the same kernel (see nam_batch.h).
+class KernelModel : public NeuralAudio::NeuralModel {
+public:
+  // throws std::bad_alloc if the kernel can't create an instance; the generic
+  // model can be deleted afterwards
+  KernelModel(const NAMKernelDescriptor *kernel,
+              NeuralAudio::NeuralModel &generic);
+  ~KernelModel() override;
+
+  KernelModel(const KernelModel &) = delete;
+  KernelModel &operator=(const KernelModel &) = delete;
+
+  void Process(float *input, float *output, size_t numSamples) override {
+    if (stream != nullptr && BatchScope::active()) {
+      stream->process(input, output, numSamples);
+    } else {
+      kernel->process(instance, input, output, numSamples);
+    }
+  }
+
+  // kernels take any block size
+  void SetMaxAudioBufferSize(int) override {}
+
+  float GetRecommendedInputDBAdjustment() override {
+    return inputDBAdjustment;
+  }
+
+  float GetRecommendedOutputDBAdjustment() override {
+    return outputDBAdjustment;
+  }
+
+private:
+  const NAMKernelDescriptor *kernel;
+  float inputDBAdjustment;
+  float outputDBAdjustment;
+  void *instance;
+  BatchStream *stream = nullptr;
+};
+} // namespace NAM
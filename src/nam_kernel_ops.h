@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+// Building blocks for kernels generated by nam2cpp. Every dimension is a
+// template parameter, so each layer compiles to fully unrolled code for the
+// exact shape of the model. Weights are laid out input-major so the inner
+// loops run over contiguous outputs.
+
+namespace NAM {
+namespace kernel {
+enum Activation { kTanh, kFastTanh, kReLU, kSigmoid, kHardTanh };
+
+// same approximation as NAM Core's fast tanh
+inline float fast_tanh(float x) noexcept {
+  const float ax = std::fabs(x);
+  const float x2 = x * x;
+
+  const float num = x * (2.45550750702956f + 2.45550750702956f * ax +
+                         (0.893229853513558f + 0.821226666969744f * ax) * x2);
+  const float den =
+      2.44506634652299f +
+      (2.44506634652299f + x2) * std::fabs(x + 0.814642734961073f * x * ax);
+
+  return num / den;
+}
+
+inline float sigmoid(float x) noexcept { return 1.0f / (1.0f + std::exp(-x)); }
+
+template <Activation A> inline float activate(float x) noexcept {
+  switch (A) {
+  case kTanh:
+    return std::tanh(x);
+  case kFastTanh:
+    return fast_tanh(x);
+  case kReLU:
+    return (x > 0.0f) ? x : 0.0f;
+  case kSigmoid:
+    return sigmoid(x);
+  case kHardTanh:
+    return (x < -1.0f) ? -1.0f : ((x > 1.0f) ? 1.0f : x);
+  }
+
+  return x;
+}
+
+// y = b + W x, with W stored as [I][O]
+template <int I, int O, bool BIAS>
+inline void dense(const float *__restrict w, const float *__restrict b,
+                  const float *__restrict x, float *__restrict y) noexcept {
+#pragma GCC unroll 64
+  for (int o = 0; o < O; ++o)
+    y[o] = BIAS ? b[o] : 0.0f;
+
+#pragma GCC unroll 64
+  for (int i = 0; i < I; ++i) {
+#pragma GCC ivdep
+    for (int o = 0; o < O; ++o)
+      y[o] += w[i * O + o] * x[i];
+  }
+}
+
+// One WaveNet layer for one sample. x is the layer input on entry and its
+// output on return, head accumulates the activations. history keeps the
+// last RING (a power of two) layer inputs.
+// conv is [K][C][Z], mixin [Z], w1x1 [C][C], with Z = 2C for gated layers
+template <int C, int K, int D, int RING, bool GATED, Activation A>
+inline void wavenet_layer(const float *__restrict conv,
+                          const float *__restrict convBias,
+                          const float *__restrict mixin,
+                          const float *__restrict w1x1,
+                          const float *__restrict b1x1,
+                          float (*__restrict history)[C], uint32_t pos,
+                          float condition, float *__restrict x,
+                          float *__restrict head) noexcept {
+  static_assert((RING & (RING - 1)) == 0 && RING > (K - 1) * D,
+                "history must be a power of two covering the receptive field");
+  constexpr int Z = GATED ? 2 * C : C;
+
+  std::memcpy(history[pos & (RING - 1)], x, sizeof(float) * C);
+
+  alignas(32) float z[Z];
+
+#pragma GCC unroll 64
+  for (int o = 0; o < Z; ++o)
+    z[o] = convBias[o] + mixin[o] * condition;
+
+#pragma GCC unroll 16
+  for (int k = 0; k < K; ++k) {
+    const float *__restrict tap = history[(pos - (K - 1 - k) * D) & (RING - 1)];
+
+#pragma GCC unroll 64
+    for (int j = 0; j < C; ++j) {
+#pragma GCC ivdep
+      for (int o = 0; o < Z; ++o)
+        z[o] += conv[(k * C + j) * Z + o] * tap[j];
+    }
+  }
+
+#pragma GCC unroll 64
+  for (int c = 0; c < C; ++c) {
+    z[c] = GATED ? activate<A>(z[c]) * sigmoid(z[C + c]) : activate<A>(z[c]);
+    head[c] += z[c];
+  }
+
+  alignas(32) float y[C];
+  dense<C, C, true>(w1x1, b1x1, z, y);
+
+#pragma GCC unroll 64
+  for (int c = 0; c < C; ++c)
+    x[c] += y[c];
+}
+
+// One LSTM cell for one sample. xh holds the input followed by the hidden
+// state, which is updated in place along with the cell state c.
+// w is [I + H][4H], gates in PyTorch order (input, forget, cell, output)
+template <int I, int H, bool FAST>
+inline void lstm_cell(const float *__restrict w, const float *__restrict b,
+                      float *__restrict xh, float *__restrict c) noexcept {
+  alignas(32) float gates[4 * H];
+  dense<I + H, 4 * H, true>(w, b, xh, gates);
+
+#pragma GCC unroll 64
+  for (int h = 0; h < H; ++h) {
+    const float i = FAST ? 0.5f * fast_tanh(0.5f * gates[h]) + 0.5f
+                         : sigmoid(gates[h]);
+    const float f = FAST ? 0.5f * fast_tanh(0.5f * gates[H + h]) + 0.5f
+                         : sigmoid(gates[H + h]);
+    const float g =
+        FAST ? fast_tanh(gates[2 * H + h]) : std::tanh(gates[2 * H + h]);
+    const float o = FAST ? 0.5f * fast_tanh(0.5f * gates[3 * H + h]) + 0.5f
+                         : sigmoid(gates[3 * H + h]);
+
+    c[h] = f * c[h] + i * g;
+    xh[I + h] = o * (FAST ? fast_tanh(c[h]) : std::tanh(c[h]));
+  }
+}
+} // namespace kernel
+} // namespace NAM
@@ -1,4 +1,3 @@
-#include <cfenv>
 #include <cstddef>
 #include <cstdint>
 #include <memory>
@@ -9,15 +8,16 @@
 #include <lv2/urid/urid.h>
 #include <lv2/worker/worker.h>
 
-#include "architecture.hpp"
-
+#include "nam_denormals.h"
 #include "nam_plugin.h"
 
 // LV2 Functions
-static LV2_Handle instantiate(const LV2_Descriptor *, double rate, const char *,
+static LV2_Handle instantiate(const LV2_Descriptor *, double rate,
+                              const char *bundle_path,
                               const LV2_Feature *const *features) {
   try {
     auto nam = std::make_unique<NAM::Plugin>();
+    nam->bundlePath = bundle_path;
 
     if (nam->initialize(rate, features)) {
       return static_cast<LV2_Handle>(nam.release());
@@ -38,17 +38,11 @@ static void connect_port(LV2_Handle instance, uint32_t port, void *data) {
 static void activate(LV2_Handle) {}
 
 static void run(LV2_Handle instance, uint32_t n_samples) {
-#ifdef DISABLE_DENORMALS // Disable floating point denormals
-  std::fenv_t fe_state;
-  std::feholdexcept(&fe_state);
-  disable_denormals();
+#ifdef DISABLE_DENORMALS // once per audio thread, see nam_denormals.h
+  NAM::flush_denormals_on_thread();
 #endif
 
   static_cast<NAM::Plugin *>(instance)->process(n_samples);
-
-#ifdef DISABLE_DENORMALS // restore previous floating point state
-  std::feupdateenv(&fe_state);
-#endif
 }
 
 static void deactivate(LV2_Handle) {}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace NAM {
+// Peak and RMS level meter in dBFS. The per-sample work (peak and sum of
+// squares) is left to the caller's existing loops, update() applies the
+// ballistics once per block.
+class LevelMeter {
+public:
+  static constexpr float FLOOR_DB = -90.0f;
+  static constexpr float PEAK_FALL_DB_PER_S = 20.0f;
+  static constexpr float RMS_TIME_S = 0.3f;
+
+  void reset() noexcept {
+    peakDb = FLOOR_DB;
+    meanSquare = 0.0f;
+  }
+
+  void update(float blockPeak, float blockSquares, uint32_t n_samples,
+              double rate) noexcept {
+    if (n_samples == 0)
+      return;
+
+    const float seconds = static_cast<float>(n_samples / rate);
+
+    // instant attack, linear fall in dB
+    const float fallen =
+        std::max(FLOOR_DB, peakDb - PEAK_FALL_DB_PER_S * seconds);
+    peakDb = std::max(to_db(blockPeak), fallen);
+
+    // one-pole average of the power
+    const float coeff = 1.0f - std::exp(-seconds / RMS_TIME_S);
+    meanSquare += coeff * (blockSquares / n_samples - meanSquare);
+
+    if (meanSquare < 1e-12f)
+      meanSquare = 0.0f;
+  }
+
+  float peak_db() const noexcept { return peakDb; }
+
+  float rms_db() const noexcept {
+    return (meanSquare > 0.0f)
+               ? std::max(FLOOR_DB, 10.0f * std::log10(meanSquare))
+               : FLOOR_DB;
+  }
+
+private:
+  float peakDb = FLOOR_DB;
+  float meanSquare = 0.0f;
+
+  static float to_db(float level) noexcept {
+    return (level > 0.0f) ? std::max(FLOOR_DB, 20.0f * std::log10(level))
+                          : FLOOR_DB;
+  }
+};
+} // namespace NAM
@@ -0,0 +1,450 @@
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+#ifdef NAM_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "nam_model_file.h"
+
+namespace NAM {
+namespace {
+#ifdef NAM_HAVE_ZSTD
+// decompresses chunk by chunk straight into out, no temporary file
+bool decompress_zstd(std::istream &in, std::string &out) {
+  ZSTD_DCtx *context = ZSTD_createDCtx();
+
+  if (context == nullptr)
+    return false;
+
+  std::vector<char> inBuffer(ZSTD_DStreamInSize());
+  std::vector<char> outBuffer(ZSTD_DStreamOutSize());
+  size_t remaining = 1;
+  bool first = true;
+  bool ok = true;
+
+  while (ok && in) {
+    in.read(inBuffer.data(), static_cast<std::streamsize>(inBuffer.size()));
+
+    ZSTD_inBuffer input = {inBuffer.data(), static_cast<size_t>(in.gcount()),
+                           0};
+
+    if (input.size == 0)
+      break;
+
+    if (first) {
+      // zstd CLI records the size, so the text is usually allocated once
+      const auto size = ZSTD_getFrameContentSize(input.src, input.size);
+
+      if (size != ZSTD_CONTENTSIZE_UNKNOWN && size != ZSTD_CONTENTSIZE_ERROR)
+        out.reserve(static_cast<size_t>(size));
+
+      first = false;
+    }
+
+    ZSTD_outBuffer output;
+
+    // a full output buffer may leave data inside the decoder
+    do {
+      output = {outBuffer.data(), outBuffer.size(), 0};
+      remaining = ZSTD_decompressStream(context, &output, &input);
+
+      if (ZSTD_isError(remaining)) {
+        ok = false;
+        break;
+      }
+
+      out.append(outBuffer.data(), output.pos);
+    } while (input.pos < input.size || output.pos == output.size);
+  }
+
+  ZSTD_freeDCtx(context);
+
+  // anything left over means the last frame was truncated
+  return ok && remaining == 0;
+}
+#endif
+
+bool is_zstd_frame(const char *magic) noexcept {
+  return static_cast<unsigned char>(magic[0]) == 0x28 &&
+         static_cast<unsigned char>(magic[1]) == 0xb5 &&
+         static_cast<unsigned char>(magic[2]) == 0x2f &&
+         static_cast<unsigned char>(magic[3]) == 0xfd;
+}
+
+// Minimal JSON scanner over a contiguous buffer. Only validates as much as it
+// needs to find value boundaries; NeuralAudio does the strict parse.
+class Scanner {
+public:
+  Scanner(const char *begin, const char *end) : p(begin), end(end) {}
+
+  const char *pos() const noexcept { return p; }
+
+  void skip_ws() noexcept {
+    while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t'))
+      ++p;
+  }
+
+  bool consume(char c) noexcept {
+    skip_ws();
+
+    if (p < end && *p == c) {
+      ++p;
+      return true;
+    }
+
+    return false;
+  }
+
+  bool peek(char c) noexcept {
+    skip_ws();
+    return p < end && *p == c;
+  }
+
+  // raw string contents, escapes left as they are
+  bool string(std::string_view &out) noexcept {
+    if (!consume('"'))
+      return false;
+
+    const char *start = p;
+
+    while (p < end && *p != '"') {
+      if (*p == '\\')
+        ++p;
+      ++p;
+    }
+
+    if (p >= end)
+      return false;
+
+    out = std::string_view(start, p - start);
+    ++p;
+
+    return true;
+  }
+
+  bool number(double &out) noexcept {
+    skip_ws();
+
+#if defined(__cpp_lib_to_chars)
+    const auto result = std::from_chars(p, end, out);
+
+    if (result.ec != std::errc())
+      return false;
+
+    p = result.ptr;
+#else
+    char *next = nullptr;
+    out = std::strtod(p, &next);
+
+    if (next == p)
+      return false;
+
+    p = next;
+#endif
+
+    return true;
+  }
+
+  bool number(float &out) noexcept {
+#if defined(__cpp_lib_to_chars)
+    skip_ws();
+
+    const auto result = std::from_chars(p, end, out);
+
+    if (result.ec != std::errc())
+      return false;
+
+    p = result.ptr;
+
+    return true;
+#else
+    double value;
+
+    if (!number(value))
+      return false;
+
+    out = static_cast<float>(value);
+
+    return true;
+#endif
+  }
+
+  bool skip_value(int depth = 0) noexcept {
+    static constexpr int MAX_DEPTH = 64;
+
+    skip_ws();
+
+    if (p >= end || depth > MAX_DEPTH)
+      return false;
+
+    switch (*p) {
+    case '"': {
+      std::string_view ignored;
+      return string(ignored);
+    }
+
+    case '{':
+      ++p;
+
+      if (consume('}'))
+        return true;
+
+      do {
+        std::string_view key;
+
+        if (!string(key) || !consume(':') || !skip_value(depth + 1))
+          return false;
+      } while (consume(','));
+
+      return consume('}');
+
+    case '[':
+      ++p;
+
+      if (consume(']'))
+        return true;
+
+      do {
+        if (!skip_value(depth + 1))
+          return false;
+      } while (consume(','));
+
+      return consume(']');
+
+    default:
+      // number or literal
+      while (p < end && *p != ',' && *p != '}' && *p != ']' && *p != ' ' &&
+             *p != '\n' && *p != '\r' && *p != '\t')
+        ++p;
+
+      return true;
+    }
+  }
+
+  // the weights array is flat, so its end is the next ']': its elements are
+  // counted by their separators, without parsing them
+  bool count_array(size_t &count) noexcept {
+    if (!consume('['))
+      return false;
+
+    const char *close =
+        static_cast<const char *>(memchr(p, ']', static_cast<size_t>(end - p)));
+
+    if (close == nullptr)
+      return false;
+
+    count = consume(']') ? 0 : std::count(p, close, ',') + 1;
+    p = close + 1;
+
+    return true;
+  }
+
+  bool float_array(std::vector<float> &out) {
+    if (!consume('['))
+      return false;
+
+    const char *close =
+        static_cast<const char *>(memchr(p, ']', static_cast<size_t>(end - p)));
+
+    if (close == nullptr)
+      return false;
+
+    out.clear();
+    out.reserve(std::count(p, close, ',') + 1);
+
+    if (consume(']'))
+      return true;
+
+    do {
+      float value;
+
+      if (!number(value))
+        return false;
+
+      out.push_back(value);
+    } while (consume(','));
+
+    return consume(']');
+  }
+
+private:
+  const char *p;
+  const char *end;
+};
+} // namespace
+
+bool ModelFile::load(const char *path) {
+  std::ifstream file(path, std::ios::binary);
+
+  if (!file)
+    return false;
+
+  // sniff the content rather than trusting the extension
+  char magic[4] = {};
+  file.read(magic, sizeof(magic));
+
+  const bool compressed =
+      file.gcount() == sizeof(magic) && is_zstd_frame(magic);
+
+  file.clear();
+  file.seekg(0);
+  text.clear();
+
+  if (compressed) {
+#ifdef NAM_HAVE_ZSTD
+    if (!decompress_zstd(file, text))
+      return false;
+#else
+    return false;
+#endif
+  } else {
+    text.assign(std::istreambuf_iterator<char>(file),
+                std::istreambuf_iterator<char>());
+  }
+
+  return parse();
+}
+
+bool ModelFile::assign(std::string document) {
+  if (document.size() >= 4 && is_zstd_frame(document.data())) {
+#ifdef NAM_HAVE_ZSTD
+    MemoryStreamBuf buffer(document.data(), document.size());
+    std::istream stream(&buffer);
+
+    text.clear();
+
+    if (!decompress_zstd(stream, text))
+      return false;
+#else
+    return false;
+#endif
+  } else {
+    text = std::move(document);
+  }
+
+  return parse();
+}
+
+// FNV-1a of the (uncompressed) document
+uint64_t ModelFile::hash() const noexcept {
+  uint64_t value = 14695981039346656037ull;
+
+  for (const unsigned char c : text) {
+    value ^= c;
+    value *= 1099511628211ull;
+  }
+
+  return value;
+}
+
+// FNV-1a of the architecture, config, rate and weight count
+uint64_t ModelFile::layout_hash() const noexcept {
+  if (!isNam)
+    return 0;
+
+  uint64_t value = 14695981039346656037ull;
+
+  const auto mix = [&value](const void *data, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+      value ^= static_cast<const unsigned char *>(data)[i];
+      value *= 1099511628211ull;
+    }
+  };
+
+  const uint64_t count = weightCount;
+
+  mix(architecture.c_str(), architecture.size() + 1);
+  mix(config.c_str(), config.size() + 1);
+  mix(&sampleRate, sizeof(sampleRate));
+  mix(&count, sizeof(count));
+
+  return value;
+}
+
+std::string ModelFile::extension(const char *path) {
+  std::filesystem::path name(path);
+
+  if (name.extension() == COMPRESSED_EXTENSION)
+    name = name.stem();
+
+  return name.extension().string();
+}
+
+bool ModelFile::parse() {
+  Scanner scanner(text.data(), text.data() + text.size());
+
+  version.clear();
+  architecture.clear();
+  config.clear();
+  metadata.clear();
+  weights.clear();
+  weightCount = 0;
+  sampleRate = 0;
+  isNam = false;
+
+  bool haveWeights = false;
+
+  if (!scanner.consume('{'))
+    return false;
+
+  if (scanner.consume('}'))
+    return true;
+
+  do {
+    std::string_view key;
+
+    if (!scanner.string(key) || !scanner.consume(':'))
+      return false;
+
+    if (key == "weights" && scanner.peek('[')) {
+      if (readWeights) {
+        if (!scanner.float_array(weights))
+          return false;
+
+        weightCount = weights.size();
+      } else if (!scanner.count_array(weightCount)) {
+        return false;
+      }
+
+      haveWeights = true;
+    } else if ((key == "version" || key == "architecture") &&
+               scanner.peek('"')) {
+      std::string_view value;
+
+      if (!scanner.string(value))
+        return false;
+
+      (key == "version" ? version : architecture) = value;
+    } else if (key == "sample_rate" && !scanner.peek('n')) {
+      if (!scanner.number(sampleRate))
+        return false;
+    } else if (key == "config" || key == "metadata") {
+      scanner.skip_ws();
+      const char *start = scanner.pos();
+
+      if (!scanner.skip_value())
+        return false;
+
+      (key == "config" ? config : metadata).assign(start, scanner.pos());
+    } else if (!scanner.skip_value()) {
+      return false;
+    }
+  } while (scanner.consume(','));
+
+  if (!scanner.consume('}'))
+    return false;
+
+  isNam = haveWeights && !architecture.empty() && !config.empty();
+
+  if (isNam && sampleRate <= 0)
+    sampleRate = DEFAULT_SAMPLE_RATE;
+
+  return true;
+}
+} // namespace NAM
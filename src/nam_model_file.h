@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace NAM {
+// In-memory .nam model file.
+// Parsed in a single scalar pass without building a DOM: config and metadata
+// are kept as raw JSON text, and the weights are only counted. This doesn't
+// replace NeuralAudio's parse. The plugin runs it as a pre-pass, to reject
+// malformed files and to get the architecture, sample rate and hashes it
+// needs, and NeuralAudio then builds its own DOM of the document, for the
+// model and again for its spare. On the bundled models the pass takes about
+// a fifth of the time of one such DOM parse; see the scan % of nam-bench.
+// Tools that need the weight values set readWeights. Other JSON model
+// formats parse successfully but are not flagged as NAM files.
+// zstd-compressed files (model.nam.zst) are decompressed while reading. Runs
+// on non-RT threads only.
+class ModelFile {
+public:
+  // NAM files without a sample_rate were trained at 48 kHz
+  static constexpr double DEFAULT_SAMPLE_RATE = 48000.0;
+  static constexpr const char *COMPRESSED_EXTENSION = ".zst";
+
+  std::string text; // the whole document
+  std::string version;
+  std::string architecture;
+  std::string config;   // raw JSON
+  std::string metadata; // raw JSON
+  double sampleRate = 0;
+  size_t weightCount = 0;
+
+  bool readWeights = false;   // set before loading to fill weights
+  std::vector<float> weights; // empty unless readWeights
+
+  bool load(const char *path);
+  // a document already in memory, compressed or not
+  bool assign(std::string document);
+  bool parse();
+
+  // extension of the model format, ".nam" for both model.nam and model.nam.zst
+  static std::string extension(const char *path);
+
+  bool is_nam() const noexcept { return isNam; }
+
+  // identifies the model across machines, compressed or not
+  uint64_t hash() const noexcept;
+
+  // identifies the shape of a NAM model: files with the same layout hash
+  // differ only in their weights, 0 for other formats
+  uint64_t layout_hash() const noexcept;
+
+private:
+  bool isNam = false;
+};
+
+// Read-only streambuf over memory we don't own, lets NeuralAudio parse an
+// in-memory document without copying it into a stringstream
+class MemoryStreamBuf : public std::streambuf {
+public:
+  MemoryStreamBuf(const char *data, size_t size) {
+    char *begin = const_cast<char *>(data);
+    setg(begin, begin, begin + size);
+  }
+};
+} // namespace NAM
@@ -1,6 +1,12 @@
 #include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <cmath>
+#include <filesystem>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <string>
 #include <utility>
 
 #include "nam_plugin.h"
@@ -16,30 +22,29 @@ namespace NAM {
 Plugin::Plugin() {
   // prevent allocations on the audio thread
   currentModelPath.reserve(MAX_FILE_NAME + 1);
+  for (auto &slot : slots)
+    slot.path.reserve(MAX_FILE_NAME + 1);
+  currentIRPath.reserve(MAX_FILE_NAME + 1);
 
-  //		NeuralAudio::NeuralModel::SetLSTMLoadMode(
-  // #ifdef LSTM_PREFER_NAM
-  //			NeuralAudio::PreferNAMCore
-  // #else
-  //			NeuralAudio::PreferRTNeural
-  // #endif
-  //		);
-  //
-  //		NeuralAudio::NeuralModel::SetWaveNetLoadMode(
-  // #ifdef WAVENET_PREFER_NAM
-  //			NeuralAudio::PreferNAMCore
-  // #else
-  //			NeuralAudio::PreferRTNeural
-  // #endif
-  //);
-}
-
-Plugin::~Plugin() { delete currentModel; }
+  // NeuralAudio backends are picked per model on the worker, see
+  // tune_backend()
+}
+
+Plugin::~Plugin() {
+  for (auto &slot : slots) {
+    delete slot.model;
+    delete slot.converter;
+    delete slot.spare;
+  }
+  delete currentIR;
+}
 
 bool Plugin::initialize(double sampleRate,
                         const LV2_Feature *const *features) noexcept {
   this->sampleRate = sampleRate;
 
+  session.start(sampleRate, bundlePath.c_str());
+
   // for fetching initial options, can be null
   LV2_Options_Option *options = nullptr;
 
@@ -54,6 +59,9 @@ bool Plugin::initialize(double sampleRate,
       options = static_cast<LV2_Options_Option *>(features[i]->data);
   }
 
+  if (map)
+    map = session.wrap_map(map);
+
   lv2_log_logger_set_map(&logger, map);
 
   if (!map) {
@@ -85,18 +93,34 @@ bool Plugin::initialize(double sampleRate,
   uris.units_frame = map->map(map->handle, LV2_UNITS__frame);
 
   uris.model_Path = map->map(map->handle, MODEL_URI);
+  uris.model_Data = map->map(map->handle, MODEL_DATA_URI);
+  uris.model_DataOffset = map->map(map->handle, MODEL_DATA_OFFSET_URI);
+  uris.model_DataSize = map->map(map->handle, MODEL_DATA_SIZE_URI);
+  uris.model_DataName = map->map(map->handle, MODEL_DATA_NAME_URI);
+  uris.atom_Chunk = map->map(map->handle, LV2_ATOM__Chunk);
+  uris.atom_Long = map->map(map->handle, LV2_ATOM__Long);
+  uris.atom_String = map->map(map->handle, LV2_ATOM__String);
+  uris.ir_Path = map->map(map->handle, IR_URI);
+  uris.faults = map->map(map->handle, FAULTS_URI);
+  uris.record_Overruns = map->map(map->handle, RECORD_OVERRUNS_URI);
+  uris.record_Errors = map->map(map->handle, RECORD_ERRORS_URI);
+
+  for (unsigned int i = 0; i < NUM_MODEL_SLOTS; ++i) {
+    const std::string uri = SLOT_URI_PREFIX + std::string(1, 'a' + i);
+    uris.slot_Path[i] = map->map(map->handle, uri.c_str());
+  }
 
   if (options != nullptr)
     options_set(this, options);
 
+  modelDataMessage.resize(
+      (sizeof(LV2ModelDataMsg) + MAX_MODEL_DATA_CHUNK + 7) / 8);
+
   // Initialize delay buffer for bypass crossfading
   update_delay_buffer_size();
 
   // Pre-calculate fade coefficients
-  fadeIncrement =
-      1.0f / ((FADE_TIME_MS / 1000.0f) * static_cast<float>(sampleRate));
-  warmupSamplesTotal =
-      static_cast<size_t>((WARMUP_TIME_MS / 1000.0) * sampleRate);
+  update_fade_coefficients();
 
   return true;
 }
@@ -107,56 +131,127 @@ LV2_Worker_Status Plugin::work(LV2_Handle instance,
                                LV2_Worker_Respond_Handle handle, uint32_t size,
                                const void *data) {
   switch (*(const LV2WorkType *)data) {
-  case kWorkTypeLoad: {
-    auto msg = static_cast<const LV2LoadModelMsg *>(data);
+  case kWorkTypeLoad:
+    return load_model(static_cast<NAM::Plugin *>(instance),
+                      static_cast<const LV2LoadModelMsg *>(data), nullptr,
+                      respond, handle);
+
+  case kWorkTypeModelData:
+    return stage_model_data(static_cast<NAM::Plugin *>(instance),
+                            static_cast<const LV2ModelDataMsg *>(data), size,
+                            respond, handle);
+
+  case kWorkTypeFree: {
+    auto msg = static_cast<const LV2FreeModelMsg *>(data);
     auto nam = static_cast<NAM::Plugin *>(instance);
+    TraceScope trace(nam->tracer, Tracer::kThreadWorker, "free model");
 
-    NeuralAudio::NeuralModel *model = nullptr;
-    LV2SwitchModelMsg response = {kWorkTypeSwitch, {}, {}};
-    LV2_Worker_Status result = LV2_WORKER_SUCCESS;
+    delete msg->model;
+    delete msg->converter;
+    delete msg->spare;
 
-    try {
-      // load model from path
-      const size_t pathlen = strlen(msg->path);
+    return LV2_WORKER_SUCCESS;
+  }
 
-      if (pathlen == 0 || pathlen >= MAX_FILE_NAME) {
-        // avoid logging an error on an empty path.
-        // but do clear the model.
-        model = nullptr;
-      } else {
-        lv2_log_trace(&nam->logger, "Staging model change: `%s`\n", msg->path);
+  case kWorkTypeLoadIR: {
+    auto msg = static_cast<const LV2LoadIRMsg *>(data);
+    auto nam = static_cast<NAM::Plugin *>(instance);
 
-        model = NeuralAudio::NeuralModel::CreateFromFile(msg->path);
-      }
+    Convolver *ir = nullptr;
+    LV2SwitchIRMsg response = {kWorkTypeSwitchIR, {}, {}};
+    TraceScope trace(nam->tracer, Tracer::kThreadWorker, "load IR");
 
-      if (model != nullptr) {
-        response.model = model;
+    const size_t pathlen = strlen(msg->path);
 
-        memcpy(response.path, msg->path, pathlen);
+    // an empty path clears the IR
+    if (pathlen > 0 && pathlen < MAX_FILE_NAME) {
+      lv2_log_trace(&nam->logger, "Staging IR change: `%s`\n", msg->path);
+
+      try {
+        // resampled to the host rate here, off the audio thread
+        ir = Convolver::create_from_file(msg->path, nam->sampleRate);
+      } catch (const std::exception &) {
       }
-    } catch (const std::exception &) {
+
+      if (ir == nullptr)
+        lv2_log_error(&nam->logger, "Unable to load IR from: '%s'\n",
+                      msg->path);
     }
 
-    if (model == nullptr) {
-      response.path[0] = '\0';
+    if (ir != nullptr) {
+      response.ir = ir;
 
-      lv2_log_error(&nam->logger, "Unable to load model from: '%s'\n",
-                    msg->path);
+      memcpy(response.path, msg->path, pathlen);
     }
 
     respond(handle, sizeof(response), &response);
 
-    return result;
+    return LV2_WORKER_SUCCESS;
   }
 
-  case kWorkTypeFree: {
-    auto msg = static_cast<const LV2FreeModelMsg *>(data);
-    delete msg->model;
+  case kWorkTypeFreeIR: {
+    auto msg = static_cast<const LV2FreeIRMsg *>(data);
+    auto nam = static_cast<NAM::Plugin *>(instance);
+    TraceScope trace(nam->tracer, Tracer::kThreadWorker, "free IR");
+
+    delete msg->ir;
+
+    return LV2_WORKER_SUCCESS;
+  }
+
+  case kWorkTypeSettle: {
+    auto msg = static_cast<const LV2SettleModelMsg *>(data);
+    auto nam = static_cast<NAM::Plugin *>(instance);
+    TraceScope trace(nam->tracer, Tracer::kThreadWorker, "settle model");
+
+    LV2SettleModelMsg response = *msg;
+    response.type = kWorkTypeSettled;
+
+    // a model that blew up stays broken, the slot goes without a spare
+    if (!settle_model(msg->model, msg->samples, msg->blockSize)) {
+      lv2_log_warning(&nam->logger, "Dropping model with corrupt state\n");
+
+      delete msg->model;
+      response.model = nullptr;
+    }
+
+    respond(handle, sizeof(response), &response);
+
+    return LV2_WORKER_SUCCESS;
+  }
+
+  case kWorkTypeDefer: {
+    auto msg = static_cast<const LV2LoadModelMsg *>(data);
+    auto nam = static_cast<NAM::Plugin *>(instance);
+
+    // handed back to the audio thread, which owns the slots
+    if (!nam->load_superseded(msg)) {
+      LV2LoadModelMsg response = *msg;
+      response.type = kWorkTypeDeferred;
+      respond(handle, sizeof(response), &response);
+    }
+
+    return LV2_WORKER_SUCCESS;
+  }
+
+  case kWorkTypeStartRecorder: {
+    auto nam = static_cast<NAM::Plugin *>(instance);
+
+    nam->recorder.start_writer(nam->sampleRate,
+                               static_cast<uint32_t>(nam->maxBufferSize));
+
+    const LV2WorkType response = kWorkTypeRecorderStarted;
+    respond(handle, sizeof(response), &response);
 
     return LV2_WORKER_SUCCESS;
   }
 
   case kWorkTypeSwitch:
+  case kWorkTypeSwitchIR:
+  case kWorkTypeSettled:
+  case kWorkTypeRecorderStarted:
+  case kWorkTypeLoadFailed:
+  case kWorkTypeDeferred:
     // should not happen!
     break;
   }
@@ -164,32 +259,716 @@ LV2_Worker_Status Plugin::work(LV2_Handle instance,
   return LV2_WORKER_ERR_UNKNOWN;
 }
 
+// runs on non-RT: builds the model for msg->path and sends it to
+// work_response(). The document is the received one if given, else the one
+// last received into the slot for a #model_data path, else the file.
+LV2_Worker_Status Plugin::load_model(Plugin *nam, const LV2LoadModelMsg *msg,
+                                     std::string *received,
+                                     LV2_Worker_Respond_Function respond,
+                                     LV2_Worker_Respond_Handle handle) {
+  // owned here until they are handed to work_response(), so a load that
+  // throws or is superseded part way frees what it built
+  std::unique_ptr<NeuralAudio::NeuralModel> model;
+  std::unique_ptr<NeuralAudio::NeuralModel> spare;
+  std::unique_ptr<RateConverter> converter;
+  LV2SwitchModelMsg response = {kWorkTypeSwitch, {}, {}, {}, msg->slot, 0,
+                                {}, 0, 0};
+  response.tunedMode = -1;
+  bool loaded = false;
+
+  const auto loadStart = std::chrono::steady_clock::now();
+  TraceStages stages(nam->tracer, Tracer::kThreadWorker);
+
+  ModelFile file;
+  NeuralAudio::EModelLoadMode mode = NeuralAudio::PreferNAMCore;
+  uint64_t modelHash = 0;
+  bool tune = false;
+  bool autoMode = false;
+  const NAMKernelDescriptor *kernel = nullptr;
+
+  const auto read = [&]() {
+    if (received != nullptr)
+      return file.assign(*received);
+
+    if (is_model_data(msg->path))
+      return file.assign(nam->slotModelData[msg->slot]);
+
+    return file.load(msg->path);
+  };
+
+  // the generic model, or the kernel generated for it, if any, which only
+  // takes the level adjustments from the generic one
+  const auto build = [&]() {
+    std::unique_ptr<NeuralAudio::NeuralModel> built(
+        create_model(file, msg->path, mode));
+
+    if (kernel != nullptr && built != nullptr)
+      built = std::make_unique<KernelModel>(kernel, *built);
+
+    return built;
+  };
+
+  // a newer load for the slot is queued: give up at the next stage rather
+  // than build a model that would only be replaced
+  struct Superseded {};
+  bool superseded = false;
+
+  const auto next_stage = [&](const char *name) {
+    if (nam->load_superseded(msg))
+      throw Superseded();
+
+    stages.next(name);
+  };
+
+  const size_t pathlen = strlen(msg->path);
+
+  try {
+    next_stage("read model");
+
+    // load model from path
+    if (pathlen == 0 || pathlen >= MAX_FILE_NAME) {
+      // avoid logging an error on an empty path.
+      // but do clear the model.
+    } else if (!read()) {
+      // rejected by the pre-pass, before NeuralAudio parses it
+    } else {
+      lv2_log_trace(&nam->logger, "Staging model change: `%s`\n", msg->path);
+
+      modelHash = file.hash();
+
+      // a kernel generated by nam2cpp for this exact file beats both
+      // backends
+      KernelRegistry::scan(
+          (std::filesystem::path(nam->bundlePath) / "kernels").string());
+      kernel = file.is_nam() ? KernelRegistry::find(modelHash) : nullptr;
+
+      // only NAM LSTM and WaveNet models can run on either backend
+      const bool choice = file.is_nam() && (file.architecture == "LSTM" ||
+                                            file.architecture == "WaveNet");
+
+      if (kernel != nullptr) {
+        lv2_log_note(&nam->logger, "Using specialized kernel `%s`\n",
+                     kernel->name);
+      } else if (msg->backend == kBackendRTNeural) {
+        mode = NeuralAudio::PreferRTNeural;
+      } else if (msg->backend == kBackendAuto && choice) {
+        autoMode = true;
+        tune = !BackendCache::lookup(modelHash, nam->maxBufferSize, mode);
+
+        // another capture of the same layout, e.g. the next knob setting
+        // of a pack, runs fastest on the same backend
+        if (tune && msg->tunedMode >= 0 &&
+            file.layout_hash() == msg->layout) {
+          mode = static_cast<NeuralAudio::EModelLoadMode>(msg->tunedMode);
+          tune = false;
+          BackendCache::store(modelHash, nam->maxBufferSize, mode);
+        }
+      }
+
+      next_stage("create model");
+      model = build();
+    }
+
+    // run the model at the rate it was trained at
+    double modelRate = 0;
+
+    if (model != nullptr) {
+      modelRate = file.is_nam() ? file.sampleRate : model->GetSampleRate();
+    }
+
+    if (modelRate > 0 && std::abs(modelRate - nam->sampleRate) > 0.5) {
+      converter = std::make_unique<RateConverter>(nam->sampleRate, modelRate,
+                                                  nam->maxBufferSize);
+
+      if (converter->is_valid() && converter->latency() > MAX_LATENCY) {
+        lv2_log_warning(&nam->logger,
+                        "Resampling %.0f Hz to model rate %.0f Hz adds too "
+                        "much latency, running model at host rate\n",
+                        nam->sampleRate, modelRate);
+
+        converter.reset();
+      } else if (converter->is_valid()) {
+        model->SetMaxAudioBufferSize(
+            static_cast<int>(converter->max_model_block()));
+
+        lv2_log_note(&nam->logger,
+                     "Resampling %.0f Hz to model rate %.0f Hz, latency %zu "
+                     "samples\n",
+                     nam->sampleRate, modelRate, converter->latency());
+      } else {
+        lv2_log_warning(&nam->logger,
+                        "Unsupported rate ratio %.0f/%.0f Hz, running model "
+                        "at host rate\n",
+                        nam->sampleRate, modelRate);
+
+        converter.reset();
+      }
+    }
+
+    if (model != nullptr) {
+      const double rate =
+          (converter != nullptr) ? modelRate : nam->sampleRate;
+      const size_t blockSize = (converter != nullptr)
+                                   ? converter->max_model_block()
+                                   : static_cast<size_t>(nam->maxBufferSize);
+
+      if (tune) {
+        next_stage("tune backend");
+        tune_backend(nam, file, msg->path, model, rate, blockSize, mode);
+        BackendCache::store(modelHash, nam->maxBufferSize, mode);
+      }
+
+      // how long the model takes to forget its input, which is also how
+      // long it needs to warm up after its state went stale
+      next_stage("measure warmup");
+      const size_t settleSamples =
+          Warmup::measure(model.get(), rate, blockSize);
+
+      lv2_log_trace(&nam->logger, "Model warmup: %zu samples\n",
+                    settleSamples);
+
+      // a spare is an optimization, the slot still works without one
+      next_stage("create spare");
+      try {
+        spare = build();
+      } catch (const std::exception &) {
+        spare.reset();
+      }
+
+      if (spare != nullptr && converter != nullptr)
+        spare->SetMaxAudioBufferSize(static_cast<int>(blockSize));
+
+      // capture the settled state now rather than warming up on the RT
+      // thread (measuring the warmup already left the model settled)
+      settle_model(spare.get(), settleSamples, blockSize);
+
+      response.settleSamples = settleSamples;
+      response.warmupSamples = static_cast<size_t>(
+          std::ceil(settleSamples * nam->sampleRate / rate));
+      response.settleBlockSize = blockSize;
+      response.cost = file.text.size() * ((spare != nullptr) ? 2 : 1);
+      strncpy(response.architecture, file.architecture.c_str(),
+              sizeof(response.architecture) - 1);
+      response.layout = file.layout_hash();
+      response.tunedMode = autoMode ? static_cast<int32_t>(mode) : -1;
+
+      memcpy(response.path, msg->path, pathlen);
+      loaded = true;
+    }
+  } catch (const std::exception &) {
+    loaded = false;
+  } catch (const Superseded &) {
+    superseded = true;
+  }
+
+  stages.end();
+
+  if (superseded || nam->load_superseded(msg)) {
+    lv2_log_trace(&nam->logger, "Dropping superseded model load: `%s`\n",
+                  msg->path);
+
+    return LV2_WORKER_SUCCESS;
+  }
+
+  // received data is kept for reloads until the slot holds a file
+  if (loaded && received != nullptr) {
+    nam->slotModelData[msg->slot] = std::move(*received);
+  } else if (!is_model_data(msg->path) && (loaded || pathlen == 0)) {
+    std::string().swap(nam->slotModelData[msg->slot]);
+  }
+
+  if (!loaded && pathlen != 0) {
+    lv2_log_error(&nam->logger, "Unable to load model from: '%s'\n",
+                  msg->path);
+
+    // the slot keeps the model it has
+    const LV2LoadFailedMsg failed = {kWorkTypeLoadFailed, msg->slot};
+    respond(handle, sizeof(failed), &failed);
+
+    return LV2_WORKER_SUCCESS;
+  }
+
+  if (loaded) {
+    const std::chrono::duration<double, std::milli> loadTime =
+        std::chrono::steady_clock::now() - loadStart;
+
+    lv2_log_trace(&nam->logger, "Loaded %s model (%zu weights) in %.1f ms\n",
+                  file.architecture.c_str(), file.weightCount,
+                  loadTime.count());
+
+    nam->stats.model_loaded(loadTime.count());
+
+    response.model = model.release();
+    response.converter = converter.release();
+    response.spare = spare.release();
+  }
+
+  // an empty path clears the slot
+  respond(handle, sizeof(response), &response);
+
+  return LV2_WORKER_SUCCESS;
+}
+
+// runs on non-RT: appends a piece of a model sent as #model_data to the
+// staging buffer, and loads the model once all of it has arrived
+LV2_Worker_Status Plugin::stage_model_data(Plugin *nam,
+                                           const LV2ModelDataMsg *msg,
+                                           uint32_t size,
+                                           LV2_Worker_Respond_Function respond,
+                                           LV2_Worker_Respond_Handle handle) {
+  if (size < sizeof(*msg) || size - sizeof(*msg) < msg->size)
+    return LV2_WORKER_ERR_UNKNOWN;
+
+  // the first piece starts a new model, dropping one left incomplete
+  if (msg->offset == 0) {
+    nam->modelData.clear();
+    nam->modelDataTotal = msg->total;
+
+    if (msg->total <= MAX_MODEL_DATA_SIZE)
+      nam->modelData.reserve(msg->total);
+  }
+
+  if (msg->total != nam->modelDataTotal ||
+      msg->offset != nam->modelData.size() ||
+      msg->total > MAX_MODEL_DATA_SIZE ||
+      msg->offset + msg->size > msg->total) {
+    // reported once, the rest of the model is ignored
+    if (nam->modelDataTotal != 0) {
+      lv2_log_error(&nam->logger, "Dropping model data for '%s'\n",
+                    msg->load.path);
+    }
+
+    std::string().swap(nam->modelData);
+    nam->modelDataTotal = 0;
+
+    return LV2_WORKER_SUCCESS;
+  }
+
+  nam->modelData.append(reinterpret_cast<const char *>(msg + 1), msg->size);
+
+  if (nam->modelData.size() < msg->total)
+    return LV2_WORKER_SUCCESS;
+
+  std::string received;
+  received.swap(nam->modelData);
+  nam->modelDataTotal = 0;
+
+  return load_model(nam, &msg->load, &received, respond, handle);
+}
+
+bool Plugin::is_model_data(const char *path) noexcept {
+  return strncmp(path, MODEL_DATA_PREFIX.data(), MODEL_DATA_PREFIX.size()) ==
+         0;
+}
+
 // runs on RT, right after process(), must not block or [de]allocate memory
 LV2_Worker_Status Plugin::work_response(LV2_Handle instance, uint32_t size,
                                         const void *data) {
+  RTSection rtSection;
+  auto nam = static_cast<NAM::Plugin *>(instance);
+  TraceScope trace(nam->tracer, Tracer::kThreadAudio, "work response");
+
+  if (nam->session.enabled())
+    nam->session.response(*(const uint32_t *)data);
+
+  if (*(const LV2WorkType *)data == kWorkTypeSwitchIR) {
+    auto msg = static_cast<const LV2SwitchIRMsg *>(data);
+
+    LV2FreeIRMsg reply = {kWorkTypeFreeIR, nam->currentIR};
+
+    nam->currentIR = msg->ir;
+    nam->currentIRPath = msg->path;
+    assert(nam->currentIRPath.capacity() >= MAX_FILE_NAME + 1);
+
+    nam->schedule->schedule_work(nam->schedule->handle, sizeof(reply), &reply);
+
+    nam->write_current_ir_path();
+
+    return LV2_WORKER_SUCCESS;
+  }
+
+  if (*(const LV2WorkType *)data == kWorkTypeLoadFailed) {
+    auto msg = static_cast<const LV2LoadFailedMsg *>(data);
+
+    // the host may already show the path that failed
+    if (msg->slot == nam->activeSlot)
+      nam->write_current_path();
+
+    return LV2_WORKER_SUCCESS;
+  }
+
+  if (*(const LV2WorkType *)data == kWorkTypeDeferred) {
+    auto msg = static_cast<const LV2LoadModelMsg *>(data);
+    ModelSlot &slot = nam->slots[msg->slot];
+
+    // a load queued since replaces the deferral
+    if (nam->load_superseded(msg))
+      return LV2_WORKER_SUCCESS;
+
+    slot.path = msg->path;
+    slot.deferred = true;
+    slot.deferredGeneration = msg->loadGeneration;
+    slot.evicted = false;
+    assert(slot.path.capacity() >= MAX_FILE_NAME + 1);
+
+    if (msg->slot == nam->activeSlot) {
+      nam->currentModelPath = slot.path;
+      nam->stats.set_model(slot.path.c_str(), "");
+      nam->write_current_path();
+    }
+
+    return LV2_WORKER_SUCCESS;
+  }
+
+  if (*(const LV2WorkType *)data == kWorkTypeRecorderStarted) {
+    nam->recorderReady = true;
+    return LV2_WORKER_SUCCESS;
+  }
+
+  if (*(const LV2WorkType *)data == kWorkTypeSettled) {
+    auto msg = static_cast<const LV2SettleModelMsg *>(data);
+    ModelSlot &slot = nam->slots[msg->slot];
+
+    if (slot.generation == msg->generation && slot.spare == nullptr) {
+      slot.spare = msg->model;
+    } else {
+      // the slot was reloaded in the meantime
+      LV2FreeModelMsg reply = {kWorkTypeFree, msg->model, nullptr, nullptr};
+      nam->schedule->schedule_work(nam->schedule->handle, sizeof(reply),
+                                   &reply);
+    }
+
+    return LV2_WORKER_SUCCESS;
+  }
+
   if (*(const LV2WorkType *)data != kWorkTypeSwitch)
     return LV2_WORKER_ERR_UNKNOWN;
 
   auto msg = static_cast<const LV2SwitchModelMsg *>(data);
-  auto nam = static_cast<NAM::Plugin *>(instance);
+  ModelSlot &slot = nam->slots[msg->slot];
 
   // prepare reply for deleting old model
-  LV2FreeModelMsg reply = {kWorkTypeFree, nam->currentModel};
-
-  // swap current model with new one
-  nam->currentModel = msg->model;
-  nam->currentModelPath = msg->path;
-  assert(nam->currentModelPath.capacity() >= MAX_FILE_NAME + 1);
+  LV2FreeModelMsg reply = {kWorkTypeFree, slot.model, slot.converter,
+                           slot.spare};
+
+  // swap slot model with new one
+  slot.model = msg->model;
+  slot.converter = msg->converter;
+  slot.spare = msg->spare;
+  slot.path = msg->path;
+  slot.cost = msg->cost;
+  slot.lastUsed = ++nam->slotClock;
+  slot.generation++;
+  slot.settleSamples = msg->settleSamples;
+  slot.warmupSamples = msg->warmupSamples;
+  slot.settleBlockSize = msg->settleBlockSize;
+  memcpy(slot.architecture, msg->architecture, sizeof(slot.architecture));
+  slot.layout = msg->layout;
+  slot.tunedMode = msg->tunedMode;
+  slot.deferred = false;
+  slot.evicted = false;
+  assert(slot.path.capacity() >= MAX_FILE_NAME + 1);
 
   // send reply
   nam->schedule->schedule_work(nam->schedule->handle, sizeof(reply), &reply);
 
-  // report change to host/ui
-  nam->write_current_path();
+  nam->evict_slots(msg->slot);
+
+  if (msg->slot == nam->activeSlot) {
+    nam->currentModel = slot.model;
+    nam->currentConverter = slot.converter;
+    nam->modelFaulted = false;
+    nam->currentModelPath = slot.path;
+    assert(nam->currentModelPath.capacity() >= MAX_FILE_NAME + 1);
+    nam->stats.set_model(slot.path.c_str(), slot.architecture);
+
+    nam->update_fade_coefficients();
+
+    // report change to host/ui
+    nam->write_current_path();
+  }
 
   return LV2_WORKER_SUCCESS;
 }
 
+// runs on RT, swaps pointers only
+void Plugin::select_slot(uint32_t slot) noexcept {
+  activeSlot = slot;
+  slots[slot].lastUsed = ++slotClock;
+
+  // passed through until it's back, like a deferred model
+  if (slots[slot].evicted) {
+    slots[slot].evicted = false;
+    reload_slot(slot);
+  }
+
+  currentModel = slots[slot].model;
+  currentConverter = slots[slot].converter;
+  currentModelPath = slots[slot].path;
+  stats.set_model(slots[slot].path.c_str(), slots[slot].architecture);
+  modelFaulted = false;
+  denormalSamples = 0;
+
+  update_fade_coefficients();
+
+  // the model stopped running when its slot was deselected: a settled spare
+  // takes over at once, otherwise it warms up on the dry signal first.
+  // Either way the resampler drops audio left from the last time it played.
+  if (currentModel != nullptr && !swap_in_settled_model()) {
+    warmupSamplesRemaining = warmupSamplesTotal;
+    bypassFadePosition = 1.0f;
+
+    if (currentConverter != nullptr)
+      currentConverter->reset();
+  }
+
+  write_current_path();
+}
+
+// runs on RT, evicted models are handed to the worker to be freed. Their
+// paths are kept, so they're still saved and load again when selected.
+void Plugin::evict_slots(uint32_t keep) noexcept {
+  size_t total = 0;
+
+  for (const auto &slot : slots)
+    total += slot.cost;
+
+  while (total > MAX_RESIDENT_MODEL_BYTES) {
+    ModelSlot *oldest = nullptr;
+
+    for (uint32_t i = 0; i < NUM_MODEL_SLOTS; ++i) {
+      if (i == keep || i == activeSlot || slots[i].model == nullptr)
+        continue;
+
+      if (oldest == nullptr || slots[i].lastUsed < oldest->lastUsed)
+        oldest = &slots[i];
+    }
+
+    if (oldest == nullptr)
+      break;
+
+    LV2FreeModelMsg reply = {kWorkTypeFree, oldest->model, oldest->converter,
+                             oldest->spare};
+    schedule->schedule_work(schedule->handle, sizeof(reply), &reply);
+
+    total -= oldest->cost;
+
+    oldest->model = nullptr;
+    oldest->converter = nullptr;
+    oldest->spare = nullptr;
+    oldest->generation++;
+    oldest->evicted = !oldest->path.empty();
+    oldest->cost = 0;
+  }
+}
+
+// runs on RT: loads every resident model again, with the current backend
+void Plugin::reload_slots() noexcept {
+  for (uint32_t i = 0; i < NUM_MODEL_SLOTS; ++i) {
+    if (slots[i].model != nullptr)
+      reload_slot(i);
+  }
+}
+
+// runs on RT: schedules the load of the slot's path
+void Plugin::reload_slot(uint32_t slot) noexcept {
+  LV2LoadModelMsg msg = load_message(slot);
+  memcpy(msg.path, slots[slot].path.c_str(), slots[slot].path.size() + 1);
+  schedule_load(msg);
+}
+
+// runs on RT: schedules the load of a path restored by restore(), unless
+// a later restore() queued a load for the slot since
+void Plugin::load_deferred(uint32_t slot) noexcept {
+  slots[slot].deferred = false;
+
+  if (loadGenerations[slot].load(std::memory_order_acquire) ==
+      slots[slot].deferredGeneration)
+    reload_slot(slot);
+}
+
+// a load into slot, without the path
+LV2LoadModelMsg Plugin::load_message(uint32_t slot) const noexcept {
+  return {kWorkTypeLoad,
+          {},
+          slot,
+          backend,
+          slots[slot].layout,
+          slots[slot].tunedMode,
+          loadGenerations[slot].load(std::memory_order_relaxed) + 1};
+}
+
+// runs on RT, or in restore(): the load becomes the newest for its slot once
+// it is queued, so a failed schedule doesn't cancel the ones before it
+void Plugin::schedule_load(const LV2LoadModelMsg &msg) noexcept {
+  if (schedule->schedule_work(schedule->handle, sizeof(msg), &msg) ==
+      LV2_WORKER_SUCCESS)
+    loadGenerations[msg.slot].store(msg.loadGeneration,
+                                    std::memory_order_release);
+}
+
+// runs on non-RT or RT: a newer load or deferral for the slot is queued
+// behind this one. The worker may run a load before schedule_load() has
+// published it, hence "newer than" rather than "different from".
+bool Plugin::load_superseded(const LV2LoadModelMsg *msg) const noexcept {
+  const uint32_t newest =
+      loadGenerations[msg->slot].load(std::memory_order_acquire);
+
+  return static_cast<int32_t>(newest - msg->loadGeneration) > 0;
+}
+
+// runs on RT: swaps the stale model for its settled spare, and sends the
+// stale one to the worker to become the next spare
+bool Plugin::swap_in_settled_model() noexcept {
+  ModelSlot &slot = slots[activeSlot];
+
+  if (slot.spare == nullptr)
+    return false;
+
+  LV2SettleModelMsg msg = {kWorkTypeSettle,    slot.model,
+                           activeSlot,         slot.generation,
+                           slot.settleSamples, slot.settleBlockSize};
+
+  slot.model = slot.spare;
+  slot.spare = nullptr;
+  currentModel = slot.model;
+
+  if (currentConverter != nullptr)
+    currentConverter->reset();
+
+  schedule->schedule_work(schedule->handle, sizeof(msg), &msg);
+
+  return true;
+}
+
+// Coefficients depend on the sample rate and on the active model's warmup
+void Plugin::update_fade_coefficients() noexcept {
+  fadeIncrement =
+      1.0f / ((FADE_TIME_MS / 1000.0f) * static_cast<float>(sampleRate));
+  warmupSamplesTotal = slots[activeSlot].warmupSamples;
+  warmupSamplesRemaining = std::min(warmupSamplesRemaining, warmupSamplesTotal);
+}
+
+// runs on non-RT: builds a model from an already read document, so the
+// spare instance doesn't read the file again
+NeuralAudio::NeuralModel *
+Plugin::create_model(const ModelFile &file, const char *path,
+                     NeuralAudio::EModelLoadMode mode) {
+  // the load modes are process wide, keep other instances' workers out
+  static std::mutex loadModeMutex;
+  std::lock_guard<std::mutex> lock(loadModeMutex);
+
+  NeuralAudio::NeuralModel::SetLSTMLoadMode(mode);
+  NeuralAudio::NeuralModel::SetWaveNetLoadMode(mode);
+
+  MemoryStreamBuf buffer(file.text.data(), file.text.size());
+  std::istream stream(&buffer);
+
+  return NeuralAudio::NeuralModel::CreateFromStream(
+      stream, ModelFile::extension(path));
+}
+
+// runs on non-RT: times the model on the other backend too and leaves
+// whichever instance was faster in model, deleting the other one
+void Plugin::tune_backend(Plugin *nam, const ModelFile &file,
+                          const char *path,
+                          std::unique_ptr<NeuralAudio::NeuralModel> &model,
+                          double rate, size_t blockSize,
+                          NeuralAudio::EModelLoadMode &mode) {
+  const NeuralAudio::EModelLoadMode otherMode =
+      (mode == NeuralAudio::PreferRTNeural) ? NeuralAudio::PreferNAMCore
+                                            : NeuralAudio::PreferRTNeural;
+  std::unique_ptr<NeuralAudio::NeuralModel> other;
+
+  try {
+    other.reset(create_model(file, path, otherMode));
+  } catch (const std::exception &) {
+    other.reset();
+  }
+
+  if (other == nullptr)
+    return;
+
+  model->SetMaxAudioBufferSize(static_cast<int>(blockSize));
+  other->SetMaxAudioBufferSize(static_cast<int>(blockSize));
+
+  const size_t samples = static_cast<size_t>(rate * TUNING_TIME_MS / 1000);
+  double modelTime = 1e9;
+  double otherTime = 1e9;
+
+  // interleaved, best of each, so a busy moment doesn't favour either
+  for (int round = 0; round <= TUNING_ROUNDS; ++round) {
+    const double t0 = time_model(model.get(), samples, blockSize);
+    const double t1 = time_model(other.get(), samples, blockSize);
+
+    // the first round only warms up caches and allocations
+    if (round > 0) {
+      modelTime = std::min(modelTime, t0);
+      otherTime = std::min(otherTime, t1);
+    }
+  }
+
+  const bool keepOther = otherTime < modelTime;
+
+  lv2_log_note(&nam->logger, "Backend %s: %.3f ms, %s: %.3f ms\n",
+               (mode == NeuralAudio::PreferRTNeural) ? "RTNeural" : "NAM Core",
+               modelTime * 1000,
+               (otherMode == NeuralAudio::PreferRTNeural) ? "RTNeural"
+                                                          : "NAM Core",
+               otherTime * 1000);
+
+  if (keepOther) {
+    model.swap(other);
+    mode = otherMode;
+  }
+}
+
+// runs on non-RT: wall time in seconds to process samples of noise
+double Plugin::time_model(NeuralAudio::NeuralModel *model, size_t samples,
+                          size_t blockSize) {
+  std::vector<float> buffer(blockSize);
+  std::minstd_rand random(1);
+  std::uniform_real_distribution<float> noise(-0.1f, 0.1f);
+
+  std::chrono::duration<double> elapsed(0);
+
+  for (size_t done = 0; done < samples; done += blockSize) {
+    const size_t count = std::min(blockSize, samples - done);
+
+    for (auto &sample : buffer)
+      sample = noise(random);
+
+    const auto start = std::chrono::steady_clock::now();
+    model->Process(buffer.data(), buffer.data(), count);
+    elapsed += std::chrono::steady_clock::now() - start;
+  }
+
+  return elapsed.count();
+}
+
+// runs on non-RT: feeds silence until the model's state has settled
+// false if the model still outputs NaN/Inf after settling, its state is
+// beyond repair then
+bool Plugin::settle_model(NeuralAudio::NeuralModel *model, size_t samples,
+                          size_t blockSize) {
+  if (model == nullptr || blockSize == 0)
+    return true;
+
+  std::vector<float> silence(blockSize, 0.0f);
+  bool healthy = true;
+
+  for (size_t done = 0; done < samples; done += blockSize) {
+    const size_t count = std::min(blockSize, samples - done);
+
+    model->Process(silence.data(), silence.data(), count);
+    healthy = scan_samples(silence.data(), static_cast<uint32_t>(count)) !=
+              kSampleNonFinite;
+    std::fill(silence.begin(), silence.end(), 0.0f);
+  }
+
+  return healthy;
+}
+
 void Plugin::set_max_buffer_size(int size) noexcept {
   maxBufferSize = size;
 
@@ -200,10 +979,8 @@ void Plugin::set_max_buffer_size(int size) noexcept {
 }
 
 void Plugin::update_delay_buffer_size() noexcept {
-  // Size = fade time + host buffer size (which represents the actual latency)
-  size_t fadeTimeSamples =
-      static_cast<size_t>((FADE_TIME_MS / 1000.0) * sampleRate);
-  size_t delayBufferSize = fadeTimeSamples + maxBufferSize;
+  // room for a block plus the longest latency the dry path is delayed by
+  size_t delayBufferSize = maxBufferSize + MAX_LATENCY;
 
   inputDelayBuffer.resize(delayBufferSize, 0.0f);
   delayBufferWritePos = 0;
@@ -216,6 +993,22 @@ __attribute__((optimize("tree-vectorize", "O3", "fp-contract=fast")))
 __attribute__((target("sse4.2,avx,avx2,fma")))
 #endif
 void Plugin::process(uint32_t n_samples) noexcept {
+  RTSection rtSection;
+  StatsBlock statsBlock(stats, n_samples, sampleRate);
+
+  if (session.enabled())
+    record_block(n_samples);
+
+  SessionOutput sessionOutput(session, ports.audio_out, n_samples);
+
+  update_recorder();
+  recorder.begin_block(ports.audio_in, n_samples);
+  RecorderBlock recorderBlock(recorder, ports.audio_out);
+  TraceScope trace(tracer, Tracer::kThreadAudio, "process");
+  TraceStages stages(tracer, Tracer::kThreadAudio);
+
+  stages.next("events");
+
   // ========== LV2 Control Message Processing ==========
   lv2_atom_forge_set_buffer(&atom_forge, (uint8_t *)ports.notify,
                             ports.notify->atom.size);
@@ -226,6 +1019,9 @@ void Plugin::process(uint32_t n_samples) noexcept {
       const auto obj = reinterpret_cast<LV2_Atom_Object *>(&event->body);
       if (obj->body.otype == uris.patch_Get) {
         write_current_path();
+        write_current_ir_path();
+        write_faults();
+        write_recorder_status();
       } else if (obj->body.otype == uris.patch_Set) {
         const LV2_Atom *property = NULL;
         const LV2_Atom *file_path = NULL;
@@ -237,29 +1033,117 @@ void Plugin::process(uint32_t n_samples) noexcept {
             ((const LV2_Atom_URID *)property)->body == uris.model_Path &&
             file_path && file_path->type == uris.atom_Path &&
             file_path->size > 0 && file_path->size < MAX_FILE_NAME) {
-          LV2LoadModelMsg msg = {kWorkTypeLoad, {}};
+          // loads into whichever slot is selected, replacing a deferred one
+          slots[activeSlot].deferred = false;
+          LV2LoadModelMsg msg = load_message(activeSlot);
+          memcpy(msg.path, file_path + 1, file_path->size);
+          schedule_load(msg);
+        } else if (property && property->type == uris.atom_URID &&
+                   ((const LV2_Atom_URID *)property)->body == uris.ir_Path &&
+                   file_path && file_path->type == uris.atom_Path &&
+                   file_path->size > 0 && file_path->size < MAX_FILE_NAME) {
+          LV2LoadIRMsg msg = {kWorkTypeLoadIR, {}};
           memcpy(msg.path, file_path + 1, file_path->size);
           schedule->schedule_work(schedule->handle, sizeof(msg), &msg);
+        } else if (property && property->type == uris.atom_URID &&
+                   ((const LV2_Atom_URID *)property)->body ==
+                       uris.model_Data &&
+                   file_path && file_path->type == uris.atom_Chunk) {
+          receive_model_data(obj, file_path);
         }
       }
     }
   }
 
+  stages.next("controls");
+
+  // ========== Backend Override ==========
+  const uint32_t requestedBackend = static_cast<uint32_t>(
+      std::clamp(*(ports.backend) + 0.5f, 0.0f, kBackendRTNeural + 0.0f));
+
+  if (requestedBackend != backend) {
+    backend = requestedBackend;
+    reload_slots();
+  }
+
+  // ========== Model Slot Selection ==========
+  const uint32_t slot = static_cast<uint32_t>(
+      std::clamp(*(ports.model_slot) + 0.5f, 0.0f, NUM_MODEL_SLOTS - 1.0f));
+
+  if (slot != activeSlot) {
+    select_slot(slot);
+  }
+
+  // the host compensates for this on the whole plugin, so the dry signal
+  // and bypass are delayed by it too
+  dryDelay = (currentConverter != nullptr) ? currentConverter->latency() : 0;
+  *(ports.latency) = static_cast<float>(dryDelay);
+
+  // ========== Freewheel ==========
+  // The host renders offline, faster than real time: bypass changes and
+  // model switches take effect without fades or warm-up, a soft bypass
+  // doesn't run the model, and the dry signal is only mixed in and the
+  // meters only updated when needed. The output only differs from real time
+  // at transitions.
+  freewheeling = *(ports.freewheel) >= 0.5f;
+
   // ========== Bypass State Management ==========
   const bool bypassed = *(ports.enabled) < 0.5f;
+  stats.set_bypassed(bypassed);
   const bool hardBypassed = *(ports.hard_bypass) >= 0.5f;
 
+  // ========== Deferred Model Loading ==========
+  if (*(ports.load_on_first_use) < 0.5f) {
+    for (uint32_t i = 0; i < NUM_MODEL_SLOTS; ++i) {
+      if (slots[i].deferred)
+        load_deferred(i);
+    }
+  } else if (slots[activeSlot].deferred && !bypassed) {
+    float peak = 0.0f;
+
+    for (uint32_t i = 0; i < n_samples; i++)
+      peak = std::max(peak, std::fabs(ports.audio_in[i]));
+
+    if (peak > DEFERRED_LOAD_THRESHOLD)
+      load_deferred(activeSlot);
+  }
+
+  // clean bypass until the active slot's model is loaded
+  if (slots[activeSlot].model == nullptr && !slots[activeSlot].path.empty()) {
+    awaitingModel = true;
+    bypassFadePosition = 1.0f;
+    pass_through(n_samples);
+    return;
+  }
+
+  if (awaitingModel) {
+    // fade in from the dry signal once the fresh model has warmed up
+    awaitingModel = false;
+    warmupSamplesRemaining = warmupSamplesTotal;
+  }
+
   // Detect bypass state change
   if (bypassed != previousBypassState) {
     previousBypassState = bypassed;
     if (!bypassed) {
-      warmupSamplesRemaining = warmupSamplesTotal;
+      // the model kept running through a soft bypass, so only a hard bypass
+      // leaves stale state; a settled spare replaces it without warming up
+      warmupSamplesRemaining =
+          (modelIdle && !swap_in_settled_model()) ? warmupSamplesTotal : 0;
+      modelIdle = false;
     }
   }
 
+  if (freewheeling) {
+    warmupSamplesRemaining = 0;
+    bypassFadePosition = bypassed ? 1.0f : 0.0f;
+  }
+
   // Hard bypass early exit: skip ALL processing when fully bypassed
-  if (bypassed && hardBypassed && bypassFadePosition >= 1.0f) {
-    std::copy(ports.audio_in, ports.audio_in + n_samples, ports.audio_out);
+  if (bypassed && (hardBypassed || freewheeling) &&
+      bypassFadePosition >= 1.0f) {
+    modelIdle = true;
+    pass_through(n_samples);
     return;
   }
 
@@ -299,18 +1183,32 @@ void Plugin::process(uint32_t n_samples) noexcept {
   targetOutputLevel =
       powf(10.0f, (*(ports.output_level) + modelOutputAdjustmentDB) * 0.05f);
 
-  // ========== Apply Input Gain (SIMD-friendly) ==========
+  stages.next("input gain");
+
+  // ========== Apply Input Gain and Meter (SIMD-friendly) ==========
   const float smoothCoeff = SMOOTH_COEFF;
   float inGain = inputLevel;
+  float inPeak = 0.0f;
+  float inSquares = 0.0f;
+  float modelInPeak = 0.0f;
 
 #pragma GCC ivdep
   for (uint32_t i = 0; i < n_samples; i++) {
     inGain += smoothCoeff * (targetInputLevel - inGain);
     out[i] = in[i] * inGain;
+
+    inPeak = std::max(inPeak, std::fabs(in[i]));
+    inSquares += in[i] * in[i];
+    modelInPeak = std::max(modelInPeak, std::fabs(out[i]));
   }
   inputLevel = inGain;
 
+  stages.next("delay buffer");
+
   // ========== Store to Delay Buffer (SIMD-friendly) ==========
+  // stored when freewheeling too, where the dry signal is only mixed in
+  // while the model faults, since a fault is only found after the model ran
+  bool dryPath = !freewheeling || modelFaulted;
   const size_t delaySize = inputDelayBuffer.size();
   size_t writePos = delayBufferWritePos;
 
@@ -323,17 +1221,69 @@ void Plugin::process(uint32_t n_samples) noexcept {
   }
   delayBufferWritePos = writePos;
 
+  stages.next("model");
+
   // ========== Process Neural Model ==========
-  if (currentModel != nullptr) {
-    currentModel->Process(out, out, n_samples);
+  if (currentModel != nullptr && !modelFaulted) {
+    // kernel models of other instances running now may take this block
+    const BatchScope batch;
+
+    if (currentConverter != nullptr) {
+      currentConverter->process(*currentModel, out, n_samples);
+    } else {
+      currentModel->Process(out, out, n_samples);
+    }
+
+    // one block of NaN/Inf, or denormals that don't die out, means the
+    // model state is broken: use the dry signal and reset the model
+    const SampleFault fault = scan_samples(out, n_samples);
+
+    if (fault == kSampleDenormal) {
+      denormalSamples += n_samples;
+    } else {
+      denormalSamples = 0;
+    }
+
+    if (fault == kSampleNonFinite ||
+        denormalSamples * 1000 > DENORMAL_FAULT_MS * sampleRate) {
+      recover_model();
+
+      // the mix multiplies the wet signal by zero, NaN would survive that
+      std::fill(out, out + n_samples, 0.0f);
+      bypassFadePosition = 1.0f;
+      targetBypassGain = 1.0f;
+      dryPath = true;
+    }
+  }
+
+  if (modelFaulted) {
+    // dry until the reloaded model arrives
+    bypassFadePosition = 1.0f;
+    targetBypassGain = 1.0f;
+  }
+
+  stages.next("ir");
+
+  // ========== Cabinet IR ==========
+  if (currentIR != nullptr) {
+    currentIR->process(out, n_samples);
+  }
+
+  stages.next("mix");
+
+  if (!dryPath) {
+    process_wet(n_samples);
+    return;
   }
 
   // ========== Apply Output Gain and Mix with Dry (SIMD-friendly) ==========
   size_t readPos =
-      (delayBufferWritePos + delaySize - maxBufferSize - n_samples) % delaySize;
+      (delayBufferWritePos + delaySize - dryDelay - n_samples) % delaySize;
 
   float outGain = outputLevel;
   float mixGain = targetBypassGain;
+  float outPeak = 0.0f;
+  float outSquares = 0.0f;
 
 #pragma GCC ivdep
   for (uint32_t i = 0; i < n_samples; i++) {
@@ -350,12 +1300,240 @@ void Plugin::process(uint32_t n_samples) noexcept {
     const float dry = inputDelayBuffer[readPos] * dryGain;
     out[i] = wet + dry;
 
+    outPeak = std::max(outPeak, std::fabs(out[i]));
+    outSquares += out[i] * out[i];
+
     readPos++;
     if (readPos >= delaySize)
       readPos = 0;
   }
 
   outputLevel = outGain;
+
+  stages.next("meters");
+
+  // ========== Meter Ballistics ==========
+  inputMeter.update(inPeak, inSquares, n_samples, sampleRate);
+  modelInputMeter.update(modelInPeak, 0.0f, n_samples, sampleRate);
+  outputMeter.update(outPeak, outSquares, n_samples, sampleRate);
+  write_meters();
+}
+
+// runs on RT: records what drives this block for nam-replay, before the
+// output can overwrite an in-place input
+void Plugin::record_block(uint32_t n_samples) noexcept {
+  if (sessionMaxBlock != maxBufferSize) {
+    sessionMaxBlock = maxBufferSize;
+    session.max_block(maxBufferSize);
+  }
+
+  const float controls[kSessionControlCount] = {
+      *ports.input_level,       *ports.output_level, *ports.enabled,
+      *ports.hard_bypass,       *ports.model_slot,   *ports.backend,
+      *ports.load_on_first_use, *ports.freewheel};
+
+  session.block(n_samples, controls, ports.control, ports.audio_in);
+}
+
+// runs on RT: passes a piece of a model sent as #model_data on to the
+// worker, which collects them and loads the model into the active slot
+void Plugin::receive_model_data(const LV2_Atom_Object *obj,
+                                const LV2_Atom *value) noexcept {
+  const LV2_Atom *offset = nullptr;
+  const LV2_Atom *total = nullptr;
+  const LV2_Atom *name = nullptr;
+
+  lv2_atom_object_get(obj, uris.model_DataOffset, &offset,
+                      uris.model_DataSize, &total, uris.model_DataName, &name,
+                      0);
+
+  if (value->size > MAX_MODEL_DATA_CHUNK || !offset ||
+      offset->type != uris.atom_Long || !total ||
+      total->type != uris.atom_Long) {
+    lv2_log_error(&logger, "Invalid model data message\n");
+    return;
+  }
+
+  auto msg = reinterpret_cast<LV2ModelDataMsg *>(modelDataMessage.data());
+  msg->type = kWorkTypeModelData;
+  msg->size = value->size;
+  msg->offset = static_cast<uint64_t>(((const LV2_Atom_Long *)offset)->body);
+  msg->total = static_cast<uint64_t>(((const LV2_Atom_Long *)total)->body);
+  msg->load = load_message(activeSlot);
+
+  // the name's extension tells the format
+  const char *fileName = "model.nam";
+  size_t nameSize = strlen(fileName);
+
+  if (name && name->type == uris.atom_String && name->size > 1) {
+    fileName = reinterpret_cast<const char *>(name + 1);
+    nameSize = strnlen(fileName, name->size);
+  }
+
+  const size_t prefixSize = MODEL_DATA_PREFIX.size();
+  nameSize = std::min(nameSize, MAX_FILE_NAME - prefixSize - 1);
+
+  memcpy(msg->load.path, MODEL_DATA_PREFIX.data(), prefixSize);
+  memcpy(msg->load.path + prefixSize, fileName, nameSize);
+  msg->load.path[prefixSize + nameSize] = '\0';
+  memcpy(msg + 1, value + 1, value->size);
+
+  slots[activeSlot].deferred = false;
+
+  if (schedule->schedule_work(schedule->handle, sizeof(*msg) + value->size,
+                              msg) != LV2_WORKER_SUCCESS) {
+    lv2_log_error(&logger, "Model data piece too large for the host\n");
+    return;
+  }
+
+  // the piece that completes the model carries its load
+  loadGenerations[activeSlot].store(msg->load.loadGeneration,
+                                    std::memory_order_release);
+}
+
+// runs on RT: follows the record port, the recorder needs its writer
+// started on the worker the first time
+void Plugin::update_recorder() noexcept {
+  const bool on = *(ports.record) >= 0.5f;
+
+  if (on && !recorderReady) {
+    if (!recorderRequested) {
+      const LV2WorkType msg = kWorkTypeStartRecorder;
+      schedule->schedule_work(schedule->handle, sizeof(msg), &msg);
+      recorderRequested = true;
+    }
+
+    return;
+  }
+
+  recorder.set_recording(on);
+
+  if (recorder.overruns() != reportedOverruns ||
+      recorder.write_errors() != reportedWriteErrors)
+    write_recorder_status();
+}
+
+// runs on RT: replaces the broken model state with the slot's settled spare,
+// or reloads the model if there is none
+void Plugin::recover_model() noexcept {
+  ++faultCount;
+  denormalSamples = 0;
+
+  if (!swap_in_settled_model()) {
+    modelFaulted = true;
+
+    if (currentConverter != nullptr)
+      currentConverter->reset();
+
+    LV2LoadModelMsg msg = load_message(activeSlot);
+    memcpy(msg.path, slots[activeSlot].path.c_str(),
+           slots[activeSlot].path.size() + 1);
+    schedule_load(msg);
+  }
+
+  write_faults();
+}
+
+// runs on RT: bit tests rather than std::isfinite(), which -ffast-math
+// folds away; vectorizes to integer compares
+SampleFault Plugin::scan_samples(const float *samples,
+                                 uint32_t n_samples) noexcept {
+  uint32_t nonFinite = 0;
+  uint32_t denormal = 0;
+
+#pragma GCC ivdep
+  for (uint32_t i = 0; i < n_samples; i++) {
+    uint32_t bits;
+    memcpy(&bits, &samples[i], sizeof(bits));
+
+    const uint32_t exponent = bits & 0x7f800000u;
+    nonFinite |= (exponent == 0x7f800000u);
+    denormal |= (exponent == 0) & ((bits & 0x007fffffu) != 0);
+  }
+
+  return nonFinite ? kSampleNonFinite
+                   : (denormal ? kSampleDenormal : kSampleOk);
+}
+
+// runs on RT: copies the input to the output, delayed by the reported
+// latency, metering it on the way
+void Plugin::pass_through(uint32_t n_samples) noexcept {
+  const float *in = ports.audio_in;
+  float *out = ports.audio_out;
+  float peak = 0.0f;
+  float squares = 0.0f;
+  float outPeak = 0.0f;
+  float outSquares = 0.0f;
+
+  if (dryDelay == 0) {
+#pragma GCC ivdep
+    for (uint32_t i = 0; i < n_samples; i++) {
+      out[i] = in[i];
+      peak = std::max(peak, std::fabs(in[i]));
+      squares += in[i] * in[i];
+    }
+
+    outPeak = peak;
+    outSquares = squares;
+  } else {
+    // the whole block is stored before any of it is read back, the output
+    // may be the input buffer
+    const size_t delaySize = inputDelayBuffer.size();
+    size_t writePos = delayBufferWritePos;
+
+    for (uint32_t i = 0; i < n_samples; i++) {
+      inputDelayBuffer[writePos] = in[i];
+      peak = std::max(peak, std::fabs(in[i]));
+      squares += in[i] * in[i];
+
+      if (++writePos >= delaySize)
+        writePos = 0;
+    }
+
+    delayBufferWritePos = writePos;
+
+    size_t readPos = (writePos + delaySize - dryDelay - n_samples) % delaySize;
+
+    for (uint32_t i = 0; i < n_samples; i++) {
+      out[i] = inputDelayBuffer[readPos];
+      outPeak = std::max(outPeak, std::fabs(out[i]));
+      outSquares += out[i] * out[i];
+
+      if (++readPos >= delaySize)
+        readPos = 0;
+    }
+  }
+
+  if (freewheeling)
+    return;
+
+  inputMeter.update(peak, squares, n_samples, sampleRate);
+  modelInputMeter.update(0.0f, 0.0f, n_samples, sampleRate);
+  outputMeter.update(outPeak, outSquares, n_samples, sampleRate);
+  write_meters();
+}
+
+// runs on RT while freewheeling: output gain only, no dry mix or meters
+void Plugin::process_wet(uint32_t n_samples) noexcept {
+  float *__restrict out = ports.audio_out;
+  const float smoothCoeff = SMOOTH_COEFF;
+  float outGain = outputLevel;
+
+#pragma GCC ivdep
+  for (uint32_t i = 0; i < n_samples; i++) {
+    outGain += smoothCoeff * (targetOutputLevel - outGain);
+    out[i] *= outGain;
+  }
+
+  outputLevel = outGain;
+}
+
+void Plugin::write_meters() noexcept {
+  *(ports.input_peak) = inputMeter.peak_db();
+  *(ports.input_rms) = inputMeter.rms_db();
+  *(ports.model_input_peak) = modelInputMeter.peak_db();
+  *(ports.output_peak) = outputMeter.peak_db();
+  *(ports.output_rms) = outputMeter.rms_db();
 }
 
 uint32_t Plugin::options_get(LV2_Handle, LV2_Options_Option *) {
@@ -386,10 +1564,125 @@ LV2_State_Status Plugin::save(LV2_Handle instance,
 
   lv2_log_trace(&nam->logger, "Saving state\n");
 
-  if (!nam->currentModel) {
-    return LV2_STATE_SUCCESS;
+  LV2_State_Status result = LV2_STATE_SUCCESS;
+
+  // deferred models are saved as if loaded, received ones can't be
+  if ((nam->currentModel || nam->slots[nam->activeSlot].deferred) &&
+      !is_model_data(nam->currentModelPath.c_str())) {
+    result = store_path(nam, nam->uris.model_Path, nam->currentModelPath,
+                        store, handle, features);
   }
 
+  for (uint32_t i = 0; i < NUM_MODEL_SLOTS && result == LV2_STATE_SUCCESS;
+       ++i) {
+    const ModelSlot &slot = nam->slots[i];
+
+    if ((slot.model || slot.deferred || slot.evicted) &&
+        !is_model_data(slot.path.c_str())) {
+      result = store_path(nam, nam->uris.slot_Path[i], slot.path, store,
+                          handle, features);
+    }
+  }
+
+  if (result == LV2_STATE_SUCCESS && nam->currentIR) {
+    result = store_path(nam, nam->uris.ir_Path, nam->currentIRPath, store,
+                        handle, features);
+  }
+
+  return result;
+}
+
+LV2_State_Status Plugin::restore(LV2_Handle instance,
+                                 LV2_State_Retrieve_Function retrieve,
+                                 LV2_State_Handle handle, uint32_t flags,
+                                 const LV2_Feature *const *features) {
+  auto nam = static_cast<NAM::Plugin *>(instance);
+
+  NAM::LV2LoadModelMsg msgs[NUM_MODEL_SLOTS] = {};
+  bool haveSlots = false;
+
+  LV2_State_Status result = LV2_STATE_SUCCESS;
+
+  for (uint32_t i = 0; i < NUM_MODEL_SLOTS && result == LV2_STATE_SUCCESS;
+       ++i) {
+    msgs[i] = nam->load_message(i);
+    result = retrieve_path(nam, nam->uris.slot_Path[i], msgs[i].path, retrieve,
+                           handle, features);
+    haveSlots = haveSlots || msgs[i].path[0] != '\0';
+  }
+
+  // state saved before slots existed only has the single model path
+  if (result == LV2_STATE_SUCCESS && !haveSlots) {
+    result = retrieve_path(nam, nam->uris.model_Path, msgs[0].path, retrieve,
+                           handle, features);
+  }
+
+  // with load_on_first_use, models are only loaded once process() sees the
+  // plugin enabled and receiving audio. The slots belong to the audio
+  // thread, which may be running: their paths are deferred through the
+  // worker like a load, and work_response() records them.
+  const bool defer =
+      nam->ports.load_on_first_use != nullptr &&
+      *(nam->ports.load_on_first_use) >= 0.5f;
+
+  if (result == LV2_STATE_SUCCESS) {
+    for (auto &msg : msgs) {
+      if (defer && msg.path[0] != '\0') {
+        lv2_log_trace(&nam->logger, "Deferring model %u '%s'\n", msg.slot,
+                      msg.path);
+
+        msg.type = kWorkTypeDefer;
+        nam->schedule_load(msg);
+        continue;
+      }
+
+      lv2_log_trace(&nam->logger, "Restoring model %u '%s'\n", msg.slot,
+                    msg.path);
+
+      // Schedule model to be loaded by the provided worker
+      // Note: currentModelPath will be updated in work_response() on the RT
+      // thread to avoid race conditions with process() reading it
+      nam->schedule_load(msg);
+    }
+  }
+
+  NAM::LV2LoadIRMsg irMsg = {NAM::kWorkTypeLoadIR, {}};
+
+  LV2_State_Status irResult = retrieve_path(nam, nam->uris.ir_Path, irMsg.path,
+                                            retrieve, handle, features);
+
+  if (irResult == LV2_STATE_SUCCESS) {
+    // an empty path clears any IR left over from a previous state
+    nam->schedule->schedule_work(nam->schedule->handle, sizeof(irMsg), &irMsg);
+  }
+
+  if (nam->session.enabled()) {
+    const char *paths[NUM_MODEL_SLOTS + 1];
+
+    for (uint32_t i = 0; i < NUM_MODEL_SLOTS; ++i)
+      paths[i] = msgs[i].path;
+    paths[NUM_MODEL_SLOTS] = irMsg.path;
+
+    uint32_t flags = 0;
+
+    if (defer)
+      flags |= kSessionRestoreDeferred;
+    if (result == LV2_STATE_SUCCESS)
+      flags |= kSessionRestoreModels;
+    if (irResult == LV2_STATE_SUCCESS)
+      flags |= kSessionRestoreIR;
+
+    nam->session.restore(flags, paths, NUM_MODEL_SLOTS + 1);
+  }
+
+  return (result != LV2_STATE_SUCCESS) ? result : irResult;
+}
+
+LV2_State_Status Plugin::store_path(Plugin *nam, LV2_URID key,
+                                    const std::string &path,
+                                    LV2_State_Store_Function store,
+                                    LV2_State_Handle handle,
+                                    const LV2_Feature *const *features) {
   LV2_State_Map_Path *map_path =
       (LV2_State_Map_Path *)lv2_features_data(features, LV2_STATE__mapPath);
 
@@ -400,11 +1693,10 @@ LV2_State_Status Plugin::save(LV2_Handle instance,
   }
 
   // Map absolute sample path to an abstract state path
-  char *apath =
-      map_path->abstract_path(map_path->handle, nam->currentModelPath.c_str());
+  char *apath = map_path->abstract_path(map_path->handle, path.c_str());
 
-  store(handle, nam->uris.model_Path, apath, strlen(apath) + 1,
-        nam->uris.atom_Path, LV2_STATE_IS_POD | LV2_STATE_IS_PORTABLE);
+  store(handle, key, apath, strlen(apath) + 1, nam->uris.atom_Path,
+        LV2_STATE_IS_POD | LV2_STATE_IS_PORTABLE);
 
   LV2_State_Free_Path *free_path =
       (LV2_State_Free_Path *)lv2_features_data(features, LV2_STATE__freePath);
@@ -420,85 +1712,106 @@ LV2_State_Status Plugin::save(LV2_Handle instance,
   return LV2_STATE_SUCCESS;
 }
 
-LV2_State_Status Plugin::restore(LV2_Handle instance,
-                                 LV2_State_Retrieve_Function retrieve,
-                                 LV2_State_Handle handle, uint32_t flags,
-                                 const LV2_Feature *const *features) {
-  auto nam = static_cast<NAM::Plugin *>(instance);
-
-  // Get model_Path from state
+// an unset key yields an empty path, which clears the slot when loaded
+LV2_State_Status Plugin::retrieve_path(Plugin *nam, LV2_URID key,
+                                       char (&path)[MAX_FILE_NAME],
+                                       LV2_State_Retrieve_Function retrieve,
+                                       LV2_State_Handle handle,
+                                       const LV2_Feature *const *features) {
   size_t size = 0;
   uint32_t type = 0;
   uint32_t valflags = 0;
-  const void *value =
-      retrieve(handle, nam->uris.model_Path, &size, &type, &valflags);
+  const void *value = retrieve(handle, key, &size, &type, &valflags);
 
-  lv2_log_trace(&nam->logger, "Restoring model '%s'\n", (const char *)value);
+  path[0] = '\0';
 
-  NAM::LV2LoadModelMsg msg = {NAM::kWorkTypeLoad, {}};
+  // Check if a path is set
+  if (!value || (type != nam->uris.atom_Path))
+    return LV2_STATE_SUCCESS;
 
-  LV2_State_Status result = LV2_STATE_SUCCESS;
+  LV2_State_Map_Path *map_path =
+      (LV2_State_Map_Path *)lv2_features_data(features, LV2_STATE__mapPath);
 
-  // Check if a path is set
-  if (!value || (type != nam->uris.atom_Path)) {
-    msg.path[0] = '\0';
-  } else {
-    LV2_State_Map_Path *map_path =
-        (LV2_State_Map_Path *)lv2_features_data(features, LV2_STATE__mapPath);
+  if (map_path == nullptr) {
+    lv2_log_error(&nam->logger, "LV2_STATE__mapPath unsupported by host\n");
 
-    if (map_path == nullptr) {
-      lv2_log_error(&nam->logger, "LV2_STATE__mapPath unsupported by host\n");
+    return LV2_STATE_ERR_NO_FEATURE;
+  }
 
-      return LV2_STATE_ERR_NO_FEATURE;
-    }
+  LV2_State_Status result = LV2_STATE_SUCCESS;
 
-    // Map abstract state path to absolute path
-    char *path = map_path->absolute_path(map_path->handle, (const char *)value);
+  // Map abstract state path to absolute path
+  char *apath = map_path->absolute_path(map_path->handle, (const char *)value);
 
-    size_t pathLen = strlen(path);
+  size_t pathLen = strlen(apath);
 
-    if (pathLen >= MAX_FILE_NAME) {
-      lv2_log_error(&nam->logger, "Model path is too long (max %u chars)\n",
-                    MAX_FILE_NAME);
+  if (pathLen >= MAX_FILE_NAME) {
+    lv2_log_error(&nam->logger, "Path is too long (max %u chars)\n",
+                  MAX_FILE_NAME);
 
-      result = LV2_STATE_ERR_UNKNOWN;
-    } else {
-      memcpy(msg.path, path, pathLen);
-    }
+    result = LV2_STATE_ERR_UNKNOWN;
+  } else {
+    memcpy(path, apath, pathLen + 1);
+  }
 
-    LV2_State_Free_Path *free_path =
-        (LV2_State_Free_Path *)lv2_features_data(features, LV2_STATE__freePath);
+  LV2_State_Free_Path *free_path =
+      (LV2_State_Free_Path *)lv2_features_data(features, LV2_STATE__freePath);
 
-    if (free_path != nullptr) {
-      free_path->free_path(free_path->handle, path);
-    } else {
+  if (free_path != nullptr) {
+    free_path->free_path(free_path->handle, apath);
+  } else {
 #ifndef _WIN32 // Can't free host-allocated memory on plugin side under Windows
-      free(path);
+    free(apath);
 #endif
-    }
-  }
-
-  if (result == LV2_STATE_SUCCESS) {
-    // Schedule model to be loaded by the provided worker
-    // Note: currentModelPath will be updated in work_response() on the RT
-    // thread to avoid race conditions with process() reading it
-    nam->schedule->schedule_work(nam->schedule->handle, sizeof(msg), &msg);
   }
 
   return result;
 }
 
 void Plugin::write_current_path() {
+  write_path(uris.model_Path, currentModelPath);
+}
+
+void Plugin::write_current_ir_path() {
+  write_path(uris.ir_Path, currentIRPath);
+}
+
+void Plugin::write_faults() noexcept {
+  write_int(uris.faults, static_cast<int32_t>(faultCount));
+}
+
+void Plugin::write_recorder_status() noexcept {
+  reportedOverruns = recorder.overruns();
+  reportedWriteErrors = recorder.write_errors();
+
+  write_int(uris.record_Overruns, static_cast<int32_t>(reportedOverruns));
+  write_int(uris.record_Errors, static_cast<int32_t>(reportedWriteErrors));
+}
+
+void Plugin::write_int(LV2_URID property, int32_t value) noexcept {
+  LV2_Atom_Forge_Frame frame;
+
+  lv2_atom_forge_frame_time(&atom_forge, 0);
+  lv2_atom_forge_object(&atom_forge, &frame, 0, uris.patch_Set);
+
+  lv2_atom_forge_key(&atom_forge, uris.patch_property);
+  lv2_atom_forge_urid(&atom_forge, property);
+  lv2_atom_forge_key(&atom_forge, uris.patch_value);
+  lv2_atom_forge_int(&atom_forge, value);
+
+  lv2_atom_forge_pop(&atom_forge, &frame);
+}
+
+void Plugin::write_path(LV2_URID property, const std::string &path) {
   LV2_Atom_Forge_Frame frame;
 
   lv2_atom_forge_frame_time(&atom_forge, 0);
   lv2_atom_forge_object(&atom_forge, &frame, 0, uris.patch_Set);
 
   lv2_atom_forge_key(&atom_forge, uris.patch_property);
-  lv2_atom_forge_urid(&atom_forge, uris.model_Path);
+  lv2_atom_forge_urid(&atom_forge, property);
   lv2_atom_forge_key(&atom_forge, uris.patch_value);
-  lv2_atom_forge_path(&atom_forge, currentModelPath.c_str(),
-                      (uint32_t)currentModelPath.length() + 1);
+  lv2_atom_forge_path(&atom_forge, path.c_str(), (uint32_t)path.length() + 1);
 
   lv2_atom_forge_pop(&atom_forge, &frame);
 }
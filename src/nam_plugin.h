@@ -1,8 +1,10 @@
 #pragma once
 
 #include <array>
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
+#include <memory>
 #include <random>
 #include <string_view>
 #include <vector>
@@ -24,28 +26,169 @@
 
 #include <NeuralAudio/NeuralModel.h>
 
+#include "nam_backend_cache.h"
+#include "nam_convolver.h"
+#include "nam_kernel_model.h"
+#include "nam_meter.h"
+#include "nam_model_file.h"
+#include "nam_recorder.h"
+#include "nam_resampler.h"
+#include "nam_rt_check.h"
+#include "nam_session.h"
+#include "nam_stats.h"
+#include "nam_trace.h"
+#include "nam_warmup.h"
+
 #define PlUGIN_URI "http://github.com/rickprice/neural-amp-modeler-bypass-lv2"
 #define MODEL_URI PlUGIN_URI "#model"
+#define MODEL_DATA_URI PlUGIN_URI "#model_data"
+#define MODEL_DATA_OFFSET_URI PlUGIN_URI "#model_data_offset"
+#define MODEL_DATA_SIZE_URI PlUGIN_URI "#model_data_size"
+#define MODEL_DATA_NAME_URI PlUGIN_URI "#model_data_name"
+#define IR_URI PlUGIN_URI "#ir"
+#define FAULTS_URI PlUGIN_URI "#faults"
+#define RECORD_OVERRUNS_URI PlUGIN_URI "#record_overruns"
+#define RECORD_ERRORS_URI PlUGIN_URI "#record_errors"
+#define SLOT_URI_PREFIX PlUGIN_URI "#slot_"
 
 namespace NAM {
 static constexpr unsigned int MAX_FILE_NAME = 1024;
+static constexpr unsigned int NUM_MODEL_SLOTS = 4;
+// resident models are costed by file size, which overestimates their memory
+static constexpr size_t MAX_RESIDENT_MODEL_BYTES = 64 * 1024 * 1024;
+// input peak above which a deferred model is loaded (-80 dBFS)
+static constexpr float DEFERRED_LOAD_THRESHOLD = 0.0001f;
+// models sent as #model_data, in pieces of up to MAX_MODEL_DATA_CHUNK; their
+// slot path is the prefix followed by the name the sender gave
+static constexpr size_t MAX_MODEL_DATA_CHUNK = 16 * 1024;
+static constexpr size_t MAX_MODEL_DATA_SIZE = MAX_RESIDENT_MODEL_BYTES;
+static constexpr std::string_view MODEL_DATA_PREFIX = "memory:";
+
+enum LV2WorkType {
+  kWorkTypeLoad,
+  kWorkTypeSwitch,
+  kWorkTypeFree,
+  kWorkTypeLoadIR,
+  kWorkTypeSwitchIR,
+  kWorkTypeFreeIR,
+  kWorkTypeSettle,
+  kWorkTypeSettled,
+  kWorkTypeStartRecorder,
+  kWorkTypeRecorderStarted,
+  kWorkTypeModelData,
+  kWorkTypeLoadFailed,
+  kWorkTypeDefer, // an LV2LoadModelMsg whose path is only recorded
+  kWorkTypeDeferred
+};
 
-enum LV2WorkType { kWorkTypeLoad, kWorkTypeSwitch, kWorkTypeFree };
+// values of the backend port
+enum ModelBackend { kBackendAuto, kBackendNAMCore, kBackendRTNeural };
+
+// worst kind of value found in a block of model output
+enum SampleFault { kSampleOk, kSampleDenormal, kSampleNonFinite };
 
 struct LV2LoadModelMsg {
   LV2WorkType type;
   char path[MAX_FILE_NAME];
+  uint32_t slot;
+  uint32_t backend;
+  // what the slot holds now, a model of the same layout can reuse its
+  // backend choice
+  uint64_t layout;
+  int32_t tunedMode;
+  // see Plugin::loadGenerations
+  uint32_t loadGeneration;
+};
+
+// a piece of a model sent over the control port, followed by its bytes;
+// the last piece loads it as if from load.path
+struct LV2ModelDataMsg {
+  LV2WorkType type;
+  uint32_t size;
+  uint64_t offset;
+  uint64_t total;
+  LV2LoadModelMsg load;
 };
 
 struct LV2SwitchModelMsg {
   LV2WorkType type;
   char path[MAX_FILE_NAME];
   NeuralAudio::NeuralModel *model;
+  RateConverter *converter;
+  uint32_t slot;
+  size_t cost;
+  NeuralAudio::NeuralModel *spare;
+  size_t settleSamples;
+  size_t settleBlockSize;
+  size_t warmupSamples;
+  char architecture[StatsSlot::ARCHITECTURE_SIZE];
+  uint64_t layout;
+  int32_t tunedMode;
+};
+
+// a load that failed, the slot keeps its model
+struct LV2LoadFailedMsg {
+  LV2WorkType type;
+  uint32_t slot;
 };
 
 struct LV2FreeModelMsg {
   LV2WorkType type;
   NeuralAudio::NeuralModel *model;
+  RateConverter *converter;
+  NeuralAudio::NeuralModel *spare;
+};
+
+// carries a used model to the worker to be settled, and back as a spare
+struct LV2SettleModelMsg {
+  LV2WorkType type;
+  NeuralAudio::NeuralModel *model;
+  uint32_t slot;
+  uint64_t generation;
+  size_t samples;
+  size_t blockSize;
+};
+
+struct LV2LoadIRMsg {
+  LV2WorkType type;
+  char path[MAX_FILE_NAME];
+};
+
+struct LV2SwitchIRMsg {
+  LV2WorkType type;
+  char path[MAX_FILE_NAME];
+  Convolver *ir;
+};
+
+struct LV2FreeIRMsg {
+  LV2WorkType type;
+  Convolver *ir;
+};
+
+// A resident model; owned here, currentModel only points at the active one
+struct ModelSlot {
+  NeuralAudio::NeuralModel *model = nullptr;
+  RateConverter *converter = nullptr;
+  // second instance of the same model, settled on silence by the worker, so
+  // unbypassing after a hard bypass doesn't start from stale state
+  NeuralAudio::NeuralModel *spare = nullptr;
+  std::string path;
+  size_t cost = 0;
+  uint64_t lastUsed = 0;
+  uint64_t generation = 0;
+  size_t settleSamples = 0; // at the model's rate
+  size_t settleBlockSize = 0;
+  size_t warmupSamples = 0; // at the host rate
+  // path restored from state but not loaded yet, see Ports::load_on_first_use
+  bool deferred = false;
+  uint32_t deferredGeneration = 0; // loadGeneration of the deferral
+  // model freed by evict_slots() to save memory, loaded again when selected
+  bool evicted = false;
+  char architecture[StatsSlot::ARCHITECTURE_SIZE] = {}; // for nam-top
+  // ModelFile::layout_hash(), models of the same layout are loaded without
+  // tuning the backend again
+  uint64_t layout = 0;
+  int32_t tunedMode = -1; // backend picked by kBackendAuto, or -1
 };
 
 class Plugin {
@@ -59,18 +202,66 @@ public:
     float *output_level;
     float *enabled;
     float *hard_bypass;
+    float *latency;
+    float *model_slot;
+    float *backend;
+    float *load_on_first_use;
+    float *input_peak;
+    float *input_rms;
+    float *model_input_peak;
+    float *output_peak;
+    float *output_rms;
+    float *record;
+    float *freewheel;
   };
 
   Ports ports = {};
 
   double sampleRate;
+  std::string bundlePath;
 
   LV2_URID_Map *map = nullptr;
   LV2_Log_Logger logger = {};
   LV2_Worker_Schedule *schedule = nullptr;
 
+  Tracer tracer;
+  InstanceStats stats;
+  SessionRecorder session; // see nam_session.h
+
+  // RT: room for a LV2ModelDataMsg and its bytes, 8-byte aligned
+  std::vector<uint64_t> modelDataMessage;
+
+  // worker: the model being received, and the last one received into each
+  // slot, which reloads read instead of a file
+  std::string modelData;
+  uint64_t modelDataTotal = 0;
+  std::array<std::string, NUM_MODEL_SLOTS> slotModelData;
+
+  // the newest load scheduled into each slot; the worker drops a load once
+  // a newer one for its slot is queued, so only the last of a quick run of
+  // model changes is built and swapped in
+  std::array<std::atomic<uint32_t>, NUM_MODEL_SLOTS> loadGenerations{};
+
+  // DI and wet recorder, its writer is started on the worker when the
+  // record port is first switched on
+  Recorder recorder;
+  bool recorderRequested = false;
+  bool recorderReady = false;
+  uint32_t reportedOverruns = 0;
+  uint32_t reportedWriteErrors = 0;
+  int32_t sessionMaxBlock = 0;
+
+  std::array<ModelSlot, NUM_MODEL_SLOTS> slots;
+  uint32_t activeSlot = 0;
+  uint64_t slotClock = 0;
+  uint32_t backend = kBackendAuto;
+
   NeuralAudio::NeuralModel *currentModel = nullptr;
   std::string currentModelPath;
+  // set when the model runs at a sample rate other than the host's
+  RateConverter *currentConverter = nullptr;
+  Convolver *currentIR = nullptr;
+  std::string currentIRPath;
   float prevDCInput = 0;
   float prevDCOutput = 0;
 
@@ -80,11 +271,22 @@ public:
       0.0f; // 0.0 = fully processed, 1.0 = fully bypassed
   std::vector<float> inputDelayBuffer;
   size_t delayBufferWritePos = 0;
+  // the reported latency: the dry path and bypass are delayed to match it
+  size_t dryDelay = 0;
+  static constexpr size_t MAX_LATENCY = 1024;
   static constexpr size_t FADE_TIME_MS = 20;
-  static constexpr size_t WARMUP_TIME_MS = 40; // 2x fade time for model warmup
   size_t warmupSamplesRemaining = 0;
+  bool modelIdle = false; // model skipped by hard bypass, its state is stale
+  bool awaitingModel = false; // passing input through until the model loads
+  bool freewheeling = false;  // the host renders offline, see process()
+  // model output sentinel: NaN/Inf, or denormals for longer than
+  // DENORMAL_FAULT_MS, make the model state be reset (see recover_model())
+  static constexpr size_t DENORMAL_FAULT_MS = 100;
+  size_t denormalSamples = 0;
+  bool modelFaulted = false; // no clean state at hand, skipped until reloaded
+  uint32_t faultCount = 0;
 
-  // Pre-calculated coefficients (set in initialize())
+  // Pre-calculated coefficients (set in update_fade_coefficients())
   float fadeIncrement = 0.0f;
   size_t warmupSamplesTotal = 0;
 
@@ -93,9 +295,18 @@ public:
   float targetOutputLevel = 1.0f;
   float targetBypassGain = 0.0f;
 
+  // Level meters, published on the *_peak and *_rms output ports
+  LevelMeter inputMeter;
+  LevelMeter modelInputMeter; // after the input gain
+  LevelMeter outputMeter;
+
   // Smoothing coefficient for all gain transitions
   static constexpr float SMOOTH_COEFF = 0.001f;
 
+  // audio run through each candidate backend when picking the faster one
+  static constexpr size_t TUNING_TIME_MS = 50;
+  static constexpr int TUNING_ROUNDS = 4;
+
   Plugin();
   ~Plugin();
 
@@ -104,6 +315,7 @@ public:
   void process(uint32_t n_samples) noexcept;
 
   void write_current_path();
+  void write_current_ir_path();
 
   static uint32_t options_get(LV2_Handle instance, LV2_Options_Option *options);
   static uint32_t options_set(LV2_Handle instance,
@@ -139,6 +351,18 @@ private:
     LV2_URID patch_value;
     LV2_URID units_frame;
     LV2_URID model_Path;
+    LV2_URID model_Data;
+    LV2_URID model_DataOffset;
+    LV2_URID model_DataSize;
+    LV2_URID model_DataName;
+    LV2_URID atom_Chunk;
+    LV2_URID atom_Long;
+    LV2_URID atom_String;
+    LV2_URID ir_Path;
+    LV2_URID faults;
+    LV2_URID record_Overruns;
+    LV2_URID record_Errors;
+    LV2_URID slot_Path[NUM_MODEL_SLOTS];
   };
 
   URIs uris = {};
@@ -153,5 +377,65 @@ private:
   int32_t maxBufferSize = 512;
 
   void update_delay_buffer_size() noexcept;
+  void select_slot(uint32_t slot) noexcept;
+  void evict_slots(uint32_t keep) noexcept;
+  void reload_slots() noexcept;
+  void reload_slot(uint32_t slot) noexcept;
+  void load_deferred(uint32_t slot) noexcept;
+  LV2LoadModelMsg load_message(uint32_t slot) const noexcept;
+  void schedule_load(const LV2LoadModelMsg &msg) noexcept;
+  bool load_superseded(const LV2LoadModelMsg *msg) const noexcept;
+  void pass_through(uint32_t n_samples) noexcept;
+  void process_wet(uint32_t n_samples) noexcept;
+  void write_meters() noexcept;
+  void record_block(uint32_t n_samples) noexcept;
+  void update_recorder() noexcept;
+  void recover_model() noexcept;
+  void write_faults() noexcept;
+  void write_recorder_status() noexcept;
+  void write_int(LV2_URID property, int32_t value) noexcept;
+
+  static SampleFault scan_samples(const float *samples,
+                                  uint32_t n_samples) noexcept;
+  bool swap_in_settled_model() noexcept;
+  void update_fade_coefficients() noexcept;
+
+  static bool settle_model(NeuralAudio::NeuralModel *model, size_t samples,
+                           size_t blockSize);
+  static NeuralAudio::NeuralModel *
+  create_model(const ModelFile &file, const char *path,
+               NeuralAudio::EModelLoadMode mode);
+  static void tune_backend(Plugin *nam, const ModelFile &file,
+                           const char *path,
+                           std::unique_ptr<NeuralAudio::NeuralModel> &model,
+                           double rate, size_t blockSize,
+                           NeuralAudio::EModelLoadMode &mode);
+  static double time_model(NeuralAudio::NeuralModel *model, size_t samples,
+                           size_t blockSize);
+  void write_path(LV2_URID property, const std::string &path);
+  void receive_model_data(const LV2_Atom_Object *obj,
+                          const LV2_Atom *value) noexcept;
+
+  static LV2_Worker_Status load_model(Plugin *nam, const LV2LoadModelMsg *msg,
+                                      std::string *received,
+                                      LV2_Worker_Respond_Function respond,
+                                      LV2_Worker_Respond_Handle handle);
+  static LV2_Worker_Status stage_model_data(Plugin *nam,
+                                            const LV2ModelDataMsg *msg,
+                                            uint32_t size,
+                                            LV2_Worker_Respond_Function respond,
+                                            LV2_Worker_Respond_Handle handle);
+  static bool is_model_data(const char *path) noexcept;
+
+  static LV2_State_Status store_path(Plugin *nam, LV2_URID key,
+                                     const std::string &path,
+                                     LV2_State_Store_Function store,
+                                     LV2_State_Handle handle,
+                                     const LV2_Feature *const *features);
+  static LV2_State_Status retrieve_path(Plugin *nam, LV2_URID key,
+                                        char (&path)[MAX_FILE_NAME],
+                                        LV2_State_Retrieve_Function retrieve,
+                                        LV2_State_Handle handle,
+                                        const LV2_Feature *const *features);
 };
 } // namespace NAM
@@ -0,0 +1,213 @@
+#include "nam_recorder.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+
+namespace NAM {
+namespace {
+std::atomic<unsigned> takeCount{0};
+
+std::filesystem::path recording_dir() {
+  if (const char *dir = getenv("NAM_RECORD_DIR"); dir && dir[0] != '\0')
+    return dir;
+
+  const char *home = getenv("HOME");
+#ifdef _WIN32
+  if (home == nullptr)
+    home = getenv("USERPROFILE");
+#endif
+
+  return std::filesystem::path(home ? home : ".") / "nam-recordings";
+}
+} // namespace
+
+Recorder::~Recorder() {
+  if (!thread.joinable())
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stop = true;
+  }
+
+  wake.notify_all();
+  thread.join();
+
+  drain();
+  close_take();
+}
+
+void Recorder::start_writer(double sampleRate, uint32_t maxBlock) {
+  if (ring != nullptr)
+    return;
+
+  this->sampleRate = sampleRate;
+
+  const size_t bytesPerSecond = static_cast<size_t>(sampleRate) * 2 * 4;
+  ring = std::make_unique<ByteRing>(
+      static_cast<size_t>(RING_SECONDS * bytesPerSecond) + 8 * maxBlock);
+  staging.resize(ring->capacity());
+  scratch.resize(4096, 0.0f);
+
+  thread = std::thread(&Recorder::run, this);
+}
+
+void Recorder::set_recording(bool on) noexcept {
+  if (ring == nullptr || on == takeOpen)
+    return;
+
+  // retried on the next block if the ring is full
+  if (push_marker(on ? kTakeStart : kTakeStop)) {
+    takeOpen = on;
+    gapSamples = 0;
+  }
+}
+
+void Recorder::begin_block(const float *input,
+                           uint32_t n_samples) noexcept {
+  blockPending = false;
+
+  if (!takeOpen || n_samples == 0)
+    return;
+
+  const size_t size = sizeof(Record) * 2 + 2 * n_samples * sizeof(float);
+
+  if (!ring->prepare(size)) {
+    ++overrunCount;
+    gapSamples += n_samples;
+    return;
+  }
+
+  if (gapSamples > 0) {
+    const Record gap = {kTakeGap, gapSamples};
+    ring->put(&gap, sizeof(gap));
+    gapSamples = 0;
+  }
+
+  const Record record = {kTakeAudio, n_samples};
+  ring->put(&record, sizeof(record));
+  ring->put(input, n_samples * sizeof(float));
+
+  blockPending = true;
+  pendingSamples = n_samples;
+}
+
+void Recorder::end_block(const float *output) noexcept {
+  if (!blockPending)
+    return;
+
+  ring->put(output, pendingSamples * sizeof(float));
+  ring->commit();
+  blockPending = false;
+}
+
+bool Recorder::push_marker(RecordType type) noexcept {
+  if (!ring->prepare(sizeof(Record)))
+    return false;
+
+  const Record record = {type, 0};
+  ring->put(&record, sizeof(record));
+  ring->commit();
+
+  return true;
+}
+
+// writer thread
+void Recorder::drain() {
+  const uint8_t *first;
+  const uint8_t *second;
+  size_t firstSize;
+  const size_t available = ring->peek(first, firstSize, second);
+
+  // records are committed whole, so everything available parses
+  memcpy(staging.data(), first, firstSize);
+  memcpy(staging.data() + firstSize, second, available - firstSize);
+  ring->release(available);
+
+  for (size_t offset = 0; offset < available;) {
+    Record record;
+    memcpy(&record, &staging[offset], sizeof(record));
+    offset += sizeof(record);
+
+    const bool wasOpen = input.is_open();
+    bool ok = true;
+
+    switch (record.type) {
+    case kTakeStart:
+      open_take();
+      break;
+
+    case kTakeAudio: {
+      const auto samples = reinterpret_cast<const float *>(&staging[offset]);
+
+      ok = input.write(samples, record.n_samples) &&
+           output.write(samples + record.n_samples, record.n_samples);
+      offset += 2 * record.n_samples * sizeof(float);
+      break;
+    }
+
+    case kTakeGap:
+      for (uint32_t done = 0; ok && done < record.n_samples;) {
+        const size_t count =
+            std::min<size_t>(record.n_samples - done, scratch.size());
+        ok = input.write(scratch.data(), count) &&
+             output.write(scratch.data(), count);
+        done += static_cast<uint32_t>(count);
+      }
+      break;
+
+    case kTakeStop:
+      close_take();
+      break;
+    }
+
+    // give up on the take, the audio thread carries on regardless
+    if (!ok && wasOpen) {
+      writeErrors.fetch_add(1, std::memory_order_relaxed);
+      close_take();
+    }
+  }
+}
+
+void Recorder::run() {
+  std::unique_lock<std::mutex> lock(mutex);
+
+  while (!stop) {
+    wake.wait_for(lock, INTERVAL);
+    drain();
+  }
+}
+
+void Recorder::open_take() {
+  close_take();
+
+  const std::filesystem::path dir = recording_dir();
+  std::error_code error;
+  std::filesystem::create_directories(dir, error);
+
+  char stamp[32];
+  const std::time_t now = std::time(nullptr);
+  std::strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", std::localtime(&now));
+
+  const std::string take =
+      (dir / ("nam-" + std::string(stamp) + "-" +
+              std::to_string(++takeCount)))
+          .string();
+
+  if (!input.open((take + "-di.wav").c_str(), sampleRate) ||
+      !output.open((take + "-wet.wav").c_str(), sampleRate)) {
+    writeErrors.fetch_add(1, std::memory_order_relaxed);
+    close_take();
+  }
+}
+
+void Recorder::close_take() {
+  const bool ok = input.close() & output.close();
+
+  if (!ok)
+    writeErrors.fetch_add(1, std::memory_order_relaxed);
+}
+} // namespace NAM
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "nam_ring.h"
+#include "nam_wav.h"
+
+namespace NAM {
+// Records the dry input and the processed output of the plugin to a pair of
+// WAV files (<take>-di.wav and <take>-wet.wav), for re-amping and capture
+// training. Takes go to NAM_RECORD_DIR, or ~/nam-recordings.
+//
+// The audio thread copies each block into a preallocated ring and never
+// waits; a writer thread streams the ring to disk. Blocks that don't fit are
+// counted as overruns and written as silence, so the files stay in time.
+class Recorder {
+public:
+  static constexpr double RING_SECONDS = 2.0;
+  static constexpr auto INTERVAL = std::chrono::milliseconds(50);
+
+  Recorder() = default;
+  ~Recorder();
+
+  Recorder(const Recorder &) = delete;
+  Recorder &operator=(const Recorder &) = delete;
+
+  // non-RT: allocates the ring and starts the writer, once
+  void start_writer(double sampleRate, uint32_t maxBlock);
+
+  // audio thread, once start_writer() has returned
+  void set_recording(bool on) noexcept;
+  // the input is copied right away, so the output may overwrite it
+  void begin_block(const float *input, uint32_t n_samples) noexcept;
+  void end_block(const float *output) noexcept;
+
+  bool recording() const noexcept { return takeOpen; }
+  uint32_t overruns() const noexcept { return overrunCount; }
+
+  // the writer couldn't create or write the files of a take
+  uint32_t write_errors() const noexcept {
+    return writeErrors.load(std::memory_order_relaxed);
+  }
+
+  // ended by end_block()
+  bool block_pending() const noexcept { return blockPending; }
+
+private:
+  enum RecordType : uint32_t { kTakeStart, kTakeAudio, kTakeGap, kTakeStop };
+
+  struct Record {
+    uint32_t type;
+    uint32_t n_samples; // followed by the input, then the output
+  };
+
+  std::unique_ptr<ByteRing> ring;
+  double sampleRate = 0.0;
+
+  // audio thread
+  bool takeOpen = false;
+  bool blockPending = false;
+  uint32_t pendingSamples = 0;
+  uint32_t gapSamples = 0;
+  uint32_t overrunCount = 0;
+
+  std::atomic<uint32_t> writeErrors{0};
+
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::thread thread;
+  bool stop = false;
+
+  // writer thread
+  WavWriter input;
+  WavWriter output;
+  std::vector<uint8_t> staging; // the ring's contents, unwrapped
+  std::vector<float> scratch;   // silence for gaps
+
+  bool push_marker(RecordType type) noexcept;
+  void drain();
+  void run();
+  void open_take();
+  void close_take();
+};
+
+// ends the block started by Recorder::begin_block() when it goes out of
+// scope, with whatever process() left in the output
+class RecorderBlock {
+public:
+  RecorderBlock(Recorder &recorder, const float *output) noexcept
+      : recorder(recorder), output(output) {}
+
+  ~RecorderBlock() {
+    if (recorder.block_pending())
+      recorder.end_block(output);
+  }
+
+  RecorderBlock(const RecorderBlock &) = delete;
+  RecorderBlock &operator=(const RecorderBlock &) = delete;
+
+private:
+  Recorder &recorder;
+  const float *output;
+};
+} // namespace NAM
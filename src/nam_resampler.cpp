@@ -0,0 +1,193 @@
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#include "nam_resampler.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+namespace NAM {
+namespace {
+// zeroth order modified Bessel function, for the Kaiser window
+double bessel_i0(double x) {
+  double sum = 1.0;
+  double term = 1.0;
+
+  for (int k = 1; k < 32; ++k) {
+    term *= (x / (2.0 * k)) * (x / (2.0 * k));
+    sum += term;
+  }
+
+  return sum;
+}
+} // namespace
+
+Resampler::Resampler(unsigned int up, unsigned int down,
+                     unsigned int tapsPerPhase, size_t maxInput)
+    : up(up), down(down), taps(tapsPerPhase), maxInput(maxInput) {
+  static constexpr double KAISER_BETA = 8.0;
+
+  // windowed-sinc prototype at the upsampled rate, cut off a little below the
+  // lower of the two Nyquist frequencies
+  const size_t length = static_cast<size_t>(up) * taps;
+  const double cutoff = 0.45 / std::max(up, down);
+  const double center = (length - 1) / 2.0;
+
+  coeffs.resize(length);
+
+  for (size_t n = 0; n < length; ++n) {
+    const double x = n - center;
+    const double ratio = x / (center + 1.0);
+    const double window =
+        bessel_i0(KAISER_BETA * std::sqrt(std::max(0.0, 1.0 - ratio * ratio))) /
+        bessel_i0(KAISER_BETA);
+    const double arg = 2.0 * M_PI * cutoff * x;
+    const double sinc = (std::abs(arg) < 1e-9) ? 1.0 : std::sin(arg) / arg;
+
+    // tap k of phase p is prototype sample p + k * up, stored reversed so
+    // process() runs forwards over the history
+    const size_t phase = n % up;
+    const size_t tap = n / up;
+
+    coeffs[phase * taps + (taps - 1 - tap)] =
+        static_cast<float>(2.0 * cutoff * sinc * window * up);
+  }
+
+  history.assign(taps - 1 + maxInput, 0.0f);
+}
+
+double Resampler::delay() const noexcept {
+  return (static_cast<double>(up) * taps - 1.0) / (2.0 * up);
+}
+
+void Resampler::reset() noexcept {
+  std::fill(history.begin(), history.end(), 0.0f);
+  position = 0;
+}
+
+size_t Resampler::process(const float *in, size_t n_samples,
+                          float *out) noexcept {
+  size_t produced = 0;
+
+  while (n_samples > 0) {
+    const size_t count = std::min(n_samples, maxInput);
+
+    std::copy(in, in + count, history.begin() + (taps - 1));
+
+    const size_t end = count * up;
+
+    for (; position < end; position += down) {
+      const float *__restrict c = &coeffs[(position % up) * taps];
+      const float *__restrict x = &history[position / up];
+      float y = 0.0f;
+
+#pragma GCC ivdep
+      for (size_t k = 0; k < taps; ++k)
+        y += c[k] * x[k];
+
+      out[produced++] = y;
+    }
+
+    position -= end;
+
+    std::copy(history.begin() + count, history.begin() + count + (taps - 1),
+              history.begin());
+
+    in += count;
+    n_samples -= count;
+  }
+
+  return produced;
+}
+
+RateConverter::RateConverter(double hostRate, double modelRate,
+                             size_t maxBlockSize)
+    : maxBlockSize(maxBlockSize) {
+  const unsigned int host = static_cast<unsigned int>(std::lround(hostRate));
+  const unsigned int native = static_cast<unsigned int>(std::lround(modelRate));
+
+  if (host == 0 || native == 0)
+    return;
+
+  const unsigned int divisor = std::gcd(host, native);
+  const unsigned int hostFactor = host / divisor;
+  const unsigned int modelFactor = native / divisor;
+
+  if (hostFactor > MAX_PHASES || modelFactor > MAX_PHASES)
+    return;
+
+  downsampler = std::make_unique<Resampler>(modelFactor, hostFactor,
+                                            TAPS_PER_PHASE, maxBlockSize);
+  modelBuffer.resize(downsampler->max_output(maxBlockSize));
+
+  upsampler = std::make_unique<Resampler>(hostFactor, modelFactor,
+                                          TAPS_PER_PHASE, modelBuffer.size());
+  upBuffer.resize(upsampler->max_output(modelBuffer.size()));
+
+  prefill = (hostFactor + modelFactor - 1) / modelFactor + 2;
+  fifo.resize(upBuffer.size() + maxBlockSize + prefill);
+
+  const double hostDelay = downsampler->delay() +
+                           upsampler->delay() * hostFactor / modelFactor +
+                           prefill;
+  latencySamples = static_cast<size_t>(std::lround(hostDelay));
+
+  reset();
+
+  valid = true;
+}
+
+void RateConverter::reset() noexcept {
+  downsampler->reset();
+  upsampler->reset();
+
+  std::fill(fifo.begin(), fifo.end(), 0.0f);
+  fifoRead = 0;
+  fifoCount = prefill;
+}
+
+void RateConverter::process(NeuralAudio::NeuralModel &model, float *buffer,
+                            size_t n_samples) noexcept {
+  const size_t fifoSize = fifo.size();
+
+  while (n_samples > 0) {
+    const size_t count = std::min(n_samples, maxBlockSize);
+
+    const size_t modelSamples =
+        downsampler->process(buffer, count, modelBuffer.data());
+
+    if (modelSamples > 0)
+      model.Process(modelBuffer.data(), modelBuffer.data(), modelSamples);
+
+    const size_t hostSamples =
+        upsampler->process(modelBuffer.data(), modelSamples, upBuffer.data());
+
+    size_t writePos = (fifoRead + fifoCount) % fifoSize;
+
+    for (size_t i = 0; i < hostSamples; ++i) {
+      fifo[writePos] = upBuffer[i];
+      if (++writePos >= fifoSize)
+        writePos = 0;
+    }
+
+    fifoCount = std::min(fifoCount + hostSamples, fifoSize);
+
+    // the prefill keeps this from underrunning, but never read stale data
+    const size_t available = std::min(fifoCount, count);
+
+    for (size_t i = 0; i < available; ++i) {
+      buffer[i] = fifo[fifoRead];
+      if (++fifoRead >= fifoSize)
+        fifoRead = 0;
+    }
+
+    std::fill(buffer + available, buffer + count, 0.0f);
+    fifoCount -= available;
+
+    buffer += count;
+    n_samples -= count;
+  }
+}
+} // namespace NAM
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include <NeuralAudio/NeuralModel.h>
+
+namespace NAM {
+// Streaming polyphase FIR resampler for a rational ratio up / down.
+// Coefficients and history are allocated in the constructor, process() is
+// RT-safe.
+class Resampler {
+public:
+  Resampler(unsigned int up, unsigned int down, unsigned int tapsPerPhase,
+            size_t maxInput);
+
+  // returns the number of samples written to out
+  size_t process(const float *in, size_t n_samples, float *out) noexcept;
+  void reset() noexcept;
+
+  size_t max_output(size_t n_samples) const noexcept {
+    return (n_samples * up) / down + 1;
+  }
+
+  // group delay of the anti-aliasing filter, in input samples
+  double delay() const noexcept;
+
+private:
+  unsigned int up;
+  unsigned int down;
+  unsigned int taps;
+  size_t maxInput;
+  std::vector<float> coeffs;  // [phase][tap], taps reversed for each phase
+  std::vector<float> history; // taps - 1 previous samples + current input
+  size_t position = 0;        // next output, in 1/up input samples
+};
+
+// Runs a model at its native sample rate behind a pair of resamplers.
+// Built on the worker thread next to the model it serves.
+class RateConverter {
+public:
+  static constexpr unsigned int TAPS_PER_PHASE = 24;
+  static constexpr unsigned int MAX_PHASES = 512;
+
+  RateConverter(double hostRate, double modelRate, size_t maxBlockSize);
+
+  // false if the rate ratio can't be expressed with MAX_PHASES phases
+  bool is_valid() const noexcept { return valid; }
+
+  // total added latency, in host samples
+  size_t latency() const noexcept { return latencySamples; }
+
+  // largest block the model will be asked to process
+  size_t max_model_block() const noexcept { return modelBuffer.size(); }
+
+  void process(NeuralAudio::NeuralModel &model, float *buffer,
+               size_t n_samples) noexcept;
+  void reset() noexcept;
+
+private:
+  bool valid = false;
+  size_t maxBlockSize;
+  size_t latencySamples = 0;
+  size_t prefill = 0;
+
+  std::unique_ptr<Resampler> downsampler; // host -> model rate
+  std::unique_ptr<Resampler> upsampler;   // model -> host rate
+  std::vector<float> modelBuffer;
+  std::vector<float> upBuffer;
+
+  // absorbs the +/- 1 sample jitter in per-block output counts
+  std::vector<float> fifo;
+  size_t fifoRead = 0;
+  size_t fifoCount = 0;
+};
+} // namespace NAM
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace NAM {
+// Single producer, single consumer byte ring for streaming from the audio
+// thread to a background thread. The producer writes whole records: prepare()
+// checks for room, put() copies parts in, commit() publishes them. Nothing
+// is ever partially visible, and a record that doesn't fit is refused rather
+// than waited for.
+class ByteRing {
+public:
+  // capacity is rounded up to a power of two
+  explicit ByteRing(size_t capacity) {
+    size_t size = 1;
+    while (size < capacity)
+      size <<= 1;
+
+    buffer.resize(size);
+    mask = size - 1;
+  }
+
+  ByteRing(const ByteRing &) = delete;
+  ByteRing &operator=(const ByteRing &) = delete;
+
+  size_t capacity() const noexcept { return buffer.size(); }
+
+  // bytes committed since the ring was created, from any thread
+  size_t written() const noexcept {
+    return head.load(std::memory_order_acquire);
+  }
+
+  // bytes released since the ring was created, consumer only
+  size_t consumed() const noexcept {
+    return tail.load(std::memory_order_relaxed);
+  }
+
+  // producer
+  bool prepare(size_t size) noexcept {
+    pending = head.load(std::memory_order_relaxed);
+    const size_t used = pending - tail.load(std::memory_order_acquire);
+
+    return size <= buffer.size() - used;
+  }
+
+  void put(const void *data, size_t size) noexcept {
+    if (size == 0)
+      return;
+
+    const size_t offset = pending & mask;
+    const size_t first = (size < buffer.size() - offset)
+                             ? size
+                             : buffer.size() - offset;
+
+    memcpy(&buffer[offset], data, first);
+    memcpy(&buffer[0], static_cast<const uint8_t *>(data) + first,
+           size - first);
+    pending += size;
+  }
+
+  void commit() noexcept { head.store(pending, std::memory_order_release); }
+
+  // consumer: up to two regions of readable data, then release() them
+  size_t peek(const uint8_t *&first, size_t &firstSize,
+              const uint8_t *&second) const noexcept {
+    const size_t tail = this->tail.load(std::memory_order_relaxed);
+    const size_t available = head.load(std::memory_order_acquire) - tail;
+    const size_t offset = tail & mask;
+
+    firstSize = (available < buffer.size() - offset) ? available
+                                                     : buffer.size() - offset;
+    first = &buffer[offset];
+    second = &buffer[0];
+
+    return available;
+  }
+
+  void release(size_t size) noexcept {
+    tail.store(tail.load(std::memory_order_relaxed) + size,
+               std::memory_order_release);
+  }
+
+private:
+  std::vector<uint8_t> buffer;
+  size_t mask = 0;
+  size_t pending = 0; // producer only
+  std::atomic<size_t> head{0};
+  std::atomic<size_t> tail{0};
+};
+} // namespace NAM
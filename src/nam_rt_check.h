@@ -0,0 +1,36 @@
+#pragma once
+
+// Marks code that runs on the audio thread. In builds with NAM_RT_CHECK,
+// entering and leaving a section is reported to nam_rt_enter() and
+// nam_rt_leave() when something defines them (tools/nam-rtcheck, or its
+// preload library under any host), which then flags allocations, locks and
+// syscalls made inside. Otherwise the marker compiles to nothing.
+
+#if defined(NAM_RT_CHECK) && !defined(_WIN32)
+extern "C" {
+__attribute__((weak)) void nam_rt_enter();
+__attribute__((weak)) void nam_rt_leave();
+}
+#endif
+
+namespace NAM {
+class RTSection {
+public:
+#if defined(NAM_RT_CHECK) && !defined(_WIN32)
+  RTSection() noexcept {
+    if (nam_rt_enter)
+      nam_rt_enter();
+  }
+
+  ~RTSection() {
+    if (nam_rt_leave)
+      nam_rt_leave();
+  }
+#else
+  RTSection() noexcept {}
+#endif
+
+  RTSection(const RTSection &) = delete;
+  RTSection &operator=(const RTSection &) = delete;
+};
+} // namespace NAM
@@ -0,0 +1,236 @@
+#include "nam_session.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+namespace NAM {
+namespace {
+std::atomic<unsigned> sessionCount{0};
+
+constexpr size_t padded(size_t size) { return (size + 7) & ~size_t(7); }
+} // namespace
+
+SessionRecorder::~SessionRecorder() {
+  if (file == nullptr)
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stop = true;
+  }
+
+  wake.notify_all();
+  thread.join();
+
+  drain();
+  fclose(file);
+}
+
+bool SessionRecorder::start(double sampleRate, const char *bundlePath) {
+  const char *dir = getenv("NAM_SESSION");
+
+  if (dir == nullptr || dir[0] == '\0')
+    return false;
+
+  const std::string path = std::string(dir) + "/nam-session-" +
+                           std::to_string(getpid()) + "-" +
+                           std::to_string(++sessionCount) + ".bin";
+  file = fopen(path.c_str(), "wb");
+
+  if (file == nullptr) {
+    fprintf(stderr, "nam: cannot record session to %s\n", path.c_str());
+    return false;
+  }
+
+  SessionHeader header = {};
+  memcpy(header.magic, SESSION_MAGIC, sizeof(header.magic));
+  header.version = SESSION_VERSION;
+  header.sampleRate = sampleRate;
+  fwrite(&header, sizeof(header), 1, file);
+
+  ring = std::make_unique<ByteRing>(RING_SIZE);
+
+  const Part bundle = {bundlePath, strlen(bundlePath) + 1};
+  write(kSessionBundle, &bundle, 1);
+
+  thread = std::thread(&SessionRecorder::run, this);
+
+  return true;
+}
+
+LV2_URID_Map *SessionRecorder::wrap_map(LV2_URID_Map *hostMap) noexcept {
+  if (file == nullptr)
+    return hostMap;
+
+  this->hostMap = hostMap;
+  map.handle = this;
+  map.map = map_uri;
+
+  return &map;
+}
+
+LV2_URID SessionRecorder::map_uri(LV2_URID_Map_Handle handle,
+                                  const char *uri) {
+  auto recorder = static_cast<SessionRecorder *>(handle);
+  const LV2_URID urid = recorder->hostMap->map(recorder->hostMap->handle, uri);
+
+  const Part parts[] = {{&urid, sizeof(urid)}, {uri, strlen(uri) + 1}};
+  recorder->write(kSessionUrid, parts, 2);
+
+  return urid;
+}
+
+void SessionRecorder::max_block(int32_t size) noexcept {
+  const Part part = {&size, sizeof(size)};
+  write(kSessionMaxBlock, &part, 1);
+}
+
+void SessionRecorder::block(uint32_t n_samples, const float *controls,
+                            const LV2_Atom_Sequence *events,
+                            const float *input) noexcept {
+  SessionBlock block = {};
+  block.n_samples = n_samples;
+  std::copy(controls, controls + kSessionControlCount, block.controls);
+
+  const uint32_t eventsSize =
+      (events != nullptr) ? sizeof(LV2_Atom) + events->atom.size : 0;
+
+  if (eventsSize <= MAX_EVENTS_SIZE)
+    block.eventsSize = eventsSize;
+
+  const Part parts[] = {{&block, sizeof(block)},
+                        {events, block.eventsSize},
+                        {input, n_samples * sizeof(float)}};
+  write(kSessionBlock, parts, 3);
+}
+
+void SessionRecorder::output(const float *samples,
+                             uint32_t n_samples) noexcept {
+  const Part part = {samples, n_samples * sizeof(float)};
+  write(kSessionOutput, &part, 1);
+}
+
+void SessionRecorder::response(uint32_t workType) noexcept {
+  const Part part = {&workType, sizeof(workType)};
+  write(kSessionResponse, &part, 1);
+}
+
+void SessionRecorder::restore(uint32_t flags, const char *const *paths,
+                              size_t count) {
+  if (file == nullptr)
+    return;
+
+  constexpr size_t MAX_PATHS = 8;
+  count = std::min(count, MAX_PATHS);
+
+  SessionRecord header = {kSessionRestore, sizeof(flags)};
+
+  for (size_t i = 0; i < count; ++i)
+    header.size += static_cast<uint32_t>(strlen(paths[i]) + 1);
+
+  PendingRestore pending = {0, {}};
+  pending.record.reserve(sizeof(header) + padded(header.size));
+
+  auto append = [&pending](const void *data, size_t size) {
+    auto bytes = static_cast<const uint8_t *>(data);
+    pending.record.insert(pending.record.end(), bytes, bytes + size);
+  };
+
+  append(&header, sizeof(header));
+  append(&flags, sizeof(flags));
+
+  for (size_t i = 0; i < count; ++i)
+    append(paths[i], strlen(paths[i]) + 1);
+
+  pending.record.resize(sizeof(header) + padded(header.size), 0);
+
+  // the writer thread holds the lock while it drains, so it hasn't gone
+  // past the position read here
+  std::lock_guard<std::mutex> lock(mutex);
+  pending.position = ring->written();
+  restores.push_back(std::move(pending));
+}
+
+// runs on the audio thread: all of the record or nothing
+bool SessionRecorder::write(uint32_t type, const Part *parts,
+                            size_t count) noexcept {
+  if (file == nullptr)
+    return false;
+
+  static constexpr uint8_t zeros[8] = {};
+  SessionRecord record = {type, 0};
+
+  for (size_t i = 0; i < count; ++i)
+    record.size += static_cast<uint32_t>(parts[i].size);
+
+  const size_t size = sizeof(record) + padded(record.size);
+  const size_t gapSize = sizeof(SessionRecord) + sizeof(uint64_t);
+
+  if (!ring->prepare(size + ((dropped > 0) ? gapSize : 0))) {
+    ++dropped;
+    return false;
+  }
+
+  // the replay needs to know its output checks are off from here on
+  if (dropped > 0) {
+    const SessionRecord gap = {kSessionGap, sizeof(uint64_t)};
+    ring->put(&gap, sizeof(gap));
+    ring->put(&dropped, sizeof(dropped));
+    dropped = 0;
+  }
+
+  ring->put(&record, sizeof(record));
+
+  for (size_t i = 0; i < count; ++i)
+    ring->put(parts[i].data, parts[i].size);
+
+  ring->put(zeros, padded(record.size) - record.size);
+  ring->commit();
+
+  return true;
+}
+
+// with the mutex held, or once the writer thread is gone
+void SessionRecorder::drain() {
+  for (const auto &pending : restores) {
+    drain_ring(pending.position);
+    fwrite(pending.record.data(), 1, pending.record.size(), file);
+  }
+
+  restores.clear();
+  drain_ring(SIZE_MAX);
+}
+
+// writes what the ring holds, up to position
+void SessionRecorder::drain_ring(size_t position) {
+  const uint8_t *first;
+  const uint8_t *second;
+  size_t firstSize;
+  const size_t available = std::min(ring->peek(first, firstSize, second),
+                                    position - ring->consumed());
+
+  firstSize = std::min(firstSize, available);
+  fwrite(first, 1, firstSize, file);
+  fwrite(second, 1, available - firstSize, file);
+  ring->release(available);
+}
+
+void SessionRecorder::run() {
+  std::unique_lock<std::mutex> lock(mutex);
+
+  while (!stop) {
+    wake.wait_for(lock, INTERVAL);
+    drain();
+    fflush(file);
+  }
+}
+} // namespace NAM
@@ -0,0 +1,176 @@
+#pragma once
+
+// Session capture for offline performance debugging. When the host is
+// started with NAM_SESSION set to a directory, each LV2 plugin instance
+// records everything that drives it into nam-session-<pid>-<n>.bin there:
+// every block's size, control port values, control events, input and output
+// audio, the points where worker responses were delivered, state restores
+// and block length changes. tools/nam-replay feeds the same sequence back
+// through the plugin and checks that the output is bit-exact.
+//
+// The audio thread writes records into a lock-free ring, a background thread
+// streams them to the file. Records that don't fit are dropped and the gap
+// is marked in the file, the audio thread never waits. State restores come
+// from another thread: they are queued under a lock with the ring position
+// they happened at, and the background thread puts them in at that point.
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <lv2/atom/atom.h>
+#include <lv2/urid/urid.h>
+
+#include "nam_ring.h"
+
+namespace NAM {
+static constexpr char SESSION_MAGIC[8] = {'N', 'A', 'M', 'S',
+                                          'E', 'S', 'S', '\0'};
+static constexpr uint32_t SESSION_VERSION = 2;
+
+// control input ports in the order they are recorded
+enum SessionControl {
+  kSessionInputLevel,
+  kSessionOutputLevel,
+  kSessionEnabled,
+  kSessionHardBypass,
+  kSessionModelSlot,
+  kSessionBackend,
+  kSessionLoadOnFirstUse,
+  kSessionFreewheel,
+  kSessionControlCount
+};
+
+struct SessionHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  double sampleRate;
+};
+
+// every record is a SessionRecord followed by size bytes of payload, padded
+// to 8 bytes
+enum SessionRecordType : uint32_t {
+  kSessionBundle,   // bundle path
+  kSessionUrid,     // uint32_t URID, then the URI
+  kSessionMaxBlock, // int32_t, before the first block and on changes
+  kSessionBlock,    // SessionBlock, control sequence, input samples
+  kSessionOutput,   // output samples of the last block
+  kSessionResponse, // uint32_t LV2WorkType of a delivered worker response
+  kSessionRestore,  // uint32_t flags, then the restored paths
+  kSessionGap       // uint64_t records dropped before this one
+};
+
+struct SessionRecord {
+  uint32_t type;
+  uint32_t size;
+};
+
+struct SessionBlock {
+  uint32_t n_samples;
+  uint32_t eventsSize; // the whole control sequence, atom header included
+  float controls[kSessionControlCount];
+};
+
+// flags of kSessionRestore, its paths are the model slots, then the IR path
+enum SessionRestoreFlags : uint32_t {
+  kSessionRestoreModels = 1,   // the slot paths were restored
+  kSessionRestoreIR = 2,       // the IR path was restored
+  kSessionRestoreDeferred = 4, // with load_on_first_use on
+};
+
+class SessionRecorder {
+public:
+  // enough for a few seconds of backlog at 48 kHz
+  static constexpr size_t RING_SIZE = 8 * 1024 * 1024;
+  static constexpr auto INTERVAL = std::chrono::milliseconds(20);
+  // larger control sequences are recorded as empty
+  static constexpr uint32_t MAX_EVENTS_SIZE = 64 * 1024;
+
+  SessionRecorder() = default;
+  ~SessionRecorder();
+
+  SessionRecorder(const SessionRecorder &) = delete;
+  SessionRecorder &operator=(const SessionRecorder &) = delete;
+
+  // opens the file if NAM_SESSION is set, false otherwise
+  bool start(double sampleRate, const char *bundlePath);
+
+  bool enabled() const noexcept { return file != nullptr; }
+
+  // records the URIDs the plugin maps, so the replay can map them the same
+  LV2_URID_Map *wrap_map(LV2_URID_Map *hostMap) noexcept;
+
+  // audio thread
+  void max_block(int32_t size) noexcept;
+  void block(uint32_t n_samples, const float *controls,
+             const LV2_Atom_Sequence *events, const float *input) noexcept;
+  void output(const float *samples, uint32_t n_samples) noexcept;
+  void response(uint32_t workType) noexcept;
+
+  // from restore(), which may run concurrently with the audio thread
+  void restore(uint32_t flags, const char *const *paths, size_t count);
+
+private:
+  std::unique_ptr<ByteRing> ring; // only allocated when recording
+  FILE *file = nullptr;
+  uint64_t dropped = 0;
+
+  LV2_URID_Map map = {};
+  LV2_URID_Map *hostMap = nullptr;
+
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::thread thread;
+  bool stop = false;
+
+  // a kSessionRestore record, written after the first position bytes of
+  // the ring
+  struct PendingRestore {
+    size_t position;
+    std::vector<uint8_t> record;
+  };
+
+  std::vector<PendingRestore> restores; // guarded by mutex
+
+  struct Part {
+    const void *data;
+    size_t size;
+  };
+
+  bool write(uint32_t type, const Part *parts, size_t count) noexcept;
+  void drain();
+  void drain_ring(size_t position);
+  void run();
+
+  static LV2_URID map_uri(LV2_URID_Map_Handle handle, const char *uri);
+};
+
+// records the output of the block when it goes out of scope, process() has
+// several ways out
+class SessionOutput {
+public:
+  SessionOutput(SessionRecorder &recorder, const float *samples,
+                uint32_t n_samples) noexcept
+      : recorder(recorder), samples(samples), n_samples(n_samples) {}
+
+  ~SessionOutput() {
+    if (recorder.enabled())
+      recorder.output(samples, n_samples);
+  }
+
+  SessionOutput(const SessionOutput &) = delete;
+  SessionOutput &operator=(const SessionOutput &) = delete;
+
+private:
+  SessionRecorder &recorder;
+  const float *samples;
+  uint32_t n_samples;
+};
+} // namespace NAM
@@ -0,0 +1,307 @@
+#include "nam_stats.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace NAM {
+bool read_stats_strings(const StatsSlot &slot, char *modelPath,
+                        char *architecture) noexcept {
+  for (int attempt = 0; attempt < 100; ++attempt) {
+    const uint32_t before = slot.sequence.load(std::memory_order_acquire);
+
+    if (before & 1)
+      continue;
+
+    memcpy(modelPath, slot.modelPath, StatsSlot::PATH_SIZE);
+    memcpy(architecture, slot.architecture, StatsSlot::ARCHITECTURE_SIZE);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    if (slot.sequence.load(std::memory_order_relaxed) == before) {
+      modelPath[StatsSlot::PATH_SIZE - 1] = '\0';
+      architecture[StatsSlot::ARCHITECTURE_SIZE - 1] = '\0';
+      return true;
+    }
+  }
+
+  return false;
+}
+
+#ifndef _WIN32
+namespace {
+// clock ticks from boot to the start of the process, 0 if unknown
+uint64_t process_start_time(int32_t pid) noexcept {
+#ifdef __linux__
+  char path[32];
+  snprintf(path, sizeof(path), "/proc/%d/stat", static_cast<int>(pid));
+
+  FILE *file = fopen(path, "r");
+
+  if (file == nullptr)
+    return 0;
+
+  char buffer[1024];
+  const size_t size = fread(buffer, 1, sizeof(buffer) - 1, file);
+  fclose(file);
+  buffer[size] = '\0';
+
+  // the command name in parentheses may hold anything, the fields after it
+  // are the state (3rd) up to the start time (22nd)
+  const char *fields = strrchr(buffer, ')');
+  unsigned long long start = 0;
+
+  if (fields == nullptr ||
+      sscanf(fields + 1,
+             "%*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s"
+             " %*s %*s %*s %llu",
+             &start) != 1)
+    return 0;
+
+  return start;
+#else
+  (void)pid;
+  return 0;
+#endif
+}
+
+// inode of this process's PID namespace, 0 if unknown
+uint64_t pid_namespace() noexcept {
+#ifdef __linux__
+  struct stat info;
+
+  if (stat("/proc/self/ns/pid", &info) == 0)
+    return info.st_ino;
+#endif
+  return 0;
+}
+} // namespace
+
+void stats_segment_name(char *name, size_t size) noexcept {
+  snprintf(name, size, "%s%u", NAM_STATS_PREFIX,
+           static_cast<unsigned>(getuid()));
+}
+
+bool stats_owner_alive(const StatsSlot &slot, int32_t owner) noexcept {
+  static const uint64_t ownNamespace = pid_namespace();
+
+  const uint64_t start = slot.ownerStart.load(std::memory_order_relaxed);
+  const uint64_t ns = slot.ownerNamespace.load(std::memory_order_relaxed);
+
+  if (ns != 0 && ownNamespace != 0 && ns != ownNamespace)
+    return true;
+
+  // EPERM means it exists
+  if (kill(static_cast<pid_t>(owner), 0) != 0 && errno == ESRCH)
+    return false;
+
+  // a later process that got the same pid
+  const uint64_t current = process_start_time(owner);
+
+  return start == 0 || current == 0 || current == start;
+}
+#endif
+
+#if defined(NAM_STATS) && !defined(_WIN32)
+namespace {
+// time constant of the smoothed DSP load
+constexpr double LOAD_TIME_S = 0.5;
+// how long the peak load is held
+constexpr double PEAK_WINDOW_S = 1.0;
+
+// keeps the end of strings that don't fit, for paths the file name matters
+void copy_tail(char *dest, const char *src, size_t size) noexcept {
+  const size_t length = strlen(src);
+  const size_t skip = (length >= size) ? length - (size - 1) : 0;
+
+  memcpy(dest, src + skip, length - skip);
+  dest[length - skip] = '\0';
+}
+} // namespace
+
+InstanceStats::InstanceStats() {
+  char name[64];
+  stats_segment_name(name, sizeof(name));
+
+  const int fd = shm_open(name, O_RDWR | O_CREAT, 0600);
+
+  if (fd < 0)
+    return;
+
+  struct stat info;
+
+  if (fstat(fd, &info) != 0 ||
+      (static_cast<size_t>(info.st_size) < sizeof(StatsPage) &&
+       ftruncate(fd, sizeof(StatsPage)) != 0)) {
+    close(fd);
+    return;
+  }
+
+  void *memory = mmap(nullptr, sizeof(StatsPage), PROT_READ | PROT_WRITE,
+                      MAP_SHARED, fd, 0);
+  close(fd);
+
+  if (memory == MAP_FAILED)
+    return;
+
+  page = static_cast<StatsPage *>(memory);
+
+  // a new segment is zero filled; racing creators write the same values
+  if (page->magic.load(std::memory_order_acquire) == 0) {
+    page->version = StatsPage::VERSION;
+    page->numSlots = StatsPage::NUM_SLOTS;
+    page->slotSize = sizeof(StatsSlot);
+    page->magic.store(StatsPage::MAGIC, std::memory_order_release);
+  }
+
+  // left by an incompatible build, keep out of it
+  if (page->magic.load(std::memory_order_acquire) != StatsPage::MAGIC ||
+      page->version != StatsPage::VERSION ||
+      page->numSlots != StatsPage::NUM_SLOTS ||
+      page->slotSize != sizeof(StatsSlot)) {
+    munmap(page, sizeof(StatsPage));
+    page = nullptr;
+    return;
+  }
+
+  const int32_t pid = static_cast<int32_t>(getpid());
+
+  for (StatsSlot &candidate : page->slots) {
+    int32_t owner = candidate.owner.load(std::memory_order_acquire);
+
+    if (owner < 0 || (owner != 0 && stats_owner_alive(candidate, owner)))
+      continue;
+
+    // claimed as -1 until the owner's identity is written, so nobody checks
+    // the new pid against the identity of the old owner
+    if (candidate.owner.compare_exchange_strong(owner, -1,
+                                                std::memory_order_acq_rel)) {
+      candidate.ownerStart.store(process_start_time(pid),
+                                 std::memory_order_relaxed);
+      candidate.ownerNamespace.store(pid_namespace(),
+                                     std::memory_order_relaxed);
+      candidate.owner.store(pid, std::memory_order_release);
+      slot = &candidate;
+      break;
+    }
+  }
+
+  if (slot == nullptr) {
+    munmap(page, sizeof(StatsPage));
+    page = nullptr;
+    return;
+  }
+
+  set_model("", "");
+
+  slot->sampleRate.store(0, std::memory_order_relaxed);
+  slot->blockSize.store(0, std::memory_order_relaxed);
+  slot->dspLoad.store(0, std::memory_order_relaxed);
+  slot->peakLoad.store(0, std::memory_order_relaxed);
+  slot->bypassed.store(0, std::memory_order_relaxed);
+  slot->loads.store(0, std::memory_order_relaxed);
+  slot->lastLoadUs.store(0, std::memory_order_relaxed);
+  slot->maxLoadUs.store(0, std::memory_order_relaxed);
+  slot->blocks.store(0, std::memory_order_relaxed);
+  slot->deadlineMisses.store(0, std::memory_order_relaxed);
+}
+
+InstanceStats::~InstanceStats() {
+  if (page == nullptr)
+    return;
+
+  slot->owner.store(0, std::memory_order_release);
+  munmap(page, sizeof(StatsPage));
+}
+
+void InstanceStats::set_model(const char *path,
+                              const char *architecture) noexcept {
+  if (slot == nullptr)
+    return;
+
+  const uint32_t sequence = slot->sequence.load(std::memory_order_relaxed);
+
+  // odd: another thread is in the middle of writing them
+  assert((sequence & 1) == 0);
+
+  slot->sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  copy_tail(slot->modelPath, path, StatsSlot::PATH_SIZE);
+  copy_tail(slot->architecture, architecture, StatsSlot::ARCHITECTURE_SIZE);
+
+  slot->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+void InstanceStats::block(uint32_t n_samples, double rate,
+                          uint64_t elapsedNs) noexcept {
+  if (slot == nullptr || n_samples == 0 || rate <= 0.0)
+    return;
+
+  const double seconds = n_samples / rate;
+  const float blockLoad = static_cast<float>(elapsedNs * 1e-9 / seconds);
+  const uint32_t blockPermille =
+      static_cast<uint32_t>(std::min(blockLoad, 1e6f) * 1000.0f + 0.5f);
+
+  load += static_cast<float>(1.0 - std::exp(-seconds / LOAD_TIME_S)) *
+          (blockLoad - load);
+
+  windowPeak = std::max(windowPeak, blockPermille);
+  windowSeconds += seconds;
+
+  if (windowSeconds >= PEAK_WINDOW_S) {
+    slot->peakLoad.store(windowPeak, std::memory_order_relaxed);
+    windowPeak = 0;
+    windowSeconds = 0.0;
+  }
+
+  // single writer: plain increments, no locked read-modify-write
+  slot->dspLoad.store(static_cast<uint32_t>(load * 1000.0f + 0.5f),
+                      std::memory_order_relaxed);
+  slot->sampleRate.store(static_cast<uint32_t>(rate),
+                         std::memory_order_relaxed);
+  slot->blockSize.store(n_samples, std::memory_order_relaxed);
+  slot->blocks.store(slot->blocks.load(std::memory_order_relaxed) + 1,
+                     std::memory_order_relaxed);
+
+  if (blockLoad > 1.0f) {
+    slot->deadlineMisses.store(
+        slot->deadlineMisses.load(std::memory_order_relaxed) + 1,
+        std::memory_order_relaxed);
+  }
+}
+
+void InstanceStats::model_loaded(double ms) noexcept {
+  if (slot == nullptr)
+    return;
+
+  const uint32_t us = static_cast<uint32_t>(std::max(0.0, ms * 1000.0));
+
+  slot->loads.store(slot->loads.load(std::memory_order_relaxed) + 1,
+                    std::memory_order_relaxed);
+  slot->lastLoadUs.store(us, std::memory_order_relaxed);
+  slot->maxLoadUs.store(
+      std::max(us, slot->maxLoadUs.load(std::memory_order_relaxed)),
+      std::memory_order_relaxed);
+}
+
+uint64_t InstanceStats::now() noexcept {
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch())
+          .count());
+}
+#endif
+} // namespace NAM
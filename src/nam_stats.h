@@ -0,0 +1,150 @@
+#pragma once
+
+// Per-instance statistics in a POSIX shared-memory segment, for watching many
+// instances across host processes with tools/nam-top. Each user has a
+// segment of their own, readable by nobody else. Every instance claims a
+// slot in it when it is created and gives it back when destroyed; slots left
+// behind by a crashed process are reclaimed by later instances.
+//
+// The audio thread only does relaxed atomic stores into its own slot, there
+// is no IPC or locking on the audio path. Compiled in with NAM_STATS (cmake
+// -DSTATS=ON, the default) on POSIX systems, compiled to nothing otherwise.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#define NAM_STATS_PREFIX "/nam-stats-" // followed by the uid
+
+namespace NAM {
+// one per instance; aligned so instances on different threads of one process
+// don't share cache lines
+struct alignas(64) StatsSlot {
+  static constexpr size_t PATH_SIZE = 256;
+  static constexpr size_t ARCHITECTURE_SIZE = 32;
+
+  std::atomic<int32_t> owner; // pid, 0 if free, -1 while being claimed
+  // tell the owner from a later process with the same pid, and from one in
+  // another PID namespace (containers, Flatpak); 0 if unknown
+  std::atomic<uint64_t> ownerStart;
+  std::atomic<uint64_t> ownerNamespace;
+  // seqlock over the strings, odd while they are written
+  std::atomic<uint32_t> sequence;
+  char modelPath[PATH_SIZE];
+  char architecture[ARCHITECTURE_SIZE];
+
+  std::atomic<uint32_t> sampleRate;
+  std::atomic<uint32_t> blockSize; // of the last block
+  std::atomic<uint32_t> dspLoad;   // per mille of the block period, smoothed
+  std::atomic<uint32_t> peakLoad;  // per mille, highest in the last second
+  std::atomic<uint32_t> bypassed;
+  std::atomic<uint32_t> loads;      // models loaded
+  std::atomic<uint32_t> lastLoadUs; // time to load the last model
+  std::atomic<uint32_t> maxLoadUs;
+  std::atomic<uint64_t> blocks;
+  std::atomic<uint64_t> deadlineMisses; // blocks that took longer than their
+                                        // own duration
+};
+
+struct StatsPage {
+  static constexpr uint32_t MAGIC = 0x534d414e; // "NAMS"
+  static constexpr uint32_t VERSION = 2;
+  static constexpr uint32_t NUM_SLOTS = 128;
+
+  std::atomic<uint32_t> magic;
+  uint32_t version;
+  uint32_t numSlots;
+  uint32_t slotSize;
+  StatsSlot slots[NUM_SLOTS];
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "stats are shared between processes");
+
+// reads the strings of a slot written by another process, false if they
+// kept changing
+bool read_stats_strings(const StatsSlot &slot, char *modelPath,
+                        char *architecture) noexcept;
+
+#ifndef _WIN32
+// name of the current user's segment
+void stats_segment_name(char *name, size_t size) noexcept;
+
+// false if the process owning a slot is gone. Owners in another PID
+// namespace can't be looked up from this one, and count as alive.
+bool stats_owner_alive(const StatsSlot &slot, int32_t owner) noexcept;
+#endif
+
+#if defined(NAM_STATS) && !defined(_WIN32)
+class InstanceStats {
+public:
+  // claims a slot, stays disabled if the segment can't be used
+  InstanceStats();
+  ~InstanceStats();
+
+  InstanceStats(const InstanceStats &) = delete;
+  InstanceStats &operator=(const InstanceStats &) = delete;
+
+  bool enabled() const noexcept { return slot != nullptr; }
+
+  // the seqlock's only writer: one thread at a time, the audio thread in
+  // the LV2 plugin, where restored paths reach it through work_response()
+  void set_model(const char *path, const char *architecture) noexcept;
+
+  // audio thread
+  void set_bypassed(bool bypassed) noexcept {
+    if (slot != nullptr)
+      slot->bypassed.store(bypassed, std::memory_order_relaxed);
+  }
+
+  void block(uint32_t n_samples, double rate, uint64_t elapsedNs) noexcept;
+
+  // worker
+  void model_loaded(double ms) noexcept;
+
+  static uint64_t now() noexcept;
+
+private:
+  StatsPage *page = nullptr;
+  StatsSlot *slot = nullptr;
+
+  float load = 0.0f;
+  uint32_t windowPeak = 0;
+  double windowSeconds = 0.0;
+};
+#else
+class InstanceStats {
+public:
+  bool enabled() const noexcept { return false; }
+
+  void set_model(const char *, const char *) noexcept {}
+  void set_bypassed(bool) noexcept {}
+  void block(uint32_t, double, uint64_t) noexcept {}
+  void model_loaded(double) noexcept {}
+
+  static uint64_t now() noexcept { return 0; }
+};
+#endif
+
+// times one block, from construction to destruction
+class StatsBlock {
+public:
+  StatsBlock(InstanceStats &stats, uint32_t n_samples, double rate) noexcept
+      : stats(stats), n_samples(n_samples), rate(rate),
+        start(stats.enabled() ? InstanceStats::now() : 0) {}
+
+  ~StatsBlock() {
+    if (stats.enabled())
+      stats.block(n_samples, rate, InstanceStats::now() - start);
+  }
+
+  StatsBlock(const StatsBlock &) = delete;
+  StatsBlock &operator=(const StatsBlock &) = delete;
+
+private:
+  InstanceStats &stats;
+  uint32_t n_samples;
+  double rate;
+  uint64_t start;
+};
+} // namespace NAM
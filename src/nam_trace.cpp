@@ -0,0 +1,212 @@
+#include "nam_trace.h"
+
+#ifdef NAM_TRACE
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+namespace NAM {
+// Drains every instance's rings into one file per process. The file is kept
+// valid JSON after each drain, so a capture cut short by a crash still loads.
+class TraceWriter {
+public:
+  static constexpr auto INTERVAL = std::chrono::milliseconds(100);
+
+  static TraceWriter &get() {
+    static TraceWriter writer;
+    return writer;
+  }
+
+  // false if tracing is off for this process
+  bool add(Tracer *tracer) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (!open())
+      return false;
+
+    tracer->id = ++lastId;
+    tracers.push_back(tracer);
+
+    for (int thread = 0; thread < Tracer::kThreadCount; ++thread) {
+      char event[160];
+      snprintf(event, sizeof(event),
+               "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,"
+               "\"args\":{\"name\":\"instance %u %s\"}}",
+               pid, tid(*tracer, thread), tracer->id,
+               (thread == Tracer::kThreadAudio) ? "audio" : "worker");
+      write(event);
+    }
+
+    finish();
+
+    if (!thread.joinable()) {
+      stop = false;
+      thread = std::thread(&TraceWriter::run, this);
+    }
+
+    return true;
+  }
+
+  void remove(Tracer *tracer) {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    drain(*tracer);
+    finish();
+    tracers.erase(std::remove(tracers.begin(), tracers.end(), tracer),
+                  tracers.end());
+
+    if (tracers.empty() && thread.joinable()) {
+      stop = true;
+      lock.unlock();
+      wake.notify_all();
+      thread.join();
+    }
+  }
+
+private:
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::thread thread;
+  bool stop = false;
+  std::vector<Tracer *> tracers;
+  uint32_t lastId = 0;
+
+  FILE *file = nullptr;
+  bool failed = false;
+  bool first = true;
+  bool unfinished = false; // events written since the last finish()
+  int pid = 0;
+
+  ~TraceWriter() {
+    if (file != nullptr)
+      fclose(file);
+  }
+
+  bool open() {
+    if (file != nullptr)
+      return true;
+    if (failed)
+      return false;
+
+    const char *dir = getenv("NAM_TRACE");
+
+    if (dir == nullptr || dir[0] == '\0') {
+      failed = true;
+      return false;
+    }
+
+    pid = static_cast<int>(getpid());
+
+    const std::string path =
+        std::string(dir) + "/nam-trace-" + std::to_string(pid) + ".json";
+    file = fopen(path.c_str(), "w");
+
+    if (file == nullptr) {
+      fprintf(stderr, "nam: cannot write trace to %s\n", path.c_str());
+      failed = true;
+      return false;
+    }
+
+    fputs("[", file);
+    unfinished = true;
+    finish();
+
+    return true;
+  }
+
+  static unsigned tid(const Tracer &tracer, int thread) {
+    return tracer.id * Tracer::kThreadCount + static_cast<unsigned>(thread);
+  }
+
+  // buffered, starting where finish() left off
+  void write(const char *event) {
+    fputs(first ? "\n" : ",\n", file);
+    fputs(event, file);
+    first = false;
+    unfinished = true;
+  }
+
+  // closes the array, so the file is valid JSON between drains, and steps
+  // back for the next events to overwrite the closing bracket: one seek per
+  // drain rather than per event
+  void finish() {
+    if (!unfinished)
+      return;
+
+    fputs("\n]\n", file);
+    fflush(file);
+    fseek(file, -3, SEEK_CUR);
+    unfinished = false;
+  }
+
+  void drain(Tracer &tracer) {
+    for (int thread = 0; thread < Tracer::kThreadCount; ++thread) {
+      TraceRing &ring = tracer.rings[thread];
+      TraceEvent event;
+      char text[192];
+
+      while (ring.pop(event)) {
+        snprintf(text, sizeof(text),
+                 "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%u,"
+                 "\"ts\":%.3f,\"dur\":%.3f}",
+                 event.name, pid, tid(tracer, thread), event.start / 1000.0,
+                 (event.end - event.start) / 1000.0);
+        write(text);
+      }
+
+      // an instant event marks where the ring overflowed
+      if (const uint64_t dropped = ring.take_dropped()) {
+        snprintf(text, sizeof(text),
+                 "{\"name\":\"dropped %llu\",\"ph\":\"i\",\"s\":\"t\","
+                 "\"pid\":%d,\"tid\":%u,\"ts\":%.3f}",
+                 static_cast<unsigned long long>(dropped), pid,
+                 tid(tracer, thread), Tracer::now() / 1000.0);
+        write(text);
+      }
+    }
+  }
+
+  void run() {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (!stop) {
+      wake.wait_for(lock, INTERVAL);
+
+      for (Tracer *tracer : tracers)
+        drain(*tracer);
+
+      finish();
+    }
+  }
+};
+
+Tracer::Tracer() { active = TraceWriter::get().add(this); }
+
+Tracer::~Tracer() {
+  if (active)
+    TraceWriter::get().remove(this);
+}
+
+uint64_t Tracer::now() noexcept {
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch())
+          .count());
+}
+} // namespace NAM
+
+#endif
@@ -0,0 +1,173 @@
+#pragma once
+
+// Trace points for the stages of process() and the worker, compiled in with
+// NAM_TRACE (cmake -DTRACE=ON) and otherwise compiled to nothing. Capture is
+// started by setting NAM_TRACE to a directory: each host process then writes
+// nam-trace-<pid>.json there, in Chrome trace format, for chrome://tracing or
+// ui.perfetto.dev. Every instance shows up as an audio and a worker track.
+//
+// The audio thread only writes into a per-instance lock-free ring; a
+// background thread drains all rings into the file.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace NAM {
+#ifdef NAM_TRACE
+struct TraceEvent {
+  const char *name; // string literal
+  uint64_t start;   // ns, steady clock
+  uint64_t end;
+};
+
+// single producer, single consumer; drops events when full
+class TraceRing {
+public:
+  static constexpr size_t SIZE = 8192; // power of two
+
+  bool push(const TraceEvent &event) noexcept {
+    const size_t head = this->head.load(std::memory_order_relaxed);
+
+    if (head - tail.load(std::memory_order_acquire) == SIZE) {
+      dropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+
+    events[head & (SIZE - 1)] = event;
+    this->head.store(head + 1, std::memory_order_release);
+
+    return true;
+  }
+
+  bool pop(TraceEvent &event) noexcept {
+    const size_t tail = this->tail.load(std::memory_order_relaxed);
+
+    if (tail == head.load(std::memory_order_acquire))
+      return false;
+
+    event = events[tail & (SIZE - 1)];
+    this->tail.store(tail + 1, std::memory_order_release);
+
+    return true;
+  }
+
+  uint64_t take_dropped() noexcept {
+    return dropped.exchange(0, std::memory_order_relaxed);
+  }
+
+private:
+  TraceEvent events[SIZE];
+  std::atomic<size_t> head{0};
+  std::atomic<size_t> tail{0};
+  std::atomic<uint64_t> dropped{0};
+};
+
+class Tracer {
+public:
+  enum Thread { kThreadAudio, kThreadWorker, kThreadCount };
+
+  // registers with the background writer if NAM_TRACE is set
+  Tracer();
+  ~Tracer();
+
+  Tracer(const Tracer &) = delete;
+  Tracer &operator=(const Tracer &) = delete;
+
+  bool enabled() const noexcept { return active; }
+
+  void record(Thread thread, const char *name, uint64_t start,
+              uint64_t end) noexcept {
+    rings[thread].push({name, start, end});
+  }
+
+  static uint64_t now() noexcept;
+
+private:
+  friend class TraceWriter;
+
+  bool active = false;
+  uint32_t id = 0;
+  TraceRing rings[kThreadCount];
+};
+
+// one span for the lifetime of the object
+class TraceScope {
+public:
+  TraceScope(Tracer &tracer, Tracer::Thread thread, const char *name) noexcept
+      : tracer(tracer), thread(thread), name(name),
+        start(tracer.enabled() ? Tracer::now() : 0) {}
+
+  ~TraceScope() {
+    if (start != 0)
+      tracer.record(thread, name, start, Tracer::now());
+  }
+
+  TraceScope(const TraceScope &) = delete;
+  TraceScope &operator=(const TraceScope &) = delete;
+
+private:
+  Tracer &tracer;
+  Tracer::Thread thread;
+  const char *name;
+  uint64_t start;
+};
+
+// consecutive spans: next() ends the current stage and starts another, so
+// stages can be marked without adding scopes to the traced code
+class TraceStages {
+public:
+  TraceStages(Tracer &tracer, Tracer::Thread thread) noexcept
+      : tracer(tracer), thread(thread) {}
+
+  ~TraceStages() { end(); }
+
+  void next(const char *stage) noexcept {
+    if (!tracer.enabled())
+      return;
+
+    const uint64_t time = Tracer::now();
+
+    if (name != nullptr)
+      tracer.record(thread, name, start, time);
+
+    name = stage;
+    start = time;
+  }
+
+  void end() noexcept {
+    if (name != nullptr)
+      tracer.record(thread, name, start, Tracer::now());
+
+    name = nullptr;
+  }
+
+  TraceStages(const TraceStages &) = delete;
+  TraceStages &operator=(const TraceStages &) = delete;
+
+private:
+  Tracer &tracer;
+  Tracer::Thread thread;
+  const char *name = nullptr;
+  uint64_t start = 0;
+};
+#else
+class Tracer {
+public:
+  enum Thread { kThreadAudio, kThreadWorker, kThreadCount };
+};
+
+class TraceScope {
+public:
+  TraceScope(Tracer &, Tracer::Thread, const char *) noexcept {}
+};
+
+class TraceStages {
+public:
+  TraceStages(Tracer &, Tracer::Thread) noexcept {}
+
+  void next(const char *) noexcept {}
+  void end() noexcept {}
+};
+#endif
+} // namespace NAM
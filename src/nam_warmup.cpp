@@ -0,0 +1,90 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "nam_warmup.h"
+
+namespace NAM {
+namespace {
+void process_silence(NeuralAudio::NeuralModel *model,
+                     std::vector<float> &buffer, size_t samples) {
+  const size_t blockSize = buffer.size();
+
+  for (size_t done = 0; done < samples; done += blockSize) {
+    const size_t count = std::min(blockSize, samples - done);
+
+    std::fill(buffer.begin(), buffer.end(), 0.0f);
+    model->Process(buffer.data(), buffer.data(), count);
+  }
+}
+} // namespace
+
+// Excites the model with a short burst and counts the samples until its
+// output returns to the settled (silence) value, within a tolerance relative
+// to the model's response to the burst. What is left after that is 40 dB
+// below the response, under the signal the model plays while it fades in
+// from the dry one.
+size_t Warmup::measure(NeuralAudio::NeuralModel *model, double rate,
+                       size_t blockSize) {
+  static constexpr size_t BURST_TIME_MS = 5;
+  static constexpr float BURST_LEVEL = 0.1f;
+  static constexpr float RELATIVE_TOLERANCE = 0.01f;
+  static constexpr float MIN_TOLERANCE = 1e-6f;
+
+  const size_t minSamples = static_cast<size_t>((MIN_TIME_MS / 1000.0) * rate);
+  const size_t maxSamples = static_cast<size_t>((MAX_TIME_MS / 1000.0) * rate);
+  const size_t burstSamples =
+      static_cast<size_t>((BURST_TIME_MS / 1000.0) * rate);
+
+  if (model == nullptr || blockSize == 0)
+    return maxSamples;
+
+  std::vector<float> buffer(blockSize);
+
+  process_silence(model, buffer, maxSamples);
+
+  std::fill(buffer.begin(), buffer.end(), 0.0f);
+  model->Process(buffer.data(), buffer.data(), 1);
+  const float settled = buffer[0];
+
+  // deterministic noise burst
+  uint32_t seed = 0x12345678;
+  float response = 0.0f;
+
+  for (size_t done = 0; done < burstSamples; done += blockSize) {
+    const size_t count = std::min(blockSize, burstSamples - done);
+
+    for (size_t i = 0; i < count; ++i) {
+      seed = seed * 1664525u + 1013904223u;
+      buffer[i] =
+          BURST_LEVEL * (static_cast<float>(seed >> 8) / 8388608.0f - 1.0f);
+    }
+
+    model->Process(buffer.data(), buffer.data(), count);
+
+    for (size_t i = 0; i < count; ++i)
+      response = std::max(response, std::abs(buffer[i] - settled));
+  }
+
+  const float tolerance =
+      std::max(RELATIVE_TOLERANCE * response, MIN_TOLERANCE);
+
+  // samples until the last one still audibly influenced by the burst
+  size_t influenced = 0;
+
+  for (size_t done = 0; done < maxSamples; done += blockSize) {
+    const size_t count = std::min(blockSize, maxSamples - done);
+
+    std::fill(buffer.begin(), buffer.begin() + count, 0.0f);
+    model->Process(buffer.data(), buffer.data(), count);
+
+    for (size_t i = 0; i < count; ++i) {
+      if (std::abs(buffer[i] - settled) > tolerance)
+        influenced = done + i + 1;
+    }
+  }
+
+  // a model still moving at the end is clamped to the maximum
+  return std::clamp(influenced, minSamples, maxSamples);
+}
+} // namespace NAM
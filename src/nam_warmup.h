@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+
+#include <NeuralAudio/NeuralModel.h>
+
+namespace NAM {
+// How long a model takes to forget its input, which is how long it needs to
+// warm up after its state went stale: the receptive field for WaveNets and
+// the decay time for LSTMs. Measured when a model is loaded, on non-RT
+// threads only.
+class Warmup {
+public:
+  static constexpr size_t MIN_TIME_MS = 1;
+  static constexpr size_t MAX_TIME_MS = 250;
+
+  // the warmup used before it was measured, which no bundled model exceeds
+  static constexpr size_t FIXED_TIME_MS = 40;
+
+  // in samples at rate, leaves the model settled
+  static size_t measure(NeuralAudio::NeuralModel *model, double rate,
+                        size_t blockSize);
+};
+} // namespace NAM
@@ -0,0 +1,216 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include "nam_wav.h"
+
+namespace NAM {
+namespace {
+enum WavFormat : uint16_t {
+  kWavFormatPCM = 1,
+  kWavFormatFloat = 3,
+  kWavFormatExtensible = 0xFFFE
+};
+
+void put_u16(uint8_t *p, uint16_t value) {
+  p[0] = static_cast<uint8_t>(value);
+  p[1] = static_cast<uint8_t>(value >> 8);
+}
+
+void put_u32(uint8_t *p, uint32_t value) {
+  for (int i = 0; i < 4; ++i)
+    p[i] = static_cast<uint8_t>(value >> (8 * i));
+}
+
+uint16_t read_u16(const uint8_t *p) {
+  return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+uint32_t read_u32(const uint8_t *p) {
+  return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+         (static_cast<uint32_t>(p[2]) << 16) |
+         (static_cast<uint32_t>(p[3]) << 24);
+}
+
+float decode_sample(const uint8_t *p, uint16_t format, uint16_t bits) {
+  if (format == kWavFormatFloat) {
+    if (bits == 32) {
+      float value;
+      uint32_t raw = read_u32(p);
+      memcpy(&value, &raw, sizeof(value));
+      return value;
+    }
+
+    double value;
+    uint64_t raw = static_cast<uint64_t>(read_u32(p)) |
+                   (static_cast<uint64_t>(read_u32(p + 4)) << 32);
+    memcpy(&value, &raw, sizeof(value));
+    return static_cast<float>(value);
+  }
+
+  switch (bits) {
+  case 16:
+    return static_cast<int16_t>(read_u16(p)) / 32768.0f;
+  case 24: {
+    int32_t value = (p[0] << 8) | (p[1] << 16) | (p[2] << 24);
+    return (value >> 8) / 8388608.0f;
+  }
+  case 32:
+    return static_cast<int32_t>(read_u32(p)) / 2147483648.0f;
+  }
+
+  return 0.0f;
+}
+} // namespace
+
+bool read_wav_file(const char *path, std::vector<float> &samples,
+                   double &sampleRate) {
+  std::ifstream file(path, std::ios::binary);
+
+  if (!file)
+    return false;
+
+  const std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)),
+                                  std::istreambuf_iterator<char>());
+
+  if (data.size() < 12 || memcmp(data.data(), "RIFF", 4) != 0 ||
+      memcmp(data.data() + 8, "WAVE", 4) != 0)
+    return false;
+
+  uint16_t format = 0;
+  uint16_t channels = 0;
+  uint16_t bits = 0;
+  uint32_t rate = 0;
+  const uint8_t *pcm = nullptr;
+  size_t pcmSize = 0;
+
+  size_t pos = 12;
+
+  while (pos + 8 <= data.size()) {
+    const uint8_t *chunk = data.data() + pos;
+    const size_t chunkSize =
+        std::min<size_t>(read_u32(chunk + 4), data.size() - pos - 8);
+
+    if (memcmp(chunk, "fmt ", 4) == 0 && chunkSize >= 16) {
+      format = read_u16(chunk + 8);
+      channels = read_u16(chunk + 10);
+      rate = read_u32(chunk + 12);
+      bits = read_u16(chunk + 22);
+
+      // WAVE_FORMAT_EXTENSIBLE keeps the real format in the sub-format GUID
+      if (format == kWavFormatExtensible && chunkSize >= 26)
+        format = read_u16(chunk + 32);
+    } else if (memcmp(chunk, "data", 4) == 0) {
+      pcm = chunk + 8;
+      pcmSize = chunkSize;
+    }
+
+    // chunks are padded to an even size
+    pos += 8 + chunkSize + (chunkSize & 1);
+  }
+
+  const bool supported =
+      (format == kWavFormatPCM && (bits == 16 || bits == 24 || bits == 32)) ||
+      (format == kWavFormatFloat && (bits == 32 || bits == 64));
+
+  if (!supported || channels == 0 || rate == 0 || pcm == nullptr)
+    return false;
+
+  const size_t frameSize = static_cast<size_t>(channels) * (bits / 8);
+  const size_t frames = pcmSize / frameSize;
+
+  samples.resize(frames);
+
+  for (size_t i = 0; i < frames; ++i)
+    samples[i] = decode_sample(pcm + i * frameSize, format, bits);
+
+  sampleRate = rate;
+
+  return true;
+}
+
+bool WavWriter::open(const char *path, double sampleRate) {
+  close();
+
+  file = fopen(path, "wb");
+
+  if (file == nullptr)
+    return false;
+
+  buffer.resize(BUFFER_SIZE);
+  setvbuf(file, buffer.data(), _IOFBF, buffer.size());
+
+  frames = 0;
+  this->sampleRate = static_cast<uint32_t>(sampleRate + 0.5);
+
+  return write_header();
+}
+
+bool WavWriter::write(const float *samples, size_t count) {
+  if (file == nullptr)
+    return false;
+
+  uint8_t bytes[4096];
+  size_t done = 0;
+
+  // little endian, whatever the host
+  while (done < count) {
+    const size_t chunk = std::min(count - done, sizeof(bytes) / 4);
+
+    for (size_t i = 0; i < chunk; ++i) {
+      uint32_t raw;
+      memcpy(&raw, &samples[done + i], sizeof(raw));
+      put_u32(&bytes[4 * i], raw);
+    }
+
+    if (fwrite(bytes, 4, chunk, file) != chunk)
+      return false;
+
+    done += chunk;
+  }
+
+  frames += count;
+
+  return true;
+}
+
+bool WavWriter::close() {
+  if (file == nullptr)
+    return true;
+
+  const bool ok = write_header() && fclose(file) == 0;
+  file = nullptr;
+
+  return ok;
+}
+
+bool WavWriter::write_header() {
+  // RIFF sizes are 32 bit, a longer take keeps the maximum
+  const uint64_t dataSize = std::min<uint64_t>(frames * 4, 0xFFFFFFFFu - 36);
+  uint8_t header[44];
+
+  memcpy(header, "RIFF", 4);
+  put_u32(header + 4, static_cast<uint32_t>(36 + dataSize));
+  memcpy(header + 8, "WAVEfmt ", 8);
+  put_u32(header + 16, 16);
+  put_u16(header + 20, kWavFormatFloat);
+  put_u16(header + 22, 1);
+  put_u32(header + 24, sampleRate);
+  put_u32(header + 28, sampleRate * 4);
+  put_u16(header + 32, 4);
+  put_u16(header + 34, 32);
+  memcpy(header + 36, "data", 4);
+  put_u32(header + 40, static_cast<uint32_t>(dataSize));
+
+  const long position = ftell(file);
+
+  if (position > 0 && fseek(file, 0, SEEK_SET) != 0)
+    return false;
+
+  const bool ok = fwrite(header, sizeof(header), 1, file) == 1;
+
+  return ok && (position <= 0 || fseek(file, position, SEEK_SET) == 0);
+}
+} // namespace NAM
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+namespace NAM {
+// Reads a RIFF/WAVE file (16/24/32 bit PCM or 32/64 bit float) and returns
+// its first channel as floats. Runs on non-RT threads only.
+bool read_wav_file(const char *path, std::vector<float> &samples,
+                   double &sampleRate);
+
+// Writes a mono 32 bit float WAVE file through a large stdio buffer. The
+// sizes in the header are filled in by close(). Runs on non-RT threads only.
+class WavWriter {
+public:
+  static constexpr size_t BUFFER_SIZE = 1 << 20;
+
+  WavWriter() = default;
+  ~WavWriter() { close(); }
+
+  WavWriter(const WavWriter &) = delete;
+  WavWriter &operator=(const WavWriter &) = delete;
+
+  bool open(const char *path, double sampleRate);
+  bool write(const float *samples, size_t count);
+  bool close();
+
+  bool is_open() const { return file != nullptr; }
+
+private:
+  FILE *file = nullptr;
+  std::vector<char> buffer;
+  uint64_t frames = 0;
+  uint32_t sampleRate = 0;
+
+  bool write_header();
+};
+} // namespace NAM
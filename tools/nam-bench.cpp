@@ -0,0 +1,332 @@
+// Benchmarks model loading and processing on the files in models/
+//
+// usage: nam-bench [-b block_size] [-s seconds] [-k kernel_dir] [-f] [-c]
+//                  [model ...]
+//
+// With -k, models that have a kernel generated by nam2cpp in kernel_dir are
+// also timed through the kernel, next to the generic model. With -f, the
+// first model is also timed at 16-64 frame blocks with the floating point
+// environment saved, set and restored around every block, and with the
+// denormal flags set once per thread as the plugins do.
+//
+// With -c, nothing is timed: each model is checked instead, and the exit
+// status is non-zero if any check failed. The measured warmup must not exceed
+// the fixed one it replaced, and with -k, a model's kernel must produce the
+// same output and level adjustments as the generic model, within
+// KERNEL_TOLERANCE.
+
+#include <algorithm>
+#include <cfenv>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <NeuralAudio/NeuralModel.h>
+
+#include "nam_denormals.h"
+#include "nam_kernel_model.h"
+#include "nam_model_file.h"
+#include "nam_warmup.h"
+
+namespace {
+constexpr int LOAD_RUNS = 9;
+constexpr double SAMPLE_RATE = 48000.0;
+
+// largest difference between kernel and generic output, -60 dBFS, which
+// leaves room for the approximate tanh of NAM_KERNEL_FAST_TANH kernels
+constexpr float KERNEL_TOLERANCE = 1e-3f;
+
+using Clock = std::chrono::steady_clock;
+
+double elapsed_ms(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start)
+      .count();
+}
+
+template <typename F> double median_ms(F &&run) {
+  std::vector<double> times;
+
+  for (int i = 0; i < LOAD_RUNS; ++i) {
+    const auto start = Clock::now();
+    run();
+    times.push_back(elapsed_ms(start));
+  }
+
+  std::sort(times.begin(), times.end());
+
+  return times[times.size() / 2];
+}
+
+// fraction of one core needed to run the model in real time
+double process_load(NeuralAudio::NeuralModel &model, size_t blockSize,
+                    double seconds) {
+  const size_t blocks =
+      static_cast<size_t>(seconds * SAMPLE_RATE / blockSize) + 1;
+  std::vector<float> buffer(blockSize);
+  uint32_t seed = 1;
+
+  const auto start = Clock::now();
+
+  for (size_t b = 0; b < blocks; ++b) {
+    for (auto &sample : buffer) {
+      seed = seed * 1664525u + 1013904223u;
+      sample = 0.1f * (static_cast<float>(seed >> 8) / 8388608.0f - 1.0f);
+    }
+
+    model.Process(buffer.data(), buffer.data(), blockSize);
+  }
+
+  const double audioMs = 1000.0 * blocks * blockSize / SAMPLE_RATE;
+
+  return elapsed_ms(start) / audioMs;
+}
+
+// nanoseconds per block of the model, with setup() run before each block
+template <typename F>
+double block_ns(NeuralAudio::NeuralModel &model, size_t blockSize,
+                double seconds, F &&setup) {
+  const size_t blocks =
+      static_cast<size_t>(seconds * SAMPLE_RATE / blockSize) + 1;
+  std::vector<float> buffer(blockSize, 0.0f);
+
+  const auto start = Clock::now();
+
+  for (size_t b = 0; b < blocks; ++b) {
+    setup();
+    model.Process(buffer.data(), buffer.data(), blockSize);
+  }
+
+  return 1e6 * elapsed_ms(start) / blocks;
+}
+
+void fenv_bench(const std::string &path, double seconds) {
+  printf("\n%s, floating point setup per block\n",
+         std::filesystem::path(path).filename().string().c_str());
+  printf("%-8s %12s %12s %10s %8s\n", "frames", "save ns", "once ns",
+         "saved ns", "saved %");
+
+  for (const size_t blockSize : {16, 32, 64}) {
+    NeuralAudio::NeuralModel::SetDefaultMaxAudioBufferSize(
+        static_cast<int>(blockSize));
+
+    std::unique_ptr<NeuralAudio::NeuralModel> model(
+        NeuralAudio::NeuralModel::CreateFromFile(path));
+
+    if (!model)
+      return;
+
+    // as nam_lv2.cpp's run() used to
+    const double saveNs = block_ns(*model, blockSize, seconds, [] {
+      std::fenv_t state;
+      std::feholdexcept(&state);
+      disable_denormals();
+      std::feupdateenv(&state);
+    });
+
+    const double onceNs = block_ns(*model, blockSize, seconds,
+                                   [] { NAM::flush_denormals_on_thread(); });
+
+    printf("%-8zu %12.0f %12.0f %10.0f %8.2f\n", blockSize, saveNs, onceNs,
+           saveNs - onceNs, 100.0 * (saveNs - onceNs) / saveNs);
+  }
+}
+
+// largest difference between the two models' outputs, from a second of
+// noise
+float max_difference(NeuralAudio::NeuralModel &a, NeuralAudio::NeuralModel &b,
+                     size_t blockSize) {
+  const size_t blocks = static_cast<size_t>(SAMPLE_RATE / blockSize) + 1;
+  std::vector<float> bufferA(blockSize);
+  std::vector<float> bufferB(blockSize);
+  uint32_t seed = 1;
+  float difference = 0.0f;
+
+  for (size_t block = 0; block < blocks; ++block) {
+    for (size_t i = 0; i < blockSize; ++i) {
+      seed = seed * 1664525u + 1013904223u;
+      bufferA[i] = 0.1f * (static_cast<float>(seed >> 8) / 8388608.0f - 1.0f);
+      bufferB[i] = bufferA[i];
+    }
+
+    a.Process(bufferA.data(), bufferA.data(), blockSize);
+    b.Process(bufferB.data(), bufferB.data(), blockSize);
+
+    for (size_t i = 0; i < blockSize; ++i)
+      difference = std::max(difference, std::fabs(bufferA[i] - bufferB[i]));
+  }
+
+  return difference;
+}
+
+// false if a check failed
+bool check_model(const std::string &path, size_t blockSize) {
+  const std::string name = std::filesystem::path(path).filename().string();
+
+  NAM::ModelFile file;
+  std::unique_ptr<NeuralAudio::NeuralModel> model(
+      NeuralAudio::NeuralModel::CreateFromFile(path));
+
+  if (!file.load(path.c_str()) || !model) {
+    printf("%-24s failed to load\n", name.c_str());
+    return false;
+  }
+
+  const double warmupMs =
+      1000.0 * NAM::Warmup::measure(model.get(), SAMPLE_RATE, blockSize) /
+      SAMPLE_RATE;
+  const bool warmupOk = warmupMs <= NAM::Warmup::FIXED_TIME_MS;
+
+  printf("%-24s %10.1f %8s", name.c_str(), warmupMs, warmupOk ? "ok" : "FAIL");
+
+  const NAMKernelDescriptor *kernel = NAM::KernelRegistry::find(file.hash());
+
+  if (kernel == nullptr) {
+    printf(" %12s %8s\n", "-", "-");
+    return warmupOk;
+  }
+
+  // both from the initial state, the generic model only kept for comparison
+  std::unique_ptr<NeuralAudio::NeuralModel> generic(
+      NeuralAudio::NeuralModel::CreateFromFile(path));
+  NAM::KernelModel kernelModel(kernel, *generic);
+
+  const float difference = max_difference(*generic, kernelModel, blockSize);
+  const bool kernelOk =
+      difference <= KERNEL_TOLERANCE &&
+      kernelModel.GetRecommendedInputDBAdjustment() ==
+          generic->GetRecommendedInputDBAdjustment() &&
+      kernelModel.GetRecommendedOutputDBAdjustment() ==
+          generic->GetRecommendedOutputDBAdjustment();
+
+  printf(" %12.2e %8s\n", difference, kernelOk ? "ok" : "FAIL");
+
+  return warmupOk && kernelOk;
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  size_t blockSize = 64;
+  double seconds = 10.0;
+  bool fenv = false;
+  bool check = false;
+  std::vector<std::string> paths;
+
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "-b") && i + 1 < argc) {
+      blockSize = std::max(1, atoi(argv[++i]));
+    } else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+      seconds = std::max(0.1, atof(argv[++i]));
+    } else if (!strcmp(argv[i], "-k") && i + 1 < argc) {
+      NAM::KernelRegistry::scan(argv[++i]);
+    } else if (!strcmp(argv[i], "-f")) {
+      fenv = true;
+    } else if (!strcmp(argv[i], "-c")) {
+      check = true;
+    } else if (argv[i][0] == '-') {
+      fprintf(stderr,
+              "usage: %s [-b block_size] [-s seconds] [-k kernel_dir] [-f] "
+              "[-c] [model ...]\n",
+              argv[0]);
+      return 1;
+    } else {
+      paths.emplace_back(argv[i]);
+    }
+  }
+
+  if (paths.empty()) {
+    namespace fs = std::filesystem;
+
+    for (const auto &entry : fs::directory_iterator(NAM_MODELS_DIR))
+      if (entry.path().extension() == ".nam")
+        paths.push_back(entry.path().string());
+
+    std::sort(paths.begin(), paths.end());
+  }
+
+  NeuralAudio::NeuralModel::SetDefaultMaxAudioBufferSize(
+      static_cast<int>(blockSize));
+
+  if (check) {
+    printf("%-24s %10s %8s %12s %8s\n", "model", "warmup ms", "warmup",
+           "kernel diff", "kernel");
+
+    bool passed = true;
+
+    for (const auto &path : paths)
+      passed = check_model(path, blockSize) && passed;
+
+    return passed ? 0 : 1;
+  }
+
+  printf("%-24s %8s %10s %10s %10s %7s %8s %9s %8s\n", "model", "weights",
+         "scan ms", "load ms", "stream ms", "scan %", "cpu %", "kernel %",
+         "speedup");
+
+  for (const auto &path : paths) {
+    const std::string name = std::filesystem::path(path).filename().string();
+
+    NAM::ModelFile file;
+
+    // the pre-pass alone, which Plugin::work runs before NeuralAudio parses
+    // the document itself
+    const double scanMs = median_ms([&] { file.load(path.c_str()); });
+
+    if (!file.load(path.c_str())) {
+      printf("%-24s unreadable\n", name.c_str());
+      continue;
+    }
+
+    // full load as NeuralAudio does it, from the file
+    const double loadMs = median_ms([&] {
+      delete NeuralAudio::NeuralModel::CreateFromFile(path);
+    });
+
+    // construction from the already read document, as the plugin does it:
+    // NeuralAudio's DOM parse and the model build
+    const double streamMs = median_ms([&] {
+      NAM::MemoryStreamBuf buffer(file.text.data(), file.text.size());
+      std::istream stream(&buffer);
+
+      delete NeuralAudio::NeuralModel::CreateFromStream(
+          stream, std::filesystem::path(path).extension());
+    });
+
+    std::unique_ptr<NeuralAudio::NeuralModel> model(
+        NeuralAudio::NeuralModel::CreateFromFile(path));
+
+    if (!model) {
+      printf("%-24s failed to load\n", name.c_str());
+      continue;
+    }
+
+    const double load = process_load(*model, blockSize, seconds);
+
+    // what the pre-pass adds to building the model from the document
+    printf("%-24s %8zu %10.3f %10.3f %10.3f %7.1f %8.2f", name.c_str(),
+           file.weightCount, scanMs, loadMs, streamMs,
+           100.0 * scanMs / streamMs, 100.0 * load);
+
+    // the same model through its generated kernel, if there is one
+    const NAMKernelDescriptor *kernel = NAM::KernelRegistry::find(file.hash());
+
+    if (kernel != nullptr) {
+      NAM::KernelModel kernelModel(kernel, *model);
+      const double kernelLoad = process_load(kernelModel, blockSize, seconds);
+
+      printf(" %9.2f %7.2fx\n", 100.0 * kernelLoad, load / kernelLoad);
+    } else {
+      printf(" %9s %8s\n", "-", "-");
+    }
+  }
+
+  if (fenv && !paths.empty())
+    fenv_bench(paths.front(), seconds);
+
+  return 0;
+}
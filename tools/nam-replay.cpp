@@ -0,0 +1,621 @@
+// Replays a session recorded with NAM_SESSION (see src/nam_session.h)
+// through the LV2 plugin, block by block, and checks that the output is
+// bit-exact. Run it under a profiler to look at a session that had xruns.
+//
+// usage: nam-replay [-b bundle_dir] [-s slowest] [-v] session.bin
+//
+// The plugin gets the same URIDs as in the recorded host, so control events
+// are passed on unchanged. The worker runs between blocks and its responses
+// are delivered where the recording says they were. Models are loaded from
+// the recorded paths; -b overrides the bundle directory, where the plugin
+// looks for kernels. With the automatic backend, the tuning can pick another
+// backend than in the recording unless its cache carries over.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <lv2/atom/atom.h>
+#include <lv2/buf-size/buf-size.h>
+#include <lv2/core/lv2.h>
+#include <lv2/log/log.h>
+#include <lv2/options/options.h>
+#include <lv2/state/state.h>
+#include <lv2/urid/urid.h>
+#include <lv2/worker/worker.h>
+
+#include "nam_plugin.h"
+#include "nam_session.h"
+
+namespace {
+constexpr size_t NOTIFY_CAPACITY = 64 * 1024;
+constexpr int32_t DEFAULT_MAX_BLOCK = 4096;
+
+using Clock = std::chrono::steady_clock;
+
+// ports, in the order of NAM::Plugin::Ports
+enum Port {
+  kControl,
+  kNotify,
+  kAudioIn,
+  kAudioOut,
+  kInputLevel,
+  kOutputLevel,
+  kEnabled,
+  kHardBypass,
+  kLatency,
+  kModelSlot,
+  kBackend,
+  kLoadOnFirstUse,
+  kInputPeak,
+  kInputRMS,
+  kModelInputPeak,
+  kOutputPeak,
+  kOutputRMS,
+  kRecord,
+  kFreewheel
+};
+
+// where each NAM::SessionControl goes
+constexpr Port CONTROL_PORTS[NAM::kSessionControlCount] = {
+    kInputLevel, kOutputLevel, kEnabled,        kHardBypass,
+    kModelSlot,  kBackend,     kLoadOnFirstUse, kFreewheel};
+
+struct Record {
+  uint32_t type;
+  const uint8_t *data;
+  uint32_t size;
+};
+
+struct BlockTime {
+  size_t index;
+  uint32_t n_samples;
+  double load; // share of the block's duration
+};
+
+class Session {
+public:
+  bool read(const char *path) {
+    std::ifstream file(path, std::ios::binary);
+    bytes.assign(std::istreambuf_iterator<char>(file),
+                 std::istreambuf_iterator<char>());
+
+    if (bytes.size() < sizeof(header))
+      return false;
+
+    memcpy(&header, bytes.data(), sizeof(header));
+
+    if (memcmp(header.magic, NAM::SESSION_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != NAM::SESSION_VERSION)
+      return false;
+
+    size_t offset = sizeof(header);
+
+    // a session cut short by a crash ends in a partial record
+    while (offset + sizeof(NAM::SessionRecord) <= bytes.size()) {
+      NAM::SessionRecord record;
+      memcpy(&record, &bytes[offset], sizeof(record));
+      offset += sizeof(record);
+
+      if (offset + record.size > bytes.size())
+        break;
+
+      records.push_back({record.type, &bytes[offset], record.size});
+      offset += (record.size + 7) & ~size_t(7);
+    }
+
+    return true;
+  }
+
+  double sample_rate() const { return header.sampleRate; }
+
+  std::vector<Record> records;
+
+private:
+  NAM::SessionHeader header = {};
+  std::vector<uint8_t> bytes;
+};
+
+class Host {
+public:
+  explicit Host(const Session &session) {
+    for (const Record &record : session.records) {
+      if (record.type == NAM::kSessionBundle) {
+        bundlePath.assign(reinterpret_cast<const char *>(record.data));
+      } else if (record.type == NAM::kSessionUrid) {
+        uint32_t urid;
+        memcpy(&urid, record.data, sizeof(urid));
+        recordedUrids[reinterpret_cast<const char *>(record.data) +
+                      sizeof(urid)] = urid;
+        nextUrid = std::max(nextUrid, urid + 1);
+      } else if (record.type == NAM::kSessionMaxBlock &&
+                 maxBlock == DEFAULT_MAX_BLOCK) {
+        memcpy(&maxBlock, record.data, sizeof(maxBlock));
+      }
+    }
+
+    map.handle = this;
+    map.map = map_uri;
+
+    log.handle = this;
+    log.printf = log_printf;
+    log.vprintf = log_vprintf;
+
+    schedule.handle = this;
+    schedule.schedule_work = schedule_work;
+
+    mapPath.handle = this;
+    mapPath.abstract_path = copy_path;
+    mapPath.absolute_path = copy_path;
+    freePath.handle = this;
+    freePath.free_path = free_path;
+
+    options[0] = {LV2_OPTIONS_INSTANCE,
+                  0,
+                  map_uri(this, LV2_BUF_SIZE__maxBlockLength),
+                  sizeof(int32_t),
+                  map_uri(this, LV2_ATOM__Int),
+                  &maxBlock};
+    options[1] = {LV2_OPTIONS_INSTANCE, 0, 0, 0, 0, nullptr};
+
+    features[0] = {LV2_URID__map, &map};
+    features[1] = {LV2_LOG__log, &log};
+    features[2] = {LV2_WORKER__schedule, &schedule};
+    features[3] = {LV2_OPTIONS__options, options};
+    features[4] = {LV2_STATE__mapPath, &mapPath};
+    features[5] = {LV2_STATE__freePath, &freePath};
+    for (size_t i = 0; i < 6; ++i)
+      featureList[i] = &features[i];
+    featureList[6] = nullptr;
+
+    std::fill(std::begin(controls), std::end(controls), 0.0f);
+  }
+
+  ~Host() {
+    if (instance != nullptr)
+      descriptor->cleanup(instance);
+  }
+
+  bool verbose = false;
+  std::string bundlePath;
+
+  bool instantiate(double sampleRate) {
+    descriptor = lv2_descriptor(0);
+    instance = descriptor->instantiate(descriptor, sampleRate,
+                                       bundlePath.c_str(), featureList);
+
+    if (instance == nullptr)
+      return false;
+
+    optionsInterface = static_cast<const LV2_Options_Interface *>(
+        descriptor->extension_data(LV2_OPTIONS__interface));
+    worker = static_cast<const LV2_Worker_Interface *>(
+        descriptor->extension_data(LV2_WORKER__interface));
+    state = static_cast<const LV2_State_Interface *>(
+        descriptor->extension_data(LV2_STATE__interface));
+
+    resize(static_cast<uint32_t>(maxBlock));
+    descriptor->connect_port(instance, kNotify, notify.data());
+
+    for (uint32_t port = kInputLevel; port <= kFreewheel; ++port)
+      descriptor->connect_port(instance, port, &controls[port]);
+
+    descriptor->activate(instance);
+    do_work();
+
+    return true;
+  }
+
+  // the first one was passed to instantiate()
+  void set_max_block(int32_t frames) {
+    if (frames == maxBlock)
+      return;
+
+    maxBlock = frames;
+    resize(static_cast<uint32_t>(frames));
+    optionsInterface->set(instance, options);
+  }
+
+  // returns the time spent in run()
+  double run(const uint8_t *data) {
+    NAM::SessionBlock block;
+    memcpy(&block, data, sizeof(block));
+    data += sizeof(block);
+
+    for (size_t i = 0; i < NAM::kSessionControlCount; ++i)
+      controls[CONTROL_PORTS[i]] = block.controls[i];
+
+    resize(block.n_samples);
+
+    if (block.eventsSize >= sizeof(LV2_Atom_Sequence)) {
+      control.assign(data, data + block.eventsSize);
+    } else {
+      // recorded without its events, or the host sent none
+      LV2_Atom_Sequence empty = {
+          {sizeof(LV2_Atom_Sequence_Body), map_uri(this, LV2_ATOM__Sequence)},
+          {0, 0}};
+      const auto bytes = reinterpret_cast<const uint8_t *>(&empty);
+      control.assign(bytes, bytes + sizeof(empty));
+    }
+
+    // 8-byte aligned, as the atoms inside expect
+    controlBuffer.resize((control.size() + 7) / 8);
+    memcpy(controlBuffer.data(), control.data(), control.size());
+    descriptor->connect_port(instance, kControl, controlBuffer.data());
+
+    memcpy(input.data(), data + block.eventsSize,
+           block.n_samples * sizeof(float));
+
+    reinterpret_cast<LV2_Atom *>(notify.data())->size = NOTIFY_CAPACITY;
+
+    const auto start = Clock::now();
+    descriptor->run(instance, block.n_samples);
+    const std::chrono::duration<double> elapsed = Clock::now() - start;
+
+    lastFrames = block.n_samples;
+    do_work();
+
+    return elapsed.count();
+  }
+
+  const float *output_data() const { return output.data(); }
+  uint32_t last_frames() const { return lastFrames; }
+
+  // false if the plugin has no response of that type waiting
+  bool deliver_response(uint32_t type) {
+    if (responses.empty())
+      return false;
+
+    std::vector<uint8_t> response = std::move(responses.front());
+    responses.pop_front();
+
+    uint32_t responseType;
+    memcpy(&responseType, response.data(), sizeof(responseType));
+
+    worker->work_response(instance, static_cast<uint32_t>(response.size()),
+                          response.data());
+    do_work();
+
+    return responseType == type;
+  }
+
+  void restore(const uint8_t *data, uint32_t size) {
+    uint32_t flags;
+    memcpy(&flags, data, sizeof(flags));
+
+    std::vector<std::string> paths;
+    for (size_t offset = sizeof(flags); offset < size;) {
+      paths.emplace_back(reinterpret_cast<const char *>(data + offset));
+      offset += paths.back().size() + 1;
+    }
+
+    stored.clear();
+
+    for (uint32_t i = 0; i < NAM::NUM_MODEL_SLOTS && i < paths.size(); ++i) {
+      const std::string uri = SLOT_URI_PREFIX + std::string(1, 'a' + i);
+
+      if ((flags & NAM::kSessionRestoreModels) && !paths[i].empty())
+        stored[map_uri(this, uri.c_str())] = paths[i];
+    }
+
+    if ((flags & NAM::kSessionRestoreIR) &&
+        paths.size() > NAM::NUM_MODEL_SLOTS &&
+        !paths[NAM::NUM_MODEL_SLOTS].empty())
+      stored[map_uri(this, IR_URI)] = paths[NAM::NUM_MODEL_SLOTS];
+
+    controls[kLoadOnFirstUse] =
+        (flags & NAM::kSessionRestoreDeferred) ? 1.0f : 0.0f;
+
+    state->restore(instance, retrieve_value, this, 0, featureList);
+    do_work();
+  }
+
+private:
+  const LV2_Descriptor *descriptor = nullptr;
+  LV2_Handle instance = nullptr;
+  const LV2_Options_Interface *optionsInterface = nullptr;
+  const LV2_Worker_Interface *worker = nullptr;
+  const LV2_State_Interface *state = nullptr;
+
+  // URIs the recorded plugin mapped keep their URIDs, others come after
+  std::map<std::string, uint32_t> recordedUrids;
+  std::vector<std::string> extraUris;
+  uint32_t nextUrid = 1;
+  uint32_t firstExtraUrid = 0;
+
+  LV2_URID_Map map = {};
+  LV2_Log_Log log = {};
+  LV2_Worker_Schedule schedule = {};
+  LV2_State_Map_Path mapPath = {};
+  LV2_State_Free_Path freePath = {};
+  int32_t maxBlock = DEFAULT_MAX_BLOCK;
+  LV2_Options_Option options[2];
+  LV2_Feature features[6];
+  const LV2_Feature *featureList[7];
+
+  std::vector<uint8_t> control;
+  std::vector<uint64_t> controlBuffer;
+  std::vector<uint8_t> notify = std::vector<uint8_t>(NOTIFY_CAPACITY + 64);
+  std::vector<float> input;
+  std::vector<float> output;
+  float controls[kFreewheel + 1];
+  uint32_t lastFrames = 0;
+
+  std::deque<std::vector<uint8_t>> requests;
+  std::deque<std::vector<uint8_t>> responses;
+
+  std::map<uint32_t, std::string> stored;
+
+  void resize(uint32_t frames) {
+    if (frames <= input.size())
+      return;
+
+    input.resize(frames);
+    output.resize(frames);
+    descriptor->connect_port(instance, kAudioIn, input.data());
+    descriptor->connect_port(instance, kAudioOut, output.data());
+  }
+
+  void do_work() {
+    // requests made by work_response() are handled too
+    while (!requests.empty()) {
+      std::vector<uint8_t> request = std::move(requests.front());
+      requests.pop_front();
+
+      worker->work(instance, respond, this,
+                   static_cast<uint32_t>(request.size()), request.data());
+    }
+  }
+
+  static LV2_URID map_uri(LV2_URID_Map_Handle handle, const char *uri) {
+    auto host = static_cast<Host *>(handle);
+    const auto recorded = host->recordedUrids.find(uri);
+
+    if (recorded != host->recordedUrids.end())
+      return recorded->second;
+
+    if (host->firstExtraUrid == 0)
+      host->firstExtraUrid = host->nextUrid;
+
+    for (size_t i = 0; i < host->extraUris.size(); ++i)
+      if (host->extraUris[i] == uri)
+        return static_cast<LV2_URID>(host->firstExtraUrid + i);
+
+    host->extraUris.emplace_back(uri);
+
+    return static_cast<LV2_URID>(host->firstExtraUrid +
+                                 host->extraUris.size() - 1);
+  }
+
+  static int log_vprintf(LV2_Log_Handle handle, LV2_URID, const char *format,
+                         va_list args) {
+    auto host = static_cast<Host *>(handle);
+
+    return host->verbose ? vfprintf(stderr, format, args) : 0;
+  }
+
+  static int log_printf(LV2_Log_Handle handle, LV2_URID type,
+                        const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    const int written = log_vprintf(handle, type, format, args);
+    va_end(args);
+
+    return written;
+  }
+
+  static LV2_Worker_Status schedule_work(LV2_Worker_Schedule_Handle handle,
+                                         uint32_t size, const void *data) {
+    auto host = static_cast<Host *>(handle);
+    auto bytes = static_cast<const uint8_t *>(data);
+
+    host->requests.emplace_back(bytes, bytes + size);
+
+    return LV2_WORKER_SUCCESS;
+  }
+
+  static LV2_Worker_Status respond(LV2_Worker_Respond_Handle handle,
+                                   uint32_t size, const void *data) {
+    auto host = static_cast<Host *>(handle);
+    auto bytes = static_cast<const uint8_t *>(data);
+
+    host->responses.emplace_back(bytes, bytes + size);
+
+    return LV2_WORKER_SUCCESS;
+  }
+
+  static char *copy_path(LV2_State_Map_Path_Handle, const char *path) {
+    return strdup(path);
+  }
+
+  static void free_path(LV2_State_Free_Path_Handle, char *path) {
+    free(path);
+  }
+
+  static const void *retrieve_value(LV2_State_Handle handle, uint32_t key,
+                                    size_t *size, uint32_t *type,
+                                    uint32_t *flags) {
+    auto host = static_cast<Host *>(handle);
+    const auto value = host->stored.find(key);
+
+    if (value == host->stored.end())
+      return nullptr;
+
+    *size = value->second.size() + 1;
+    *type = map_uri(host, LV2_ATOM__Path);
+    *flags = LV2_STATE_IS_POD;
+
+    return value->second.c_str();
+  }
+};
+} // namespace
+
+int main(int argc, char **argv) {
+  const char *sessionPath = nullptr;
+  const char *bundlePath = nullptr;
+  size_t slowest = 10;
+  bool verbose = false;
+
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "-b") && i + 1 < argc) {
+      bundlePath = argv[++i];
+    } else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+      slowest = static_cast<size_t>(std::max(0, atoi(argv[++i])));
+    } else if (!strcmp(argv[i], "-v")) {
+      verbose = true;
+    } else if (argv[i][0] == '-' || sessionPath != nullptr) {
+      fprintf(stderr,
+              "usage: %s [-b bundle_dir] [-s slowest] [-v] session.bin\n",
+              argv[0]);
+      return 1;
+    } else {
+      sessionPath = argv[i];
+    }
+  }
+
+  Session session;
+
+  if (sessionPath == nullptr || !session.read(sessionPath)) {
+    fprintf(stderr, "nam-replay: not a session file: %s\n",
+            sessionPath ? sessionPath : "(none)");
+    return 1;
+  }
+
+  Host host(session);
+  host.verbose = verbose;
+  if (bundlePath != nullptr)
+    host.bundlePath = bundlePath;
+
+  if (!host.instantiate(session.sample_rate())) {
+    fprintf(stderr, "nam-replay: instantiation failed\n");
+    return 1;
+  }
+
+  std::vector<BlockTime> times;
+  size_t mismatches = 0;
+  size_t firstMismatch = 0;
+  float maxDifference = 0.0f;
+  size_t gapBlock = 0;
+  uint64_t dropped = 0;
+  size_t missingResponses = 0;
+  double processSeconds = 0.0;
+  double audioSeconds = 0.0;
+
+  for (const Record &record : session.records) {
+    switch (record.type) {
+    case NAM::kSessionMaxBlock: {
+      int32_t frames;
+      memcpy(&frames, record.data, sizeof(frames));
+      host.set_max_block(frames);
+      break;
+    }
+
+    case NAM::kSessionBlock: {
+      const double seconds = host.run(record.data);
+      const double duration = host.last_frames() / session.sample_rate();
+
+      times.push_back({times.size(), host.last_frames(), seconds / duration});
+      processSeconds += seconds;
+      audioSeconds += duration;
+      break;
+    }
+
+    case NAM::kSessionOutput: {
+      const auto recorded = reinterpret_cast<const float *>(record.data);
+      const uint32_t frames = record.size / sizeof(float);
+      const float *output = host.output_data();
+
+      if (frames != host.last_frames() ||
+          memcmp(recorded, output, record.size) != 0) {
+        if (mismatches++ == 0)
+          firstMismatch = times.size() - 1;
+
+        for (uint32_t i = 0; i < std::min(frames, host.last_frames()); ++i)
+          maxDifference =
+              std::max(maxDifference, std::fabs(recorded[i] - output[i]));
+      }
+      break;
+    }
+
+    case NAM::kSessionResponse: {
+      uint32_t type;
+      memcpy(&type, record.data, sizeof(type));
+
+      if (!host.deliver_response(type))
+        ++missingResponses;
+      break;
+    }
+
+    case NAM::kSessionRestore:
+      host.restore(record.data, record.size);
+      break;
+
+    case NAM::kSessionGap: {
+      uint64_t count;
+      memcpy(&count, record.data, sizeof(count));
+
+      if (dropped == 0)
+        gapBlock = times.size();
+      dropped += count;
+      break;
+    }
+
+    default:
+      break;
+    }
+  }
+
+  if (times.empty()) {
+    printf("no blocks recorded\n");
+    return 0;
+  }
+
+  printf("%zu blocks, %.1f s of audio processed in %.3f s (%.1fx real "
+         "time)\n",
+         times.size(), audioSeconds, processSeconds,
+         audioSeconds / std::max(processSeconds, 1e-9));
+
+  std::vector<BlockTime> sorted = times;
+  std::sort(sorted.begin(), sorted.end(),
+            [](const BlockTime &a, const BlockTime &b) {
+              return a.load > b.load;
+            });
+
+  printf("block load: median %.1f%%, p99 %.1f%%, max %.1f%%\n",
+         100.0 * sorted[sorted.size() / 2].load,
+         100.0 * sorted[sorted.size() / 100].load, 100.0 * sorted[0].load);
+
+  for (size_t i = 0; i < std::min(slowest, sorted.size()); ++i)
+    printf("  block %zu (%u frames): %.1f%%\n", sorted[i].index,
+           sorted[i].n_samples, 100.0 * sorted[i].load);
+
+  if (dropped > 0)
+    printf("%llu records were dropped while recording, from block %zu on "
+           "the output can differ\n",
+           static_cast<unsigned long long>(dropped), gapBlock);
+
+  if (missingResponses > 0)
+    printf("%zu worker responses did not match the recording\n",
+           missingResponses);
+
+  if (mismatches > 0) {
+    printf("output differs in %zu blocks, from block %zu (max difference "
+           "%g)\n",
+           mismatches, firstMismatch, maxDifference);
+    return 1;
+  }
+
+  printf("output is bit-exact\n");
+
+  return 0;
+}
@@ -0,0 +1,284 @@
+// Flags allocations, locks and syscalls made inside the audio-thread sections
+// marked with NAM::RTSection (built with NAM_RT_CHECK). Linked into
+// nam-rtcheck, or built as libnam-rtcheck.so to LD_PRELOAD into any host:
+//
+//   LD_PRELOAD=libnam-rtcheck.so jalv.gtk <plugin uri>
+//
+// Every violation is reported on stderr with a stack trace. glibc only.
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <atomic>
+#include <cerrno>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void __libc_free(void *ptr);
+}
+
+namespace {
+constexpr int MAX_FRAMES = 32;
+constexpr unsigned long MAX_REPORTS = 100;
+
+thread_local int depth = 0;
+thread_local bool reporting = false;
+std::atomic<unsigned long> violations{0};
+
+// resolved up front by resolve(), since dlsym may allocate; lazily only
+// for calls made before this library's constructor ran
+template <typename F> F real(F &function, const char *name) {
+  if (function == nullptr)
+    function = reinterpret_cast<F>(dlsym(RTLD_NEXT, name));
+
+  return function;
+}
+
+int (*real_mutex_lock)(pthread_mutex_t *);
+int (*real_cond_wait)(pthread_cond_t *, pthread_mutex_t *);
+int (*real_open)(const char *, int, ...);
+int (*real_openat)(int, const char *, int, ...);
+ssize_t (*real_read)(int, void *, size_t);
+ssize_t (*real_write)(int, const void *, size_t);
+int (*real_close)(int);
+int (*real_usleep)(useconds_t);
+int (*real_nanosleep)(const struct timespec *, struct timespec *);
+int (*real_vfprintf)(FILE *, const char *, va_list);
+int (*real_vfprintf_chk)(FILE *, int, const char *, va_list);
+size_t (*real_fwrite)(const void *, size_t, size_t, FILE *);
+int (*real_fputs)(const char *, FILE *);
+int (*real_fflush)(FILE *);
+FILE *(*real_fopen)(const char *, const char *);
+
+void print(const char *text) {
+  // straight to the kernel, the interposed write would recurse
+  syscall(SYS_write, STDERR_FILENO, text, strlen(text));
+}
+
+void check(const char *what) {
+  if (depth == 0 || reporting)
+    return;
+
+  reporting = true;
+
+  if (violations.fetch_add(1) < MAX_REPORTS) {
+    char header[128];
+    snprintf(header, sizeof(header),
+             "nam-rtcheck: %s called on the audio thread\n", what);
+    print(header);
+
+    void *frames[MAX_FRAMES];
+    const int count = backtrace(frames, MAX_FRAMES);
+
+    // skip check() and the interposer itself
+    backtrace_symbols_fd(frames + 2, count - 2, STDERR_FILENO);
+    print("\n");
+  }
+
+  reporting = false;
+}
+
+__attribute__((constructor)) void resolve() {
+  real(real_mutex_lock, "pthread_mutex_lock");
+  real(real_cond_wait, "pthread_cond_wait");
+  real(real_open, "open");
+  real(real_openat, "openat");
+  real(real_read, "read");
+  real(real_write, "write");
+  real(real_close, "close");
+  real(real_usleep, "usleep");
+  real(real_nanosleep, "nanosleep");
+  real(real_vfprintf, "vfprintf");
+  real(real_vfprintf_chk, "__vfprintf_chk");
+  real(real_fwrite, "fwrite");
+  real(real_fputs, "fputs");
+  real(real_fflush, "fflush");
+  real(real_fopen, "fopen");
+
+  // the first backtrace() loads libgcc, do it now rather than mid-report
+  void *frames[1];
+  backtrace(frames, 1);
+}
+
+__attribute__((destructor)) void summary() {
+  char text[96];
+  snprintf(text, sizeof(text), "nam-rtcheck: %lu violation(s)\n",
+           violations.load());
+  print(text);
+}
+} // namespace
+
+extern "C" {
+void nam_rt_enter() { ++depth; }
+void nam_rt_leave() { --depth; }
+unsigned long nam_rt_violations() { return violations.load(); }
+
+// memory
+void *malloc(size_t size) {
+  check("malloc");
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+  check("calloc");
+  return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+  check("realloc");
+  return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) {
+  if (ptr != nullptr)
+    check("free");
+  __libc_free(ptr);
+}
+
+void *memalign(size_t alignment, size_t size) {
+  check("memalign");
+  return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+  check("aligned_alloc");
+  return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size) {
+  check("posix_memalign");
+  *ptr = __libc_memalign(alignment, size);
+  return (*ptr != nullptr) ? 0 : ENOMEM;
+}
+
+// locks and waits
+int pthread_mutex_lock(pthread_mutex_t *mutex) {
+  check("pthread_mutex_lock");
+  return real(real_mutex_lock, "pthread_mutex_lock")(mutex);
+}
+
+int pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex) {
+  check("pthread_cond_wait");
+  return real(real_cond_wait, "pthread_cond_wait")(cond, mutex);
+}
+
+int usleep(useconds_t usec) {
+  check("usleep");
+  return real(real_usleep, "usleep")(usec);
+}
+
+int nanosleep(const struct timespec *req, struct timespec *rem) {
+  check("nanosleep");
+  return real(real_nanosleep, "nanosleep")(req, rem);
+}
+
+// files and stdio (glibc's stdio calls its own write internally)
+int open(const char *path, int flags, ...) {
+  va_list args;
+  va_start(args, flags);
+  const mode_t mode = va_arg(args, mode_t);
+  va_end(args);
+
+  check("open");
+  return real(real_open, "open")(path, flags, mode);
+}
+
+int openat(int dir, const char *path, int flags, ...) {
+  va_list args;
+  va_start(args, flags);
+  const mode_t mode = va_arg(args, mode_t);
+  va_end(args);
+
+  check("openat");
+  return real(real_openat, "openat")(dir, path, flags, mode);
+}
+
+ssize_t read(int fd, void *buffer, size_t count) {
+  check("read");
+  return real(real_read, "read")(fd, buffer, count);
+}
+
+ssize_t write(int fd, const void *buffer, size_t count) {
+  check("write");
+  return real(real_write, "write")(fd, buffer, count);
+}
+
+int close(int fd) {
+  check("close");
+  return real(real_close, "close")(fd);
+}
+
+FILE *fopen(const char *path, const char *mode) {
+  check("fopen");
+  return real(real_fopen, "fopen")(path, mode);
+}
+
+int vfprintf(FILE *stream, const char *format, va_list args) {
+  check("vfprintf");
+  return real(real_vfprintf, "vfprintf")(stream, format, args);
+}
+
+int fprintf(FILE *stream, const char *format, ...) {
+  check("fprintf");
+
+  va_list args;
+  va_start(args, format);
+  const int result = real(real_vfprintf, "vfprintf")(stream, format, args);
+  va_end(args);
+
+  return result;
+}
+
+int __fprintf_chk(FILE *stream, int flag, const char *format, ...) {
+  check("fprintf");
+
+  va_list args;
+  va_start(args, format);
+  const int result =
+      real(real_vfprintf_chk, "__vfprintf_chk")(stream, flag, format, args);
+  va_end(args);
+
+  return result;
+}
+
+int printf(const char *format, ...) {
+  check("printf");
+
+  va_list args;
+  va_start(args, format);
+  const int result = real(real_vfprintf, "vfprintf")(stdout, format, args);
+  va_end(args);
+
+  return result;
+}
+
+size_t fwrite(const void *data, size_t size, size_t count, FILE *stream) {
+  check("fwrite");
+  return real(real_fwrite, "fwrite")(data, size, count, stream);
+}
+
+int fputs(const char *text, FILE *stream) {
+  check("fputs");
+  return real(real_fputs, "fputs")(text, stream);
+}
+
+int fflush(FILE *stream) {
+  check("fflush");
+  return real(real_fflush, "fflush")(stream);
+}
+}
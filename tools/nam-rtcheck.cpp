@@ -0,0 +1,565 @@
+// Drives the LV2 plugin through model loading, slot switching, bypassing,
+// backend changes and state save/restore, with the interposer from
+// nam-rtcheck-interpose.cpp watching its audio-thread sections. Exits with
+// status 1 if anything in them allocated, locked or made a syscall.
+//
+// usage: nam-rtcheck [-i ir.wav] [model_a [model_b]]
+//
+// The host side is minimal and synchronous: the worker runs between cycles
+// and its responses are delivered right after run(), like jalv does.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <lv2/atom/forge.h>
+#include <lv2/buf-size/buf-size.h>
+#include <lv2/core/lv2.h>
+#include <lv2/log/log.h>
+#include <lv2/options/options.h>
+#include <lv2/patch/patch.h>
+#include <lv2/state/state.h>
+#include <lv2/urid/urid.h>
+#include <lv2/worker/worker.h>
+
+#include "nam_plugin.h"
+
+// from nam-rtcheck-interpose.cpp
+extern "C" unsigned long nam_rt_violations();
+
+namespace {
+constexpr double SAMPLE_RATE = 48000.0;
+constexpr int32_t MAX_BLOCK = 512;
+constexpr size_t ATOM_CAPACITY = 8192;
+constexpr size_t MAX_MESSAGE = 2048;
+constexpr size_t QUEUE_SIZE = 64;
+constexpr size_t LOG_CAPACITY = 64 * 1024;
+constexpr int MAX_IDLE_CYCLES = 20000;
+
+// ports, in the order of NAM::Plugin::Ports
+enum Port {
+  kControl,
+  kNotify,
+  kAudioIn,
+  kAudioOut,
+  kInputLevel,
+  kOutputLevel,
+  kEnabled,
+  kHardBypass,
+  kLatency,
+  kModelSlot,
+  kBackend,
+  kLoadOnFirstUse,
+  kInputPeak,
+  kInputRMS,
+  kModelInputPeak,
+  kOutputPeak,
+  kOutputRMS,
+  kRecord,
+  kFreewheel
+};
+
+struct Message {
+  uint32_t size;
+  alignas(8) uint8_t data[MAX_MESSAGE];
+};
+
+class Host {
+public:
+  Host() {
+    uris.reserve(256);
+    map.handle = this;
+    map.map = map_uri;
+
+    log.handle = this;
+    log.printf = log_printf;
+    log.vprintf = log_vprintf;
+
+    schedule.handle = this;
+    schedule.schedule_work = schedule_work;
+
+    mapPath.handle = this;
+    mapPath.abstract_path = copy_path;
+    mapPath.absolute_path = copy_path;
+    freePath.handle = this;
+    freePath.free_path = free_path;
+
+    maxBlock = MAX_BLOCK;
+    options[0] = {LV2_OPTIONS_INSTANCE,
+                  0,
+                  map_uri(this, LV2_BUF_SIZE__maxBlockLength),
+                  sizeof(int32_t),
+                  map_uri(this, LV2_ATOM__Int),
+                  &maxBlock};
+    options[1] = {LV2_OPTIONS_INSTANCE, 0, 0, 0, 0, nullptr};
+
+    features[0] = {LV2_URID__map, &map};
+    features[1] = {LV2_LOG__log, &log};
+    features[2] = {LV2_WORKER__schedule, &schedule};
+    features[3] = {LV2_OPTIONS__options, options};
+    features[4] = {LV2_STATE__mapPath, &mapPath};
+    features[5] = {LV2_STATE__freePath, &freePath};
+    for (size_t i = 0; i < 6; ++i)
+      featureList[i] = &features[i];
+    featureList[6] = nullptr;
+
+    lv2_atom_forge_init(&forge, &map);
+    std::fill(std::begin(controls), std::end(controls), 0.0f);
+    controls[kEnabled] = 1.0f;
+  }
+
+  ~Host() {
+    if (instance != nullptr)
+      descriptor->cleanup(instance);
+  }
+
+  bool instantiate(const char *bundlePath) {
+    descriptor = lv2_descriptor(0);
+    instance = descriptor->instantiate(descriptor, SAMPLE_RATE, bundlePath,
+                                       featureList);
+
+    if (instance == nullptr)
+      return false;
+
+    optionsInterface = static_cast<const LV2_Options_Interface *>(
+        descriptor->extension_data(LV2_OPTIONS__interface));
+    worker = static_cast<const LV2_Worker_Interface *>(
+        descriptor->extension_data(LV2_WORKER__interface));
+    state = static_cast<const LV2_State_Interface *>(
+        descriptor->extension_data(LV2_STATE__interface));
+
+    descriptor->connect_port(instance, kControl, control);
+    descriptor->connect_port(instance, kNotify, notify);
+    descriptor->connect_port(instance, kAudioIn, input);
+    descriptor->connect_port(instance, kAudioOut, output);
+
+    for (uint32_t port = kInputLevel; port <= kFreewheel; ++port)
+      descriptor->connect_port(instance, port, &controls[port]);
+
+    descriptor->activate(instance);
+    begin_control();
+
+    return true;
+  }
+
+  float &control_port(Port port) { return controls[port]; }
+
+  // queued for the next cycle's control sequence
+  void set_path(const char *property, const char *path) {
+    LV2_Atom_Forge_Frame frame;
+
+    lv2_atom_forge_frame_time(&forge, 0);
+    lv2_atom_forge_object(&forge, &frame, 0, map_uri(this, LV2_PATCH__Set));
+    lv2_atom_forge_key(&forge, map_uri(this, LV2_PATCH__property));
+    lv2_atom_forge_urid(&forge, map_uri(this, property));
+    lv2_atom_forge_key(&forge, map_uri(this, LV2_PATCH__value));
+    lv2_atom_forge_path(&forge, path, static_cast<uint32_t>(strlen(path)) + 1);
+    lv2_atom_forge_pop(&forge, &frame);
+  }
+
+  void get() {
+    LV2_Atom_Forge_Frame frame;
+
+    lv2_atom_forge_frame_time(&forge, 0);
+    lv2_atom_forge_object(&forge, &frame, 0, map_uri(this, LV2_PATCH__Get));
+    lv2_atom_forge_pop(&forge, &frame);
+  }
+
+  // one host cycle: run, deliver worker responses, then do the work
+  void cycle(uint32_t frames, bool silent = false) {
+    lv2_atom_forge_pop(&forge, &controlFrame);
+
+    for (uint32_t i = 0; i < frames; ++i) {
+      input[i] = silent ? 0.0f
+                        : 0.3f * std::sin(phase) *
+                              ((clock / 24000) % 4 == 3 ? 0.0f : 1.0f);
+      phase = std::fmod(phase + 2.0f * float(M_PI) * 110.0f / SAMPLE_RATE,
+                        2.0f * float(M_PI));
+      ++clock;
+    }
+
+    reinterpret_cast<LV2_Atom *>(notify)->size = ATOM_CAPACITY;
+    descriptor->run(instance, frames);
+
+    deliver_responses();
+    do_work();
+    flush_log();
+
+    for (uint32_t i = 0; i < frames; ++i) {
+      if (!std::isfinite(output[i])) {
+        fprintf(stderr, "nam-rtcheck: non-finite output\n");
+        break;
+      }
+    }
+
+    begin_control();
+  }
+
+  // runs until the worker has nothing left to do
+  bool settle(uint32_t frames = 128) {
+    for (int i = 0; i < MAX_IDLE_CYCLES; ++i) {
+      cycle(frames);
+
+      if (requestCount == 0 && responseCount == 0)
+        return true;
+    }
+
+    return false;
+  }
+
+  // from the host's main thread, between cycles
+  void set_max_block(int32_t frames) {
+    maxBlock = frames;
+    optionsInterface->set(instance, options);
+  }
+
+  void save() {
+    stored.clear();
+    state->save(instance, store_value, this, LV2_STATE_IS_POD, featureList);
+  }
+
+  void restore() {
+    state->restore(instance, retrieve_value, this, 0, featureList);
+  }
+
+private:
+  struct Value {
+    uint32_t type;
+    std::string data;
+  };
+
+  const LV2_Descriptor *descriptor = nullptr;
+  LV2_Handle instance = nullptr;
+  const LV2_Options_Interface *optionsInterface = nullptr;
+  const LV2_Worker_Interface *worker = nullptr;
+  const LV2_State_Interface *state = nullptr;
+
+  std::vector<std::string> uris;
+  LV2_URID_Map map = {};
+  LV2_Log_Log log = {};
+  LV2_Worker_Schedule schedule = {};
+  LV2_State_Map_Path mapPath = {};
+  LV2_State_Free_Path freePath = {};
+  int32_t maxBlock;
+  LV2_Options_Option options[2];
+  LV2_Feature features[6];
+  const LV2_Feature *featureList[7];
+
+  LV2_Atom_Forge forge = {};
+  LV2_Atom_Forge_Frame controlFrame;
+  alignas(8) uint8_t control[ATOM_CAPACITY];
+  alignas(8) uint8_t notify[ATOM_CAPACITY];
+  float input[MAX_BLOCK];
+  float output[MAX_BLOCK];
+  float controls[kFreewheel + 1];
+  float phase = 0.0f;
+  uint64_t clock = 0;
+
+  // the plugin's messages, copied into preallocated storage
+  Message requests[QUEUE_SIZE];
+  Message responses[QUEUE_SIZE];
+  size_t requestCount = 0;
+  size_t responseCount = 0;
+
+  char logText[LOG_CAPACITY];
+  size_t logUsed = 0;
+
+  std::map<uint32_t, Value> stored;
+
+  void begin_control() {
+    lv2_atom_forge_set_buffer(&forge, control, sizeof(control));
+    lv2_atom_forge_sequence_head(&forge, &controlFrame, 0);
+  }
+
+  void deliver_responses() {
+    for (size_t i = 0; i < responseCount; ++i)
+      worker->work_response(instance, responses[i].size, responses[i].data);
+
+    responseCount = 0;
+  }
+
+  void do_work() {
+    // requests made by work_response() above are handled too
+    for (size_t i = 0; i < requestCount; ++i)
+      worker->work(instance, respond, this, requests[i].size,
+                   requests[i].data);
+
+    requestCount = 0;
+  }
+
+  void flush_log() {
+    if (logUsed > 0 && getenv("NAM_RTCHECK_VERBOSE") != nullptr)
+      fwrite(logText, 1, logUsed, stderr);
+
+    logUsed = 0;
+  }
+
+  static bool push(Message *queue, size_t &count, uint32_t size,
+                   const void *data) {
+    if (count == QUEUE_SIZE || size > MAX_MESSAGE)
+      return false;
+
+    queue[count].size = size;
+    memcpy(queue[count].data, data, size);
+    ++count;
+
+    return true;
+  }
+
+  static LV2_URID map_uri(LV2_URID_Map_Handle handle, const char *uri) {
+    auto host = static_cast<Host *>(handle);
+
+    for (size_t i = 0; i < host->uris.size(); ++i)
+      if (host->uris[i] == uri)
+        return static_cast<LV2_URID>(i + 1);
+
+    host->uris.emplace_back(uri);
+
+    return static_cast<LV2_URID>(host->uris.size());
+  }
+
+  // into a fixed buffer, as the plugin logs from the audio thread too
+  static int log_vprintf(LV2_Log_Handle handle, LV2_URID, const char *format,
+                         va_list args) {
+    auto host = static_cast<Host *>(handle);
+    const size_t space = LOG_CAPACITY - host->logUsed;
+
+    if (space <= 1)
+      return 0;
+
+    const int written =
+        vsnprintf(host->logText + host->logUsed, space, format, args);
+
+    if (written > 0)
+      host->logUsed += std::min(static_cast<size_t>(written), space - 1);
+
+    return written;
+  }
+
+  static int log_printf(LV2_Log_Handle handle, LV2_URID type,
+                        const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    const int written = log_vprintf(handle, type, format, args);
+    va_end(args);
+
+    return written;
+  }
+
+  static LV2_Worker_Status schedule_work(LV2_Worker_Schedule_Handle handle,
+                                         uint32_t size, const void *data) {
+    auto host = static_cast<Host *>(handle);
+
+    return push(host->requests, host->requestCount, size, data)
+               ? LV2_WORKER_SUCCESS
+               : LV2_WORKER_ERR_NO_SPACE;
+  }
+
+  static LV2_Worker_Status respond(LV2_Worker_Respond_Handle handle,
+                                   uint32_t size, const void *data) {
+    auto host = static_cast<Host *>(handle);
+
+    return push(host->responses, host->responseCount, size, data)
+               ? LV2_WORKER_SUCCESS
+               : LV2_WORKER_ERR_NO_SPACE;
+  }
+
+  static char *copy_path(LV2_State_Map_Path_Handle, const char *path) {
+    return strdup(path);
+  }
+
+  static void free_path(LV2_State_Free_Path_Handle, char *path) {
+    free(path);
+  }
+
+  static LV2_State_Status store_value(LV2_State_Handle handle, uint32_t key,
+                                      const void *value, size_t size,
+                                      uint32_t type, uint32_t) {
+    auto host = static_cast<Host *>(handle);
+
+    host->stored[key] = {
+        type, std::string(static_cast<const char *>(value), size)};
+
+    return LV2_STATE_SUCCESS;
+  }
+
+  static const void *retrieve_value(LV2_State_Handle handle, uint32_t key,
+                                    size_t *size, uint32_t *type,
+                                    uint32_t *flags) {
+    auto host = static_cast<Host *>(handle);
+    const auto value = host->stored.find(key);
+
+    if (value == host->stored.end())
+      return nullptr;
+
+    *size = value->second.data.size();
+    *type = value->second.type;
+    *flags = LV2_STATE_IS_POD;
+
+    return value->second.data.data();
+  }
+};
+
+void step(const char *name) { printf("%s\n", name); }
+
+void run_for(Host &host, int cycles, uint32_t frames = 128) {
+  for (int i = 0; i < cycles; ++i)
+    host.cycle(frames);
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  const char *irPath = nullptr;
+  std::vector<std::string> models;
+
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "-i") && i + 1 < argc) {
+      irPath = argv[++i];
+    } else if (argv[i][0] == '-') {
+      fprintf(stderr, "usage: %s [-i ir.wav] [model_a [model_b]]\n", argv[0]);
+      return 1;
+    } else {
+      models.emplace_back(argv[i]);
+    }
+  }
+
+  if (models.size() < 1)
+    models.emplace_back(NAM_MODELS_DIR "/BossLSTM-1x16.nam");
+  if (models.size() < 2)
+    models.emplace_back(NAM_MODELS_DIR "/BossWN-feather.nam");
+
+  Host host;
+
+  if (!host.instantiate(NAM_MODELS_DIR "/")) {
+    fprintf(stderr, "nam-rtcheck: instantiation failed\n");
+    return 1;
+  }
+
+  step("idle without a model");
+  run_for(host, 50);
+
+  step("load into slot A");
+  host.set_path(MODEL_URI, models[0].c_str());
+  if (!host.settle())
+    fprintf(stderr, "nam-rtcheck: worker did not settle\n");
+
+  step("load into slot B");
+  host.control_port(kModelSlot) = 1.0f;
+  host.cycle(128);
+  host.set_path(MODEL_URI, models[1].c_str());
+  host.settle();
+
+  step("switch slots");
+  for (int i = 0; i < 8; ++i) {
+    host.control_port(kModelSlot) = static_cast<float>(i % 2);
+    run_for(host, 20);
+  }
+
+  step("bypass and unbypass");
+  host.control_port(kEnabled) = 0.0f;
+  run_for(host, 50);
+  host.control_port(kEnabled) = 1.0f;
+  run_for(host, 50);
+
+  step("hard bypass and unbypass");
+  host.control_port(kHardBypass) = 1.0f;
+  host.settle();
+  host.control_port(kHardBypass) = 0.0f;
+  run_for(host, 100);
+
+  step("gain changes");
+  for (int i = 0; i < 20; ++i) {
+    host.control_port(kInputLevel) = static_cast<float>(i % 5) * 4.0f - 8.0f;
+    host.control_port(kOutputLevel) = static_cast<float>(i % 3) * -3.0f;
+    run_for(host, 5);
+  }
+
+  step("backend changes");
+  for (float backend : {1.0f, 2.0f, 0.0f}) {
+    host.control_port(kBackend) = backend;
+    host.settle();
+  }
+
+  if (irPath != nullptr) {
+    step("load and clear an IR");
+    host.set_path(IR_URI, irPath);
+    host.settle();
+    run_for(host, 50);
+    host.set_path(IR_URI, "");
+    host.settle();
+  }
+
+  step("patch:Get");
+  host.get();
+  run_for(host, 2);
+
+  step("save and restore");
+  host.save();
+  host.restore();
+  host.settle();
+
+  step("restore with load on first use");
+  host.control_port(kLoadOnFirstUse) = 1.0f;
+  host.restore();
+  for (int i = 0; i < 20; ++i)
+    host.cycle(128, true);
+  host.settle();
+  host.control_port(kLoadOnFirstUse) = 0.0f;
+
+  step("block sizes");
+  for (uint32_t frames : {1u, 17u, 64u, 256u, 511u, 512u})
+    run_for(host, 20, frames);
+
+  step("max block length changes");
+  for (int32_t frames : {64, 256, MAX_BLOCK}) {
+    host.set_max_block(frames);
+    run_for(host, 20, static_cast<uint32_t>(frames));
+  }
+
+  step("silence");
+  for (int i = 0; i < 100; ++i)
+    host.cycle(128, true);
+
+  step("freewheel");
+  host.control_port(kFreewheel) = 1.0f;
+  run_for(host, 20);
+  host.control_port(kEnabled) = 0.0f;
+  run_for(host, 20);
+  host.control_port(kEnabled) = 1.0f;
+  host.settle();
+  host.control_port(kFreewheel) = 0.0f;
+  run_for(host, 20);
+
+  step("record a take");
+  char recordDir[] = "/tmp/nam-rtcheck-XXXXXX";
+  if (mkdtemp(recordDir) != nullptr) {
+    setenv("NAM_RECORD_DIR", recordDir, 1);
+    host.control_port(kRecord) = 1.0f;
+    host.settle();
+    run_for(host, 100);
+    host.control_port(kRecord) = 0.0f;
+    run_for(host, 10);
+
+    // let the writer close the take before removing it
+    std::this_thread::sleep_for(4 * NAM::Recorder::INTERVAL);
+    std::filesystem::remove_all(recordDir);
+  }
+
+  step("clear the model");
+  host.control_port(kModelSlot) = 0.0f;
+  host.set_path(MODEL_URI, "");
+  host.settle();
+
+  const unsigned long violations = nam_rt_violations();
+  printf("%lu violation(s) in audio-thread sections\n", violations);
+
+  return violations > 0 ? 1 : 0;
+}
@@ -0,0 +1,617 @@
+// Runs many instances of the LV2 plugin on many pinned threads, the way a
+// host with a parallel processing graph does, to expose contention between
+// instances: NeuralAudio's process-wide settings, the allocator, the shared
+// stats page, false sharing.
+//
+// usage: nam-scale [-n max_instances] [-t max_threads] [-b block_size]
+//                  [-p periods] [model]
+//
+// For every instance count N and thread count M, both powers of two, the
+// first N instances are spread round-robin over M threads pinned to their own
+// cores. Each period all threads leave a barrier together and run their
+// instances once; the period lasts until the slowest thread is done, like a
+// host's deadline. Reported for each configuration:
+//
+//   blocks/s  instance blocks processed per second of period time
+//   scaling   blocks/s against ideal linear scaling of the 1x1 run, which is
+//             min(N, M) times its rate; 1.00 means no contention at all
+//   p50..max  period times, in ms and as a share of the block's duration
+//   IPC, LLC  instructions per cycle and last level cache misses per block,
+//             from perf_event_open when the kernel allows it
+//             (perf_event_paranoid <= 2, or CAP_PERFMON)
+//
+// Cache misses that grow with M at a fixed N point at data shared between
+// threads rather than a lack of cores.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <lv2/atom/forge.h>
+#include <lv2/buf-size/buf-size.h>
+#include <lv2/core/lv2.h>
+#include <lv2/log/log.h>
+#include <lv2/options/options.h>
+#include <lv2/patch/patch.h>
+#include <lv2/urid/urid.h>
+#include <lv2/worker/worker.h>
+
+#include "nam_plugin.h"
+
+namespace {
+constexpr double SAMPLE_RATE = 48000.0;
+constexpr size_t ATOM_CAPACITY = 8192;
+constexpr size_t MAX_MESSAGE = 2048;
+constexpr size_t QUEUE_SIZE = 64;
+constexpr int MAX_LOAD_CYCLES = 20000;
+
+using Clock = std::chrono::steady_clock;
+
+// ports, in the order of NAM::Plugin::Ports
+enum Port {
+  kControl,
+  kNotify,
+  kAudioIn,
+  kAudioOut,
+  kInputLevel,
+  kOutputLevel,
+  kEnabled,
+  kHardBypass,
+  kLatency,
+  kModelSlot,
+  kBackend,
+  kLoadOnFirstUse,
+  kInputPeak,
+  kInputRMS,
+  kModelInputPeak,
+  kOutputPeak,
+  kOutputRMS,
+  kRecord,
+  kFreewheel
+};
+
+struct Message {
+  uint32_t size;
+  alignas(8) uint8_t data[MAX_MESSAGE];
+};
+
+// One plugin instance and the host side it needs. The worker runs
+// synchronously on whichever thread calls service(), between periods.
+class Instance {
+public:
+  explicit Instance(uint32_t blockSize)
+      : blockSize(blockSize), input(blockSize), output(blockSize) {
+    map.handle = this;
+    map.map = map_uri;
+
+    log.handle = this;
+    log.printf = log_printf;
+    log.vprintf = log_vprintf;
+
+    schedule.handle = this;
+    schedule.schedule_work = schedule_work;
+
+    maxBlock = static_cast<int32_t>(blockSize);
+    options[0] = {LV2_OPTIONS_INSTANCE,
+                  0,
+                  map_uri(this, LV2_BUF_SIZE__maxBlockLength),
+                  sizeof(int32_t),
+                  map_uri(this, LV2_ATOM__Int),
+                  &maxBlock};
+    options[1] = {LV2_OPTIONS_INSTANCE, 0, 0, 0, 0, nullptr};
+
+    features[0] = {LV2_URID__map, &map};
+    features[1] = {LV2_LOG__log, &log};
+    features[2] = {LV2_WORKER__schedule, &schedule};
+    features[3] = {LV2_OPTIONS__options, options};
+    for (size_t i = 0; i < 4; ++i)
+      featureList[i] = &features[i];
+    featureList[4] = nullptr;
+
+    lv2_atom_forge_init(&forge, &map);
+    std::fill(std::begin(controls), std::end(controls), 0.0f);
+    controls[kEnabled] = 1.0f;
+
+    // a guitar-like level, different for every instance
+    for (uint32_t i = 0; i < blockSize; ++i)
+      input[i] = 0.2f * std::sin(static_cast<float>(i) * 0.05f +
+                                 static_cast<float>(nextSeed++));
+  }
+
+  ~Instance() {
+    if (instance != nullptr)
+      descriptor->cleanup(instance);
+  }
+
+  Instance(const Instance &) = delete;
+  Instance &operator=(const Instance &) = delete;
+
+  bool instantiate(const char *bundlePath) {
+    descriptor = lv2_descriptor(0);
+    instance = descriptor->instantiate(descriptor, SAMPLE_RATE, bundlePath,
+                                       featureList);
+
+    if (instance == nullptr)
+      return false;
+
+    worker = static_cast<const LV2_Worker_Interface *>(
+        descriptor->extension_data(LV2_WORKER__interface));
+
+    descriptor->connect_port(instance, kControl, control);
+    descriptor->connect_port(instance, kNotify, notify);
+    descriptor->connect_port(instance, kAudioIn, input.data());
+    descriptor->connect_port(instance, kAudioOut, output.data());
+
+    for (uint32_t port = kInputLevel; port <= kFreewheel; ++port)
+      descriptor->connect_port(instance, port, &controls[port]);
+
+    descriptor->activate(instance);
+    empty_control();
+
+    return true;
+  }
+
+  // sends the model and runs until the worker is idle
+  bool load(const char *path) {
+    LV2_Atom_Forge_Frame sequence;
+    LV2_Atom_Forge_Frame frame;
+
+    lv2_atom_forge_set_buffer(&forge, control, sizeof(control));
+    lv2_atom_forge_sequence_head(&forge, &sequence, 0);
+    lv2_atom_forge_frame_time(&forge, 0);
+    lv2_atom_forge_object(&forge, &frame, 0, map_uri(this, LV2_PATCH__Set));
+    lv2_atom_forge_key(&forge, map_uri(this, LV2_PATCH__property));
+    lv2_atom_forge_urid(&forge, map_uri(this, MODEL_URI));
+    lv2_atom_forge_key(&forge, map_uri(this, LV2_PATCH__value));
+    lv2_atom_forge_path(&forge, path, static_cast<uint32_t>(strlen(path)) + 1);
+    lv2_atom_forge_pop(&forge, &frame);
+    lv2_atom_forge_pop(&forge, &sequence);
+
+    run();
+    empty_control();
+
+    for (int i = 0; i < MAX_LOAD_CYCLES; ++i) {
+      service();
+      run();
+
+      if (requestCount == 0 && responseCount == 0)
+        return true;
+    }
+
+    return false;
+  }
+
+  void run() noexcept {
+    reinterpret_cast<LV2_Atom *>(notify)->size = ATOM_CAPACITY;
+    descriptor->run(instance, blockSize);
+  }
+
+  // worker responses and requests left by the last run()
+  void service() {
+    for (size_t i = 0; i < responseCount; ++i)
+      worker->work_response(instance, responses[i].size, responses[i].data);
+
+    responseCount = 0;
+
+    for (size_t i = 0; i < requestCount; ++i)
+      worker->work(instance, respond, this, requests[i].size,
+                   requests[i].data);
+
+    requestCount = 0;
+  }
+
+private:
+  static inline unsigned nextSeed = 0;
+
+  const LV2_Descriptor *descriptor = nullptr;
+  LV2_Handle instance = nullptr;
+  const LV2_Worker_Interface *worker = nullptr;
+
+  std::vector<std::string> uris;
+  LV2_URID_Map map = {};
+  LV2_Log_Log log = {};
+  LV2_Worker_Schedule schedule = {};
+  int32_t maxBlock;
+  LV2_Options_Option options[2];
+  LV2_Feature features[4];
+  const LV2_Feature *featureList[5];
+
+  LV2_Atom_Forge forge = {};
+  alignas(8) uint8_t control[ATOM_CAPACITY];
+  alignas(8) uint8_t notify[ATOM_CAPACITY];
+  uint32_t blockSize;
+  std::vector<float> input;
+  std::vector<float> output;
+  float controls[kFreewheel + 1];
+
+  Message requests[QUEUE_SIZE];
+  Message responses[QUEUE_SIZE];
+  size_t requestCount = 0;
+  size_t responseCount = 0;
+
+  void empty_control() {
+    LV2_Atom_Forge_Frame sequence;
+
+    lv2_atom_forge_set_buffer(&forge, control, sizeof(control));
+    lv2_atom_forge_sequence_head(&forge, &sequence, 0);
+    lv2_atom_forge_pop(&forge, &sequence);
+  }
+
+  static bool push(Message *queue, size_t &count, uint32_t size,
+                   const void *data) {
+    if (count == QUEUE_SIZE || size > MAX_MESSAGE)
+      return false;
+
+    queue[count].size = size;
+    memcpy(queue[count].data, data, size);
+    ++count;
+
+    return true;
+  }
+
+  static LV2_URID map_uri(LV2_URID_Map_Handle handle, const char *uri) {
+    auto host = static_cast<Instance *>(handle);
+
+    for (size_t i = 0; i < host->uris.size(); ++i)
+      if (host->uris[i] == uri)
+        return static_cast<LV2_URID>(i + 1);
+
+    host->uris.emplace_back(uri);
+
+    return static_cast<LV2_URID>(host->uris.size());
+  }
+
+  static int log_vprintf(LV2_Log_Handle, LV2_URID, const char *, va_list) {
+    return 0;
+  }
+
+  static int log_printf(LV2_Log_Handle, LV2_URID, const char *, ...) {
+    return 0;
+  }
+
+  static LV2_Worker_Status schedule_work(LV2_Worker_Schedule_Handle handle,
+                                         uint32_t size, const void *data) {
+    auto host = static_cast<Instance *>(handle);
+
+    return push(host->requests, host->requestCount, size, data)
+               ? LV2_WORKER_SUCCESS
+               : LV2_WORKER_ERR_NO_SPACE;
+  }
+
+  static LV2_Worker_Status respond(LV2_Worker_Respond_Handle handle,
+                                   uint32_t size, const void *data) {
+    auto host = static_cast<Instance *>(handle);
+
+    return push(host->responses, host->responseCount, size, data)
+               ? LV2_WORKER_SUCCESS
+               : LV2_WORKER_ERR_NO_SPACE;
+  }
+};
+
+void cpu_pause() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield");
+#endif
+}
+
+// Sense-reversing spin barrier, so that waking up costs no syscall and all
+// threads start a period within a few hundred nanoseconds of each other
+class SpinBarrier {
+public:
+  explicit SpinBarrier(unsigned count) : count(count) {}
+
+  void wait() noexcept {
+    const unsigned generation =
+        this->generation.load(std::memory_order_acquire);
+
+    if (arrived.fetch_add(1, std::memory_order_acq_rel) + 1 == count) {
+      arrived.store(0, std::memory_order_relaxed);
+      this->generation.store(generation + 1, std::memory_order_release);
+      return;
+    }
+
+    while (this->generation.load(std::memory_order_acquire) == generation)
+      cpu_pause();
+  }
+
+private:
+  const unsigned count;
+  alignas(64) std::atomic<unsigned> arrived{0};
+  alignas(64) std::atomic<unsigned> generation{0};
+};
+
+// Cycles, instructions and last level cache misses of the calling thread,
+// read as one group. Unavailable when perf_event_open is refused.
+class Counters {
+public:
+  enum Counter { kCycles, kInstructions, kCacheMisses, kCount };
+
+  Counters() {
+    const uint64_t configs[kCount] = {PERF_COUNT_HW_CPU_CYCLES,
+                                      PERF_COUNT_HW_INSTRUCTIONS,
+                                      PERF_COUNT_HW_CACHE_MISSES};
+
+    for (int i = 0; i < kCount; ++i) {
+      perf_event_attr attr = {};
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.size = sizeof(attr);
+      attr.config = configs[i];
+      attr.disabled = (i == 0) ? 1 : 0;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_GROUP;
+
+      fds[i] = static_cast<int>(
+          syscall(SYS_perf_event_open, &attr, 0, -1, fds[0], 0));
+
+      if (fds[i] < 0) {
+        close_all();
+        return;
+      }
+    }
+  }
+
+  ~Counters() { close_all(); }
+
+  Counters(const Counters &) = delete;
+  Counters &operator=(const Counters &) = delete;
+
+  bool available() const noexcept { return fds[0] >= 0; }
+
+  void start() noexcept {
+    if (available())
+      ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  }
+
+  void stop() noexcept {
+    if (available())
+      ioctl(fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+  }
+
+  // totals since the counters were opened
+  bool read(uint64_t (&values)[kCount]) const noexcept {
+    struct {
+      uint64_t count;
+      uint64_t values[kCount];
+    } group = {};
+
+    if (!available() || ::read(fds[0], &group, sizeof(group)) < 0 ||
+        group.count != kCount)
+      return false;
+
+    std::copy(std::begin(group.values), std::end(group.values), values);
+
+    return true;
+  }
+
+private:
+  int fds[kCount] = {-1, -1, -1};
+
+  void close_all() {
+    for (int &fd : fds) {
+      if (fd >= 0)
+        close(fd);
+
+      fd = -1;
+    }
+  }
+};
+
+// what each thread measured, on its own cache lines
+struct alignas(64) ThreadResult {
+  std::vector<double> periods; // seconds
+  uint64_t counters[Counters::kCount] = {};
+  bool counted = false;
+};
+
+struct Result {
+  double blocksPerSecond;
+  double p50;
+  double p99;
+  double max;
+  double ipc;
+  double missesPerBlock;
+  bool counted;
+};
+
+void pin(unsigned cpu) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+Result measure(std::vector<std::unique_ptr<Instance>> &instances,
+               unsigned count, unsigned threads, unsigned periods) {
+  const unsigned warmup = std::max(10u, periods / 10);
+  SpinBarrier barrier(threads);
+  std::vector<ThreadResult> results(threads);
+
+  const auto body = [&](unsigned index) {
+    pin(index % std::thread::hardware_concurrency());
+
+    ThreadResult &result = results[index];
+    result.periods.resize(periods);
+    Counters counters;
+
+    for (unsigned period = 0; period < warmup + periods; ++period) {
+      const bool measured = period >= warmup;
+
+      barrier.wait();
+
+      if (measured)
+        counters.start();
+
+      const auto start = Clock::now();
+
+      for (unsigned i = index; i < count; i += threads)
+        instances[i]->run();
+
+      const std::chrono::duration<double> elapsed = Clock::now() - start;
+
+      if (measured) {
+        counters.stop();
+        result.periods[period - warmup] = elapsed.count();
+      }
+
+      // outside the period, like a host's worker thread
+      for (unsigned i = index; i < count; i += threads)
+        instances[i]->service();
+    }
+
+    result.counted = counters.read(result.counters);
+  };
+
+  std::vector<std::thread> pool;
+
+  for (unsigned i = 1; i < threads; ++i)
+    pool.emplace_back(body, i);
+
+  body(0);
+
+  for (auto &thread : pool)
+    thread.join();
+
+  // a period ends when its slowest thread is done
+  std::vector<double> times(periods, 0.0);
+  uint64_t totals[Counters::kCount] = {};
+  bool counted = true;
+
+  for (const ThreadResult &result : results) {
+    for (unsigned p = 0; p < periods; ++p)
+      times[p] = std::max(times[p], result.periods[p]);
+
+    for (int c = 0; c < Counters::kCount; ++c)
+      totals[c] += result.counters[c];
+
+    counted = counted && result.counted;
+  }
+
+  double total = 0.0;
+  for (double time : times)
+    total += time;
+
+  std::sort(times.begin(), times.end());
+
+  const double blocks = static_cast<double>(count) * periods;
+
+  Result result = {};
+  result.blocksPerSecond = blocks / total;
+  result.p50 = times[periods / 2];
+  result.p99 = times[std::min<size_t>(periods - 1, periods * 99 / 100)];
+  result.max = times.back();
+  result.counted = counted && totals[Counters::kCycles] > 0;
+
+  if (result.counted) {
+    result.ipc = static_cast<double>(totals[Counters::kInstructions]) /
+                 static_cast<double>(totals[Counters::kCycles]);
+    result.missesPerBlock =
+        static_cast<double>(totals[Counters::kCacheMisses]) / blocks;
+  }
+
+  return result;
+}
+
+void usage(const char *name) {
+  fprintf(stderr,
+          "usage: %s [-n max_instances] [-t max_threads] [-b block_size] "
+          "[-p periods] [model]\n",
+          name);
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  unsigned maxInstances = 32;
+  unsigned maxThreads = std::max(1u, std::thread::hardware_concurrency());
+  uint32_t blockSize = 128;
+  unsigned periods = 2000;
+  std::string model = NAM_MODELS_DIR "/BossWN-feather.nam";
+
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+      maxInstances = static_cast<unsigned>(std::max(1, atoi(argv[++i])));
+    } else if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+      maxThreads = static_cast<unsigned>(std::max(1, atoi(argv[++i])));
+    } else if (!strcmp(argv[i], "-b") && i + 1 < argc) {
+      blockSize = static_cast<uint32_t>(std::max(1, atoi(argv[++i])));
+    } else if (!strcmp(argv[i], "-p") && i + 1 < argc) {
+      periods = static_cast<unsigned>(std::max(10, atoi(argv[++i])));
+    } else if (argv[i][0] == '-') {
+      usage(argv[0]);
+      return 1;
+    } else {
+      model = argv[i];
+    }
+  }
+
+  // spinning threads sharing a core would only measure the scheduler
+  maxThreads = std::min(maxThreads, std::thread::hardware_concurrency());
+
+  std::vector<std::unique_ptr<Instance>> instances;
+
+  for (unsigned i = 0; i < maxInstances; ++i) {
+    instances.push_back(std::make_unique<Instance>(blockSize));
+
+    if (!instances.back()->instantiate(NAM_MODELS_DIR "/") ||
+        !instances.back()->load(model.c_str())) {
+      fprintf(stderr, "nam-scale: cannot run %s\n", model.c_str());
+      return 1;
+    }
+  }
+
+  const double deadline = blockSize / SAMPLE_RATE;
+  const Counters probe;
+
+  printf("%s, %u samples per block (%.3f ms)%s\n\n", model.c_str(), blockSize,
+         deadline * 1000,
+         probe.available() ? "" : ", no hardware counters");
+  printf("%9s %7s %10s %7s %8s %8s %8s %6s %5s %9s\n", "instances",
+         "threads", "blocks/s", "scaling", "p50 ms", "p99 ms", "max ms",
+         "p99 %", "IPC", "LLC/blk");
+
+  double baseline = 0.0;
+
+  for (unsigned count = 1; count <= maxInstances; count *= 2) {
+    for (unsigned threads = 1; threads <= std::min(count, maxThreads);
+         threads *= 2) {
+      const Result result = measure(instances, count, threads, periods);
+
+      if (baseline == 0.0)
+        baseline = result.blocksPerSecond;
+
+      const double ideal = baseline * std::min(count, threads);
+
+      printf("%9u %7u %10.0f %7.2f %8.3f %8.3f %8.3f %6.1f", count, threads,
+             result.blocksPerSecond, result.blocksPerSecond / ideal,
+             result.p50 * 1000, result.p99 * 1000, result.max * 1000,
+             100.0 * result.p99 / deadline);
+
+      if (result.counted)
+        printf(" %5.2f %9.0f\n", result.ipc, result.missesPerBlock);
+      else
+        printf(" %5s %9s\n", "-", "-");
+
+      fflush(stdout);
+    }
+  }
+
+  return 0;
+}
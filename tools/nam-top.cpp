@@ -0,0 +1,203 @@
+// Live view of every plugin instance on the machine, from the stats they
+// publish in shared memory (see src/nam_stats.h)
+//
+// usage: nam-top [-d seconds] [-1]
+//
+// -d sets the refresh interval, -1 prints one snapshot and exits. Instances
+// are sorted by DSP load; LOAD is the smoothed share of each block period
+// spent in the plugin, PEAK the highest over the last second, and MISS the
+// blocks that took longer than their own duration.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "nam_stats.h"
+
+namespace {
+struct Row {
+  size_t index;
+  int32_t pid;
+  std::string model;
+  std::string architecture;
+  uint32_t sampleRate;
+  uint32_t blockSize;
+  uint32_t dspLoad;
+  uint32_t peakLoad;
+  bool bypassed;
+  bool idle;
+  uint32_t loads;
+  uint32_t lastLoadUs;
+  uint64_t deadlineMisses;
+};
+
+char segmentName[64];
+
+const NAM::StatsPage *open_page() {
+  const int fd = shm_open(segmentName, O_RDONLY, 0);
+
+  if (fd < 0)
+    return nullptr;
+
+  void *memory =
+      mmap(nullptr, sizeof(NAM::StatsPage), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if (memory == MAP_FAILED)
+    return nullptr;
+
+  auto page = static_cast<const NAM::StatsPage *>(memory);
+
+  if (page->magic.load(std::memory_order_acquire) != NAM::StatsPage::MAGIC ||
+      page->version != NAM::StatsPage::VERSION ||
+      page->numSlots != NAM::StatsPage::NUM_SLOTS ||
+      page->slotSize != sizeof(NAM::StatsSlot)) {
+    fprintf(stderr, "nam-top: %s was written by an incompatible version\n",
+            segmentName);
+    exit(1);
+  }
+
+  return page;
+}
+
+std::string file_name(const char *path) {
+  const char *slash = strrchr(path, '/');
+  return (slash != nullptr) ? slash + 1 : path;
+}
+
+// instances that stopped processing keep their last load, so it is flagged
+std::vector<Row> read_rows(const NAM::StatsPage &page,
+                           std::vector<uint64_t> &lastBlocks) {
+  std::vector<Row> rows;
+
+  for (size_t i = 0; i < NAM::StatsPage::NUM_SLOTS; ++i) {
+    const NAM::StatsSlot &slot = page.slots[i];
+    const int32_t pid = slot.owner.load(std::memory_order_acquire);
+
+    // free, being claimed, or left behind by a crashed process
+    if (pid <= 0 || !NAM::stats_owner_alive(slot, pid))
+      continue;
+
+    char path[NAM::StatsSlot::PATH_SIZE];
+    char architecture[NAM::StatsSlot::ARCHITECTURE_SIZE];
+
+    if (!NAM::read_stats_strings(slot, path, architecture))
+      strcpy(path, "?");
+
+    const uint64_t blocks = slot.blocks.load(std::memory_order_relaxed);
+
+    Row row;
+    row.index = i;
+    row.pid = pid;
+    row.model = path[0] ? file_name(path) : "-";
+    row.architecture = architecture[0] ? architecture : "-";
+    row.sampleRate = slot.sampleRate.load(std::memory_order_relaxed);
+    row.blockSize = slot.blockSize.load(std::memory_order_relaxed);
+    row.dspLoad = slot.dspLoad.load(std::memory_order_relaxed);
+    row.peakLoad = slot.peakLoad.load(std::memory_order_relaxed);
+    row.bypassed = slot.bypassed.load(std::memory_order_relaxed) != 0;
+    row.idle = blocks == lastBlocks[i];
+    row.loads = slot.loads.load(std::memory_order_relaxed);
+    row.lastLoadUs = slot.lastLoadUs.load(std::memory_order_relaxed);
+    row.deadlineMisses = slot.deadlineMisses.load(std::memory_order_relaxed);
+
+    lastBlocks[i] = blocks;
+    rows.push_back(row);
+  }
+
+  std::sort(rows.begin(), rows.end(), [](const Row &a, const Row &b) {
+    return a.dspLoad > b.dspLoad;
+  });
+
+  return rows;
+}
+
+void print(const std::vector<Row> &rows) {
+  std::set<int32_t> processes;
+  uint64_t load = 0;
+  uint64_t misses = 0;
+
+  for (const Row &row : rows) {
+    processes.insert(row.pid);
+    load += row.idle ? 0 : row.dspLoad;
+    misses += row.deadlineMisses;
+  }
+
+  printf("%zu instances in %zu processes, total load %.1f%%, %llu deadline "
+         "misses\n\n",
+         rows.size(), processes.size(), load / 10.0,
+         static_cast<unsigned long long>(misses));
+
+  printf("%7s %4s %-28.28s %-10s %6s %5s %6s %6s %8s %5s %8s %s\n", "PID",
+         "SLOT", "MODEL", "ARCH", "RATE", "BLOCK", "LOAD%", "PEAK%", "MISS",
+         "LOADS", "LOAD-MS", "STATE");
+
+  for (const Row &row : rows) {
+    const char *state = row.idle ? "idle" : (row.bypassed ? "bypass" : "run");
+
+    printf("%7d %4zu %-28.28s %-10.10s %6u %5u %6.1f %6.1f %8llu %5u %8.1f "
+           "%s\n",
+           row.pid, row.index, row.model.c_str(), row.architecture.c_str(),
+           row.sampleRate, row.blockSize, row.dspLoad / 10.0,
+           row.peakLoad / 10.0,
+           static_cast<unsigned long long>(row.deadlineMisses), row.loads,
+           row.lastLoadUs / 1000.0, state);
+  }
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  double interval = 1.0;
+  bool once = false;
+
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "-d") && i + 1 < argc) {
+      interval = std::max(0.1, atof(argv[++i]));
+    } else if (!strcmp(argv[i], "-1")) {
+      once = true;
+    } else {
+      fprintf(stderr, "usage: %s [-d seconds] [-1]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  NAM::stats_segment_name(segmentName, sizeof(segmentName));
+  const NAM::StatsPage *page = open_page();
+
+  if (page == nullptr) {
+    fprintf(stderr, "nam-top: no instances have published stats (%s)\n",
+            segmentName);
+    return 1;
+  }
+
+  // the first pass only records block counts, or every instance looks idle
+  std::vector<uint64_t> lastBlocks(NAM::StatsPage::NUM_SLOTS, UINT64_MAX);
+  read_rows(*page, lastBlocks);
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+  for (;;) {
+    const std::vector<Row> rows = read_rows(*page, lastBlocks);
+
+    if (!once)
+      printf("\033[H\033[2J");
+
+    print(rows);
+    fflush(stdout);
+
+    if (once)
+      return 0;
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(interval));
+  }
+}
@@ -0,0 +1,537 @@
+// Generates a specialized kernel (see src/nam_kernel.h) from a NAM model:
+// every dimension becomes a compile-time constant and the weights constexpr
+// arrays, laid out for the building blocks in src/nam_kernel_ops.h.
+//
+// usage: nam2cpp [--fast-tanh] model.nam [-o kernel.cpp]
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <json.hpp>
+
+#include "nam_model_file.h"
+
+namespace {
+using json = nlohmann::json;
+
+// reads the flat weights array in NAM Core's order
+class WeightReader {
+public:
+  explicit WeightReader(const std::vector<float> &weights)
+      : weights(weights) {}
+
+  bool done() const { return pos == weights.size(); }
+
+  float next() {
+    if (pos >= weights.size())
+      throw std::runtime_error("not enough weights for the config");
+
+    return weights[pos++];
+  }
+
+  std::vector<float> vector(int n) {
+    std::vector<float> values(n);
+
+    for (auto &value : values)
+      value = next();
+
+    return values;
+  }
+
+  // stored [out][in], returned [in][out]
+  std::vector<float> conv1x1(int in, int out) {
+    std::vector<float> values(in * out);
+
+    for (int o = 0; o < out; ++o)
+      for (int i = 0; i < in; ++i)
+        values[i * out + o] = next();
+
+    return values;
+  }
+
+  // stored [out][in][k], returned [k][in][out]
+  std::vector<float> conv1d(int in, int out, int kernelSize) {
+    std::vector<float> values(kernelSize * in * out);
+
+    for (int o = 0; o < out; ++o)
+      for (int i = 0; i < in; ++i)
+        for (int k = 0; k < kernelSize; ++k)
+          values[(k * in + i) * out + o] = next();
+
+    return values;
+  }
+
+private:
+  const std::vector<float> &weights;
+  size_t pos = 0;
+};
+
+class Generator {
+public:
+  Generator(FILE *out, bool fastTanh) : out(out), fastTanh(fastTanh) {}
+
+  void array(const std::string &name, const std::vector<float> &values) {
+    fprintf(out, "alignas(32) constexpr float %s[] = {", name.c_str());
+
+    for (size_t i = 0; i < values.size(); ++i) {
+      if (!std::isfinite(values[i]))
+        throw std::runtime_error("non-finite weight in " + name);
+
+      fprintf(out, "%s%.9ef,", (i % 4 == 0) ? "\n    " : " ", values[i]);
+    }
+
+    fprintf(out, "\n};\n\n");
+  }
+
+  const char *activation(const std::string &name) const {
+    if (name == "Tanh")
+      return fastTanh ? "kFastTanh" : "kTanh";
+    if (name == "ReLU")
+      return "kReLU";
+    if (name == "Sigmoid")
+      return "kSigmoid";
+    if (name == "Hardtanh")
+      return "kHardTanh";
+
+    throw std::runtime_error("unsupported activation " + name);
+  }
+
+  void wavenet(const json &config, WeightReader &weights) {
+    if (!config.value("head", json()).is_null())
+      throw std::runtime_error("WaveNet head networks are not supported");
+
+    for (const auto &layer : config.at("layers")) {
+      if (layer.at("condition_size").get<int>() != 1)
+        throw std::runtime_error("condition_size must be 1");
+
+      arrays.push_back({layer.at("input_size").get<int>(),
+                        layer.at("head_size").get<int>(),
+                        layer.at("channels").get<int>(),
+                        layer.at("kernel_size").get<int>(),
+                        layer.at("dilations").get<std::vector<int>>(),
+                        activation(layer.at("activation").get<std::string>()),
+                        layer.at("gated").get<bool>(),
+                        layer.at("head_bias").get<bool>()});
+    }
+
+    if (arrays.empty())
+      throw std::runtime_error("no layer arrays");
+
+    for (size_t a = 0; a < arrays.size(); ++a) {
+      const bool chained =
+          (a == 0) ? arrays[a].inputSize == 1
+                   : arrays[a].inputSize == arrays[a - 1].channels &&
+                         arrays[a].channels == arrays[a - 1].headSize;
+
+      if (!chained)
+        throw std::runtime_error("layer array sizes don't chain");
+    }
+
+    if (arrays.back().headSize != 1)
+      throw std::runtime_error("the last head_size must be 1");
+
+    // weights, in file order
+    for (size_t a = 0; a < arrays.size(); ++a) {
+      const auto &array = arrays[a];
+      const int c = array.channels;
+      const int z = array.gated ? 2 * c : c;
+      const std::string prefix = "a" + std::to_string(a);
+
+      this->array(prefix + "_rechannel",
+                  weights.conv1x1(array.inputSize, c));
+
+      for (size_t l = 0; l < array.dilations.size(); ++l) {
+        const std::string layer = prefix + "_l" + std::to_string(l);
+
+        this->array(layer + "_conv", weights.conv1d(c, z, array.kernelSize));
+        this->array(layer + "_conv_bias", weights.vector(z));
+        this->array(layer + "_mixin", weights.conv1x1(1, z));
+        this->array(layer + "_1x1", weights.conv1x1(c, c));
+        this->array(layer + "_1x1_bias", weights.vector(c));
+      }
+
+      this->array(prefix + "_head", weights.conv1x1(c, array.headSize));
+
+      if (array.headBias)
+        this->array(prefix + "_head_bias", weights.vector(array.headSize));
+    }
+
+    fprintf(out, "constexpr float HEAD_SCALE = %.9ef;\n\n", weights.next());
+
+    // state: the history of every layer's input
+    fprintf(out, "struct State {\n  uint32_t pos;\n");
+
+    for (size_t a = 0; a < arrays.size(); ++a) {
+      for (size_t l = 0; l < arrays[a].dilations.size(); ++l) {
+        const int reach =
+            (arrays[a].kernelSize - 1) * arrays[a].dilations[l] + 1;
+        int ring = 1;
+
+        while (ring < reach)
+          ring *= 2;
+
+        rings.push_back(ring);
+        fprintf(out, "  alignas(32) float a%zu_l%zu[%d][%d];\n", a, l, ring,
+                arrays[a].channels);
+      }
+    }
+
+    fprintf(out, "};\n\n");
+
+    fprintf(out, "void reset(void *instance) {\n"
+                 "  std::memset(instance, 0, sizeof(State));\n"
+                 "}\n\n");
+
+    fprintf(out,
+            "void process(void *instance, const float *input, float *output,\n"
+            "             size_t n_samples) {\n"
+            "  State &s = *static_cast<State *>(instance);\n\n"
+            "  for (size_t i = 0; i < n_samples; ++i) {\n"
+            "    const float condition = input[i];\n"
+            "    const uint32_t pos = s.pos++;\n");
+
+    wavenet_step(Streams{false});
+
+    batch_header();
+    fprintf(out, "    float condition[NAM_KERNEL_MAX_BATCH];\n"
+                 "    uint32_t pos[NAM_KERNEL_MAX_BATCH];\n\n"
+                 "    for (size_t k = 0; k < streams; ++k) {\n"
+                 "      condition[k] = inputs[k][i];\n"
+                 "      pos[k] = s[k]->pos++;\n"
+                 "    }\n");
+
+    wavenet_step(Streams{true});
+  }
+
+  void lstm(const json &config, WeightReader &weights) {
+    const int layers = config.at("num_layers").get<int>();
+    const int inputSize = config.at("input_size").get<int>();
+    const int hidden = config.at("hidden_size").get<int>();
+
+    if (inputSize != 1 || layers < 1)
+      throw std::runtime_error("unsupported LSTM shape");
+
+    for (int l = 0; l < layers; ++l) {
+      const int in = (l == 0) ? inputSize : hidden;
+      const std::string layer = "l" + std::to_string(l);
+
+      // [4H][I + H] row major, same transposition as a 1x1 convolution
+      array(layer + "_w", weights.conv1x1(in + hidden, 4 * hidden));
+      array(layer + "_b", weights.vector(4 * hidden));
+      array(layer + "_h0", weights.vector(hidden));
+      array(layer + "_c0", weights.vector(hidden));
+    }
+
+    array("head_w", weights.vector(hidden));
+    fprintf(out, "constexpr float HEAD_BIAS = %.9ef;\n\n", weights.next());
+
+    fprintf(out, "struct State {\n");
+
+    for (int l = 0; l < layers; ++l) {
+      fprintf(out, "  alignas(32) float xh%d[%d];\n", l,
+              ((l == 0) ? inputSize : hidden) + hidden);
+      fprintf(out, "  alignas(32) float c%d[%d];\n", l, hidden);
+    }
+
+    fprintf(out, "};\n\n");
+
+    fprintf(out, "void reset(void *instance) {\n"
+                 "  State &s = *static_cast<State *>(instance);\n\n");
+
+    for (int l = 0; l < layers; ++l) {
+      const int in = (l == 0) ? inputSize : hidden;
+
+      fprintf(out,
+              "  std::memset(s.xh%d, 0, sizeof(s.xh%d));\n"
+              "  std::memcpy(s.xh%d + %d, l%d_h0, sizeof(l%d_h0));\n"
+              "  std::memcpy(s.c%d, l%d_c0, sizeof(l%d_c0));\n",
+              l, l, l, in, l, l, l, l, l);
+    }
+
+    fprintf(out, "}\n\n");
+
+    fprintf(out,
+            "void process(void *instance, const float *input, float *output,\n"
+            "             size_t n_samples) {\n"
+            "  State &s = *static_cast<State *>(instance);\n\n"
+            "  for (size_t i = 0; i < n_samples; ++i) {\n"
+            "    s.xh0[0] = input[i];\n");
+
+    lstm_step(Streams{false}, layers, inputSize, hidden);
+
+    batch_header();
+    fprintf(out, "    for (size_t k = 0; k < streams; ++k)\n"
+                 "      s[k]->xh0[0] = inputs[k][i];\n");
+
+    lstm_step(Streams{true}, layers, inputSize, hidden);
+  }
+
+private:
+  struct LayerArray {
+    int inputSize, headSize, channels, kernelSize;
+    std::vector<int> dilations;
+    std::string activation;
+    bool gated, headBias;
+  };
+
+  // How one step of the generated code addresses its state. process() runs
+  // one stream; process_batch() runs each step for all of its streams
+  // before the next, so the step's weights are fetched once for all of them.
+  struct Streams {
+    bool batch;
+
+    // prefix of a statement run for every stream
+    const char *each() const {
+      return batch ? "for (size_t k = 0; k < streams; ++k)\n      " : "";
+    }
+
+    // extent of a per-stream temporary, and the current stream's element
+    const char *dim() const { return batch ? "[NAM_KERNEL_MAX_BATCH]" : ""; }
+    const char *at() const { return batch ? "[k]" : ""; }
+
+    const char *state() const { return batch ? "s[k]->" : "s."; }
+    const char *output() const { return batch ? "outputs[k]" : "output"; }
+  };
+
+  void batch_header() {
+    fprintf(out,
+            "void process_batch(void *const *instances, "
+            "const float *const *inputs,\n"
+            "                   float *const *outputs, size_t streams,\n"
+            "                   size_t n_samples) {\n"
+            "  State *s[NAM_KERNEL_MAX_BATCH];\n\n"
+            "  for (size_t k = 0; k < streams; ++k)\n"
+            "    s[k] = static_cast<State *>(instances[k]);\n\n"
+            "  for (size_t i = 0; i < n_samples; ++i) {\n");
+  }
+
+  // the rest of the sample loop, once condition and pos are set
+  void wavenet_step(const Streams &st) {
+    const char *each = st.each();
+    const char *dim = st.dim();
+    const char *k = st.at();
+    size_t ring = 0;
+
+    for (size_t a = 0; a < arrays.size(); ++a) {
+      const auto &array = arrays[a];
+      const int c = array.channels;
+
+      fprintf(out, "\n    // layer array %zu\n", a);
+      fprintf(out, "    alignas(32) float x%zu%s[%d];\n", a, dim, c);
+
+      if (a == 0) {
+        fprintf(out,
+                "    %sdense<1, %d, false>(a0_rechannel, nullptr, "
+                "&condition%s, x0%s);\n",
+                each, c, k, k);
+        fprintf(out, "    alignas(32) float head0%s[%d] = {};\n", dim, c);
+      } else {
+        fprintf(out,
+                "    %sdense<%d, %d, false>(a%zu_rechannel, nullptr, x%zu%s, "
+                "x%zu%s);\n",
+                each, array.inputSize, c, a, a - 1, k, a, k);
+        fprintf(out, "    alignas(32) float head%zu%s[%d];\n", a, dim, c);
+        fprintf(out,
+                "    %sstd::memcpy(head%zu%s, headOut%zu%s, "
+                "sizeof(head%zu%s));\n",
+                each, a, k, a - 1, k, a, k);
+      }
+
+      for (size_t l = 0; l < array.dilations.size(); ++l, ++ring) {
+        fprintf(out,
+                "    %swavenet_layer<%d, %d, %d, %d, %s, %s>(\n"
+                "        a%zu_l%zu_conv, a%zu_l%zu_conv_bias, a%zu_l%zu_mixin, "
+                "a%zu_l%zu_1x1,\n"
+                "        a%zu_l%zu_1x1_bias, %sa%zu_l%zu, pos%s, condition%s, "
+                "x%zu%s, head%zu%s);\n",
+                each, c, array.kernelSize, array.dilations[l], rings[ring],
+                array.gated ? "true" : "false", array.activation.c_str(), a,
+                l, a, l, a, l, a, l, a, l, st.state(), a, l, k, k, a, k, a,
+                k);
+      }
+
+      fprintf(out, "    alignas(32) float headOut%zu%s[%d];\n", a, dim,
+              array.headSize);
+
+      if (array.headBias) {
+        fprintf(out,
+                "    %sdense<%d, %d, true>(a%zu_head, a%zu_head_bias, "
+                "head%zu%s, headOut%zu%s);\n",
+                each, c, array.headSize, a, a, a, k, a, k);
+      } else {
+        fprintf(out,
+                "    %sdense<%d, %d, false>(a%zu_head, nullptr, head%zu%s, "
+                "headOut%zu%s);\n",
+                each, c, array.headSize, a, a, k, a, k);
+      }
+    }
+
+    fprintf(out,
+            "\n    %s%s[i] = HEAD_SCALE * headOut%zu%s[0];\n"
+            "  }\n"
+            "}\n\n",
+            each, st.output(), arrays.size() - 1, k);
+  }
+
+  // the rest of the sample loop, once the input is in xh0
+  void lstm_step(const Streams &st, int layers, int inputSize, int hidden) {
+    const char *each = st.each();
+    const char *state = st.state();
+
+    for (int l = 0; l < layers; ++l) {
+      const int in = (l == 0) ? inputSize : hidden;
+
+      if (l > 0) {
+        fprintf(out,
+                "    %sstd::memcpy(%sxh%d, %sxh%d + %d, sizeof(float) * %d);\n",
+                each, state, l, state, l - 1, (l == 1) ? inputSize : hidden,
+                hidden);
+      }
+
+      fprintf(out,
+              "    %slstm_cell<%d, %d, %s>(l%d_w, l%d_b, %sxh%d, %sc%d);\n",
+              each, in, hidden, fastTanh ? "true" : "false", l, l, state, l,
+              state, l);
+    }
+
+    const int lastInput = (layers == 1) ? inputSize : hidden;
+
+    if (!st.batch) {
+      fprintf(out,
+              "\n    float y = HEAD_BIAS;\n\n"
+              "    for (int h = 0; h < %d; ++h)\n"
+              "      y += head_w[h] * s.xh%d[%d + h];\n\n"
+              "    output[i] = y;\n"
+              "  }\n"
+              "}\n\n",
+              hidden, layers - 1, lastInput);
+      return;
+    }
+
+    fprintf(out,
+            "\n    for (size_t k = 0; k < streams; ++k) {\n"
+            "      float y = HEAD_BIAS;\n\n"
+            "      for (int h = 0; h < %d; ++h)\n"
+            "        y += head_w[h] * s[k]->xh%d[%d + h];\n\n"
+            "      outputs[k][i] = y;\n"
+            "    }\n"
+            "  }\n"
+            "}\n\n",
+            hidden, layers - 1, lastInput);
+  }
+
+  FILE *out;
+  bool fastTanh;
+  std::vector<LayerArray> arrays;
+  std::vector<int> rings;
+};
+} // namespace
+
+int main(int argc, char **argv) {
+  const char *inputPath = nullptr;
+  const char *outputPath = nullptr;
+  bool fastTanh = false;
+
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+      outputPath = argv[++i];
+    } else if (!strcmp(argv[i], "--fast-tanh")) {
+      fastTanh = true;
+    } else if (argv[i][0] != '-' && inputPath == nullptr) {
+      inputPath = argv[i];
+    } else {
+      inputPath = nullptr;
+      break;
+    }
+  }
+
+  if (inputPath == nullptr) {
+    fprintf(stderr, "usage: %s [--fast-tanh] model.nam [-o kernel.cpp]\n",
+            argv[0]);
+    return 1;
+  }
+
+  NAM::ModelFile file;
+
+  file.readWeights = true;
+
+  if (!file.load(inputPath) || !file.is_nam()) {
+    fprintf(stderr, "%s: not a readable NAM model\n", inputPath);
+    return 1;
+  }
+
+  FILE *out = (outputPath != nullptr) ? fopen(outputPath, "w") : stdout;
+
+  if (out == nullptr) {
+    fprintf(stderr, "%s: can't write\n", outputPath);
+    return 1;
+  }
+
+  const std::string name = std::filesystem::path(inputPath).filename().string();
+  bool ok = true;
+
+  try {
+    const json config = json::parse(file.config);
+    WeightReader weights(file.weights);
+    Generator generator(out, fastTanh);
+
+    fprintf(out,
+            "// Generated by nam2cpp from %s, do not edit\n\n"
+            "#include <cstddef>\n"
+            "#include <cstdint>\n"
+            "#include <cstring>\n"
+            "#include <new>\n\n"
+            "#include \"nam_kernel.h\"\n"
+            "#include \"nam_kernel_ops.h\"\n\n"
+            "namespace {\n"
+            "using namespace NAM::kernel;\n\n",
+            name.c_str());
+
+    if (file.architecture == "WaveNet")
+      generator.wavenet(config, weights);
+    else if (file.architecture == "LSTM")
+      generator.lstm(config, weights);
+    else
+      throw std::runtime_error("unsupported architecture " + file.architecture);
+
+    if (!weights.done())
+      throw std::runtime_error("more weights than the config uses");
+
+    fprintf(out,
+            "void *create() {\n"
+            "  State *s = new (std::nothrow) State;\n\n"
+            "  if (s != nullptr)\n"
+            "    reset(s);\n\n"
+            "  return s;\n"
+            "}\n\n"
+            "void destroy(void *instance) {\n"
+            "  delete static_cast<State *>(instance);\n"
+            "}\n"
+            "} // namespace\n\n"
+            "NAM_KERNEL_EXPORT const NAMKernelDescriptor *"
+            "nam_kernel_descriptor() {\n"
+            "  static const NAMKernelDescriptor descriptor = {\n"
+            "      NAM_KERNEL_ABI_VERSION, 0x%016llxull, %.1f, \"%s\",\n"
+            "      create, destroy, reset, process, process_batch};\n\n"
+            "  return &descriptor;\n"
+            "}\n",
+            static_cast<unsigned long long>(file.hash()), file.sampleRate,
+            name.c_str());
+  } catch (const std::exception &e) {
+    fprintf(stderr, "%s: %s\n", inputPath, e.what());
+    ok = false;
+  }
+
+  if (out != stdout)
+    fclose(out);
+
+  if (!ok && outputPath != nullptr)
+    std::remove(outputPath);
+
+  return ok ? 0 : 1;
+}